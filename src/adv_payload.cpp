@@ -0,0 +1,146 @@
+#include "adv_payload.h"
+
+#include <string.h>
+#include "device_profile.h"
+
+int AdvPayload::addField(uint8_t type, const uint8_t *value, uint8_t valueLength)
+{
+  if (len + 2 + valueLength > ADV_PAYLOAD_MAX)
+  {
+    return -1;
+  }
+
+  buf[len++] = valueLength + 1;
+  buf[len++] = type;
+  int offset = len;
+  memcpy(&buf[len], value, valueLength);
+  len += valueLength;
+  return offset;
+}
+
+bool SensorPayload::addSpill(uint8_t type, const uint8_t *value, uint8_t valueLength)
+{
+  if (adv.addField(type, value, valueLength) >= 0)
+  {
+    return true;
+  }
+  return scanRsp.addField(type, value, valueLength) >= 0;
+}
+
+bool SensorPayload::build(uint8_t profile, const char *name, uint8_t bpm, uint8_t battery)
+{
+  static const uint8_t flags[SENSOR_FLAGS_LENGTH] = {0x06};
+  const DeviceProfile &p = deviceProfile(profile);
+  const uint8_t *uuids = (const uint8_t *)p.services;
+  uint8_t uuidsLength = p.serviceCount * 2;
+
+  adv.clear();
+  scanRsp.clear();
+  adv.addField(AD_TYPE_FLAGS, flags, sizeof(flags));
+  batteryOffset = -1;
+  bpmOffset = -1;
+  if (p.companyId != PROFILE_NO_COMPANY)
+  {
+    uint8_t mfr[2 + PROFILE_MFR_MAX] = {(uint8_t)(p.companyId & 0xFF), (uint8_t)(p.companyId >> 8)};
+    memcpy(&mfr[2], p.mfrFields, p.mfrLength);
+    int fieldsOffset = adv.addField(AD_TYPE_MANUFACTURER, mfr, 2 + p.mfrLength) + 2;
+    if (p.batteryOffset != PROFILE_FIELD_NONE)
+    {
+      batteryOffset = fieldsOffset + p.batteryOffset;
+    }
+    if (p.bpmOffset != PROFILE_FIELD_NONE)
+    {
+      bpmOffset = fieldsOffset + p.bpmOffset;
+    }
+  }
+  setBattery(battery);
+  setBpm(bpm);
+
+  if (adv.addField(AD_TYPE_UUID16_COMPLETE, uuids, uuidsLength) < 0)
+  {
+    adv.addField(AD_TYPE_UUID16_INCOMPLETE, uuids, 2);
+    scanRsp.addField(AD_TYPE_UUID16_COMPLETE, uuids, uuidsLength);
+  }
+
+  if (name == nullptr)
+  {
+    return true;
+  }
+
+  size_t nameLength = strlen(name);
+  if (nameLength <= SENSOR_NAME_MAX && addSpill(AD_TYPE_NAME_COMPLETE, (const uint8_t *)name, nameLength))
+  {
+    return true;
+  }
+  uint8_t room = ADV_PAYLOAD_MAX - scanRsp.length();
+  if (room > AD_FIELD_SIZE(0))
+  {
+    scanRsp.addField(AD_TYPE_NAME_SHORT, (const uint8_t *)name, room - AD_FIELD_SIZE(0));
+  }
+  return false;
+}
+
+void SensorPayload::setBattery(uint8_t battery)
+{
+  if (batteryOffset >= 0)
+  {
+    adv.patch(batteryOffset, battery);
+  }
+}
+
+void SensorPayload::setBpm(uint8_t bpm)
+{
+  if (bpmOffset >= 0)
+  {
+    adv.patch(bpmOffset, bpm);
+  }
+}
+
+static bool matchProfile(const DeviceProfile &p, const uint8_t *value, uint8_t valueLength,
+                         uint8_t &bpm, uint8_t &battery)
+{
+  if (p.bpmOffset == PROFILE_FIELD_NONE || valueLength != 2 + p.mfrLength ||
+      value[0] != (p.companyId & 0xFF) || value[1] != (p.companyId >> 8))
+  {
+    return false;
+  }
+  const uint8_t *fields = &value[2];
+  for (int i = 0; i < p.mfrLength; i++)
+  {
+    if (i != p.batteryOffset && i != p.bpmOffset && fields[i] != p.mfrFields[i])
+    {
+      return false;
+    }
+  }
+  bpm = fields[p.bpmOffset];
+  if (p.batteryOffset != PROFILE_FIELD_NONE)
+  {
+    battery = fields[p.batteryOffset];
+  }
+  return true;
+}
+
+bool sensorPayloadDecode(const uint8_t *data, uint8_t length, uint8_t &bpm, uint8_t &battery)
+{
+  uint8_t pos = 0;
+  while (pos + 1 < length)
+  {
+    uint8_t fieldLength = data[pos];
+    if (fieldLength == 0 || pos + 1 + fieldLength > length)
+    {
+      return false;
+    }
+    if (data[pos + 1] == AD_TYPE_MANUFACTURER)
+    {
+      for (size_t i = 0; i < DEVICE_PROFILE_COUNT; i++)
+      {
+        if (matchProfile(deviceProfiles[i], &data[pos + 2], fieldLength - 1, bpm, battery))
+        {
+          return true;
+        }
+      }
+    }
+    pos += 1 + fieldLength;
+  }
+  return false;
+}
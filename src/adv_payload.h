@@ -0,0 +1,59 @@
+#pragma once
+
+#include <stdint.h>
+
+#define ADV_PAYLOAD_MAX 31
+
+#define AD_TYPE_FLAGS 0x01
+#define AD_TYPE_UUID16_INCOMPLETE 0x02
+#define AD_TYPE_UUID16_COMPLETE 0x03
+#define AD_TYPE_NAME_SHORT 0x08
+#define AD_TYPE_NAME_COMPLETE 0x09
+#define AD_TYPE_MANUFACTURER 0xFF
+
+#define AD_FIELD_SIZE(valueLength) (2 + (valueLength))
+
+#define SENSOR_FLAGS_LENGTH 1
+#define SENSOR_NAME_MAX (ADV_PAYLOAD_MAX - AD_FIELD_SIZE(0))
+
+class AdvPayload
+{
+public:
+  AdvPayload() : len(0) {}
+
+  void clear() { len = 0; }
+  int addField(uint8_t type, const uint8_t *value, uint8_t valueLength);
+  void patch(uint8_t offset, uint8_t value) { buf[offset] = value; }
+
+  uint8_t *data() { return buf; }
+  const uint8_t *data() const { return buf; }
+  uint8_t length() const { return len; }
+
+private:
+  uint8_t buf[ADV_PAYLOAD_MAX];
+  uint8_t len;
+};
+
+class SensorPayload
+{
+public:
+  SensorPayload() : batteryOffset(-1), bpmOffset(-1) {}
+
+  bool build(uint8_t profile, const char *name, uint8_t bpm, uint8_t battery);
+  void setBattery(uint8_t battery);
+  void setBpm(uint8_t bpm);
+
+  AdvPayload adv;
+  AdvPayload scanRsp;
+
+private:
+  bool addSpill(uint8_t type, const uint8_t *value, uint8_t valueLength);
+
+  int batteryOffset;
+  int bpmOffset;
+};
+
+// Walks the AD structures of a received advertisement and matches the
+// manufacturer block against every profile that carries readings; false if
+// the packet is not one of ours.
+bool sensorPayloadDecode(const uint8_t *data, uint8_t length, uint8_t &bpm, uint8_t &battery);
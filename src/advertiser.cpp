@@ -0,0 +1,314 @@
+#include "advertiser.h"
+
+#include <string.h>
+#include "telemetry.h"
+
+// Fixed interval in ms; the controller still adds its own 0-10 ms advDelay.
+static uint16_t intervalUnits(uint16_t intervalMs)
+{
+  uint32_t units = (uint32_t)intervalMs * 1000 / 625;
+  if (units < 0x20)
+    units = 0x20;
+  if (units > 0x4000)
+    units = 0x4000;
+  return units;
+}
+
+#ifdef PHANTOM_BLE_NIMBLE
+
+#include <NimBLEDevice.h>
+
+#define ADV_INTERVAL_MIN_UNITS 0x20
+#define ADV_INTERVAL_MAX_UNITS 0x40
+
+static NimBLEAdvertising *advertising = nullptr;
+static bool running = false;
+
+static void setRaw(AdvPayload &payload, bool scanResponse)
+{
+  NimBLEAdvertisementData data;
+  data.addData((char *)payload.data(), payload.length());
+  if (scanResponse)
+  {
+    advertising->setScanResponseData(data);
+  }
+  else
+  {
+    advertising->setAdvertisementData(data);
+  }
+}
+
+void advertiserBegin()
+{
+  advertising = NimBLEDevice::getAdvertising();
+  advertising->setMinInterval(ADV_INTERVAL_MIN_UNITS);
+  advertising->setMaxInterval(ADV_INTERVAL_MAX_UNITS);
+  advertising->setScanResponse(true);
+  running = false;
+}
+
+void advertiserSetAddress(const uint8_t *addr)
+{
+  uint8_t native[6];
+  for (int i = 0; i < 6; i++)
+  {
+    native[i] = addr[5 - i];
+  }
+  if (ble_hs_id_set_rnd(native) == 0)
+  {
+    NimBLEDevice::setOwnAddrType(BLE_OWN_ADDR_RANDOM);
+  }
+}
+
+void advertiserSetInterval(uint16_t intervalMs)
+{
+  uint16_t units = intervalUnits(intervalMs);
+  advertising->setMinInterval(units);
+  advertising->setMaxInterval(units);
+}
+
+void advertiserSetConnectable(bool connectable)
+{
+  advertising->setAdvertisementType(connectable ? BLE_GAP_CONN_MODE_UND : BLE_GAP_CONN_MODE_NON);
+}
+
+bool advertiserSetPayload(AdvPayload &payload)
+{
+  setRaw(payload, false);
+  return true;
+}
+
+bool advertiserSetScanResponse(AdvPayload &scanRsp)
+{
+  setRaw(scanRsp, true);
+  return true;
+}
+
+bool advertiserStart()
+{
+  if (running)
+  {
+    advertiserStop();
+  }
+  running = advertising->start();
+  if (running)
+  {
+    telemetryCount(TELEMETRY_ADV_STARTS);
+  }
+  return running;
+}
+
+bool advertiserStop()
+{
+  running = false;
+  return advertising->stop();
+}
+
+bool advertiserRunning()
+{
+  return running;
+}
+
+// NimBLE-Arduino's legacy advertising API has no scan request events.
+bool advertiserReportScans(AdvScanHook hook)
+{
+  (void)hook;
+  return false;
+}
+
+#else
+
+#include <Arduino.h>
+#include "esp_gap_ble_api.h"
+
+static esp_ble_adv_params_t advParams;
+static bool running = false;
+
+// BLE 5 controllers only report scan requests for advertising sets, so with
+// a scan hook the same legacy PDUs go out through the extended commands.
+// A set has to exist before it takes an address or data, which is why that
+// path keeps both here and pushes everything again on every start.
+#if defined(SOC_BLE_50_SUPPORTED)
+
+#include <BLEDevice.h>
+
+#define ADVERTISER_INSTANCE 0
+
+static AdvScanHook scanHook = nullptr;
+static bool extended = false;
+static bool setCreated = false;
+static esp_bd_addr_t extAddr;
+static uint8_t advData[ADV_PAYLOAD_MAX];
+static uint8_t advLength = 0;
+static uint8_t rspData[ADV_PAYLOAD_MAX];
+static uint8_t rspLength = 0;
+
+static void onGapEvent(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_param_t *param)
+{
+  if (event == ESP_GAP_BLE_SCAN_REQ_RECEIVED_EVT && param->scan_req_received.adv_instance == ADVERTISER_INSTANCE &&
+      scanHook != nullptr)
+  {
+    scanHook();
+  }
+}
+
+static bool extStart()
+{
+  esp_ble_gap_ext_adv_params_t params;
+  memset(&params, 0, sizeof(params));
+  params.type = advParams.adv_type == ADV_TYPE_IND ? ESP_BLE_GAP_SET_EXT_ADV_PROP_LEGACY_IND
+                                                   : ESP_BLE_GAP_SET_EXT_ADV_PROP_LEGACY_SCAN;
+  params.interval_min = advParams.adv_int_min;
+  params.interval_max = advParams.adv_int_max;
+  params.channel_map = ADV_CHNL_ALL;
+  params.own_addr_type = advParams.own_addr_type;
+  params.peer_addr_type = BLE_ADDR_TYPE_PUBLIC;
+  params.filter_policy = ADV_FILTER_ALLOW_SCAN_ANY_CON_ANY;
+  params.tx_power = EXT_ADV_TX_PWR_NO_PREFERENCE;
+  params.primary_phy = ESP_BLE_GAP_PRI_PHY_1M;
+  params.secondary_phy = ESP_BLE_GAP_PHY_1M;
+  params.sid = ADVERTISER_INSTANCE;
+  params.scan_req_notif = true;
+
+  esp_ble_gap_ext_adv_t set = {ADVERTISER_INSTANCE, 0, 0};
+  setCreated = esp_ble_gap_ext_adv_set_params(ADVERTISER_INSTANCE, &params) == ESP_OK;
+  return setCreated &&
+         (advParams.own_addr_type != BLE_ADDR_TYPE_RANDOM ||
+          esp_ble_gap_ext_adv_set_rand_addr(ADVERTISER_INSTANCE, extAddr) == ESP_OK) &&
+         esp_ble_gap_config_ext_adv_data_raw(ADVERTISER_INSTANCE, advLength, advData) == ESP_OK &&
+         esp_ble_gap_config_ext_scan_rsp_data_raw(ADVERTISER_INSTANCE, rspLength, rspData) == ESP_OK &&
+         esp_ble_gap_ext_adv_start(1, &set) == ESP_OK;
+}
+
+bool advertiserReportScans(AdvScanHook hook)
+{
+  scanHook = hook;
+  if (!extended)
+  {
+    BLEDevice::setCustomGapHandler(onGapEvent);
+    extended = true;
+  }
+  return true;
+}
+
+#else
+
+bool advertiserReportScans(AdvScanHook hook)
+{
+  (void)hook;
+  return false;
+}
+
+#endif
+
+void advertiserBegin()
+{
+  memset(&advParams, 0, sizeof(advParams));
+  advParams.adv_int_min = 0x20;
+  advParams.adv_int_max = 0x40;
+  advParams.adv_type = ADV_TYPE_IND;
+  advParams.own_addr_type = BLE_ADDR_TYPE_PUBLIC;
+  advParams.channel_map = ADV_CHNL_ALL;
+  advParams.adv_filter_policy = ADV_FILTER_ALLOW_SCAN_ANY_CON_ANY;
+  running = false;
+}
+
+void advertiserSetAddress(const uint8_t *addr)
+{
+#if defined(SOC_BLE_50_SUPPORTED)
+  if (extended)
+  {
+    memcpy(extAddr, addr, sizeof(extAddr));
+    advParams.own_addr_type = BLE_ADDR_TYPE_RANDOM;
+    return;
+  }
+#endif
+  esp_bd_addr_t randAddr;
+  memcpy(randAddr, addr, sizeof(randAddr));
+  if (esp_ble_gap_set_rand_addr(randAddr) == ESP_OK)
+  {
+    advParams.own_addr_type = BLE_ADDR_TYPE_RANDOM;
+  }
+}
+
+void advertiserSetInterval(uint16_t intervalMs)
+{
+  advParams.adv_int_min = intervalUnits(intervalMs);
+  advParams.adv_int_max = advParams.adv_int_min;
+}
+
+// Scannable but not connectable once every connection slot is taken, so
+// scanners still see the band.
+void advertiserSetConnectable(bool connectable)
+{
+  advParams.adv_type = connectable ? ADV_TYPE_IND : ADV_TYPE_SCAN_IND;
+}
+
+// Live reading updates land while the set is enabled, which legacy PDUs allow.
+bool advertiserSetPayload(AdvPayload &payload)
+{
+#if defined(SOC_BLE_50_SUPPORTED)
+  if (extended)
+  {
+    advLength = payload.length();
+    memcpy(advData, payload.data(), advLength);
+    return !setCreated ||
+           esp_ble_gap_config_ext_adv_data_raw(ADVERTISER_INSTANCE, advLength, advData) == ESP_OK;
+  }
+#endif
+  return esp_ble_gap_config_adv_data_raw(payload.data(), payload.length()) == ESP_OK;
+}
+
+bool advertiserSetScanResponse(AdvPayload &scanRsp)
+{
+#if defined(SOC_BLE_50_SUPPORTED)
+  if (extended)
+  {
+    rspLength = scanRsp.length();
+    memcpy(rspData, scanRsp.data(), rspLength);
+    return !setCreated ||
+           esp_ble_gap_config_ext_scan_rsp_data_raw(ADVERTISER_INSTANCE, rspLength, rspData) == ESP_OK;
+  }
+#endif
+  return esp_ble_gap_config_scan_rsp_data_raw(scanRsp.data(), scanRsp.length()) == ESP_OK;
+}
+
+// The controller refuses new parameters for an enabled set, so a start
+// while advertising (e.g. a connectable switch) restarts it.
+bool advertiserStart()
+{
+  if (running)
+  {
+    advertiserStop();
+  }
+#if defined(SOC_BLE_50_SUPPORTED)
+  running = extended ? extStart() : esp_ble_gap_start_advertising(&advParams) == ESP_OK;
+#else
+  running = esp_ble_gap_start_advertising(&advParams) == ESP_OK;
+#endif
+  if (running)
+  {
+    telemetryCount(TELEMETRY_ADV_STARTS);
+  }
+  return running;
+}
+
+bool advertiserStop()
+{
+  running = false;
+#if defined(SOC_BLE_50_SUPPORTED)
+  if (extended)
+  {
+    uint8_t instance = ADVERTISER_INSTANCE;
+    return esp_ble_gap_ext_adv_stop(1, &instance) == ESP_OK;
+  }
+#endif
+  return esp_ble_gap_stop_advertising() == ESP_OK;
+}
+
+bool advertiserRunning()
+{
+  return running;
+}
+
+#endif
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <stdint.h>
+#include "adv_payload.h"
+
+// Called from the BLE host task for every scan request the controller
+// answers on the advertised identity.
+typedef void (*AdvScanHook)();
+
+void advertiserBegin();
+void advertiserSetAddress(const uint8_t *addr);
+void advertiserSetInterval(uint16_t intervalMs);
+void advertiserSetConnectable(bool connectable);
+bool advertiserSetPayload(AdvPayload &payload);
+bool advertiserSetScanResponse(AdvPayload &scanRsp);
+bool advertiserStart();
+bool advertiserStop();
+bool advertiserRunning();
+
+// Has the controller report scan requests, where the stack can (Bluedroid
+// on BLE 5 targets). Call it before the first advertiserStart().
+bool advertiserReportScans(AdvScanHook hook);
@@ -0,0 +1,194 @@
+#include "ble_stack.h"
+
+static BleConnectionHook connectionHook = nullptr;
+static BleConnParams connParams = {30, 0, 4000, 185};
+static volatile uint8_t connections = 0;
+
+static uint16_t connIntervalUnits(uint16_t intervalMs)
+{
+  uint32_t units = (uint32_t)intervalMs * 4 / 5;
+  if (units < 6)
+    units = 6;
+  if (units > 3200)
+    units = 3200;
+  return units;
+}
+
+static void connectionChanged(bool connected)
+{
+  if (connected)
+  {
+    connections++;
+  }
+  else if (connections > 0)
+  {
+    connections--;
+  }
+  if (connectionHook != nullptr)
+  {
+    connectionHook(connected, connections);
+  }
+}
+
+uint8_t bleStackConnections()
+{
+  return connections;
+}
+
+#ifdef PHANTOM_BLE_NIMBLE
+
+static uint8_t address[6];
+
+// NimBLEDevice::init() already hands the Classic BT controller memory back.
+size_t bleStackReleaseClassic()
+{
+  return 0;
+}
+
+void bleStackInit(const char *name)
+{
+  NimBLEDevice::init(name);
+}
+
+// NimBLE keeps addresses little-endian; everything else here is MSB first.
+const uint8_t *bleStackAddress()
+{
+  const uint8_t *native = NimBLEDevice::getAddress().getNative();
+  for (int i = 0; i < 6; i++)
+  {
+    address[i] = native[5 - i];
+  }
+  return address;
+}
+
+// NimBLE adds the 0x2902 descriptor itself for notify/indicate characteristics.
+void bleAddCccd(BleCharacteristic *characteristic)
+{
+  (void)characteristic;
+}
+
+// NimBLE registers the whole GATT table at once, after every service exists.
+void bleStackStartServer(BleServer *server)
+{
+  server->start();
+}
+
+class ConnectionCallbacks : public NimBLEServerCallbacks
+{
+  void onConnect(NimBLEServer *server, ble_gap_conn_desc *desc)
+  {
+    uint16_t interval = connIntervalUnits(connParams.intervalMs);
+    server->updateConnParams(desc->conn_handle, interval, interval, connParams.latency, connParams.timeoutMs / 10);
+    connectionChanged(true);
+  }
+  void onDisconnect(NimBLEServer *server, ble_gap_conn_desc *desc)
+  {
+    (void)server;
+    (void)desc;
+    connectionChanged(false);
+  }
+};
+
+static ConnectionCallbacks connectionCallbacks;
+
+// Advertising is restarted by the hook, so NimBLE's own restart stays off.
+void bleStackServe(BleServer *server, BleConnectionHook hook)
+{
+  connectionHook = hook;
+  server->setCallbacks(&connectionCallbacks, false);
+  server->advertiseOnDisconnect(false);
+}
+
+void bleStackSetConnParams(const BleConnParams &params)
+{
+  connParams = params;
+  NimBLEDevice::setMTU(params.mtu);
+}
+
+const char *bleStackName()
+{
+  return "NimBLE";
+}
+
+#else
+
+#include <Arduino.h>
+#include <BLE2902.h>
+#include "esp_bt.h"
+#include "esp_bt_device.h"
+#include "esp_heap_caps.h"
+
+// Only the original ESP32 has a Classic BT controller to give memory back
+// from. The controller must then be started in BLE-only mode before
+// BLEDevice::init(), which would otherwise enable dual mode and fail.
+size_t bleStackReleaseClassic()
+{
+#if defined(PHANTOM_MEMORY_BUDGET) && defined(CONFIG_IDF_TARGET_ESP32)
+  size_t before = heap_caps_get_free_size(MALLOC_CAP_INTERNAL);
+  if (esp_bt_controller_mem_release(ESP_BT_MODE_CLASSIC_BT) != ESP_OK || !btStartMode(BT_MODE_BLE))
+  {
+    return 0;
+  }
+  return heap_caps_get_free_size(MALLOC_CAP_INTERNAL) - before;
+#else
+  return 0;
+#endif
+}
+
+void bleStackInit(const char *name)
+{
+  BLEDevice::init(name);
+}
+
+const uint8_t *bleStackAddress()
+{
+  return esp_bt_dev_get_address();
+}
+
+void bleAddCccd(BleCharacteristic *characteristic)
+{
+  characteristic->addDescriptor(new BLE2902());
+}
+
+void bleStackStartServer(BleServer *server)
+{
+  (void)server;
+}
+
+class ConnectionCallbacks : public BLEServerCallbacks
+{
+  void onConnect(BLEServer *server, esp_ble_gatts_cb_param_t *param)
+  {
+    uint16_t interval = connIntervalUnits(connParams.intervalMs);
+    server->updateConnParams(param->connect.remote_bda, interval, interval, connParams.latency,
+                             connParams.timeoutMs / 10);
+    connectionChanged(true);
+  }
+  void onDisconnect(BLEServer *server, esp_ble_gatts_cb_param_t *param)
+  {
+    (void)server;
+    (void)param;
+    connectionChanged(false);
+  }
+};
+
+static ConnectionCallbacks connectionCallbacks;
+
+void bleStackServe(BleServer *server, BleConnectionHook hook)
+{
+  connectionHook = hook;
+  server->setCallbacks(&connectionCallbacks);
+}
+
+void bleStackSetConnParams(const BleConnParams &params)
+{
+  connParams = params;
+  BLEDevice::setMTU(params.mtu);
+}
+
+const char *bleStackName()
+{
+  return "Bluedroid";
+}
+
+#endif
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <stdint.h>
+
+// The firmware talks to one BLE host through these names. Bluedroid (the
+// Arduino BLE library) is the default; -DPHANTOM_BLE_NIMBLE swaps in
+// NimBLE-Arduino, which has the same class shapes under a Nim prefix.
+#ifdef PHANTOM_BLE_NIMBLE
+
+#include <NimBLEDevice.h>
+
+typedef NimBLEDevice BleDevice;
+typedef NimBLEServer BleServer;
+typedef NimBLEService BleService;
+typedef NimBLECharacteristic BleCharacteristic;
+typedef NimBLEUUID BleUUID;
+typedef NimBLEServerCallbacks BleServerCallbacks;
+typedef NimBLECharacteristicCallbacks BleCharacteristicCallbacks;
+typedef int BleStatusCode;
+
+#define BLE_PROPERTY_READ NIMBLE_PROPERTY::READ
+#define BLE_PROPERTY_NOTIFY NIMBLE_PROPERTY::NOTIFY
+#define BLE_PROPERTY_WRITE NIMBLE_PROPERTY::WRITE
+#define BLE_PROPERTY_WRITE_NR NIMBLE_PROPERTY::WRITE_NR
+
+inline size_t bleValueLength(BleCharacteristic *characteristic)
+{
+  return characteristic->getDataLength();
+}
+
+#else
+
+#include <BLEDevice.h>
+#include <BLEServer.h>
+
+typedef BLEDevice BleDevice;
+typedef BLEServer BleServer;
+typedef BLEService BleService;
+typedef BLECharacteristic BleCharacteristic;
+typedef BLEUUID BleUUID;
+typedef BLEServerCallbacks BleServerCallbacks;
+typedef BLECharacteristicCallbacks BleCharacteristicCallbacks;
+typedef uint32_t BleStatusCode;
+
+#define BLE_PROPERTY_READ BLECharacteristic::PROPERTY_READ
+#define BLE_PROPERTY_NOTIFY BLECharacteristic::PROPERTY_NOTIFY
+#define BLE_PROPERTY_WRITE BLECharacteristic::PROPERTY_WRITE
+#define BLE_PROPERTY_WRITE_NR BLECharacteristic::PROPERTY_WRITE_NR
+
+inline size_t bleValueLength(BleCharacteristic *characteristic)
+{
+  return characteristic->getLength();
+}
+
+#endif
+
+// Concurrent connections the controller and host were built for; a larger
+// configured limit is clamped to this.
+#if defined(CONFIG_BT_NIMBLE_MAX_CONNECTIONS)
+#define BLE_MAX_CONNECTIONS CONFIG_BT_NIMBLE_MAX_CONNECTIONS
+#elif defined(CONFIG_BTDM_CTRL_BLE_MAX_CONN)
+#define BLE_MAX_CONNECTIONS CONFIG_BTDM_CTRL_BLE_MAX_CONN
+#elif defined(CONFIG_BT_ACL_CONNECTIONS)
+#define BLE_MAX_CONNECTIONS CONFIG_BT_ACL_CONNECTIONS
+#else
+#define BLE_MAX_CONNECTIONS 3
+#endif
+
+// Requested from every central right after it connects. The central has the
+// last word on the interval; the MTU is our side of the exchange.
+struct BleConnParams
+{
+  uint16_t intervalMs;
+  uint16_t latency;
+  uint16_t timeoutMs;
+  uint16_t mtu;
+};
+
+// Called from the BLE host task after every connect and disconnect.
+typedef void (*BleConnectionHook)(bool connected, uint8_t connections);
+
+size_t bleStackReleaseClassic();
+void bleStackInit(const char *name);
+const uint8_t *bleStackAddress();
+void bleAddCccd(BleCharacteristic *characteristic);
+void bleStackStartServer(BleServer *server);
+void bleStackServe(BleServer *server, BleConnectionHook hook);
+void bleStackSetConnParams(const BleConnParams &params);
+uint8_t bleStackConnections();
+const char *bleStackName();
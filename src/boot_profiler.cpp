@@ -0,0 +1,127 @@
+#include "boot_profiler.h"
+
+#include <Arduino.h>
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+#include "ble_stack.h"
+
+static const char *phaseNames[BOOT_PHASE_COUNT] = {
+    "Carga da configuração",
+    "Espera do console",
+    "Seleção de MAC",
+    "esp_base_mac_addr_set",
+    "BLEDevice::init",
+    "Criação de serviços",
+    "Início do advertising",
+    "Tarefas de console/GATT"};
+
+static int64_t setupStart = 0;
+static int64_t phaseEnd[BOOT_PHASE_COUNT];
+static bool phaseRecorded[BOOT_PHASE_COUNT];
+static uint32_t setupHeap = 0;
+static uint32_t setupPsram = 0;
+static uint32_t phaseHeap[BOOT_PHASE_COUNT];
+static uint32_t phasePsram[BOOT_PHASE_COUNT];
+
+void bootProfilerStart()
+{
+  setupStart = esp_timer_get_time();
+  setupHeap = heap_caps_get_free_size(MALLOC_CAP_INTERNAL);
+  setupPsram = heap_caps_get_free_size(MALLOC_CAP_SPIRAM);
+  for (int i = 0; i < BOOT_PHASE_COUNT; i++)
+  {
+    phaseEnd[i] = 0;
+    phaseRecorded[i] = false;
+  }
+}
+
+void bootProfilerMark(BootPhase phase)
+{
+  phaseEnd[phase] = esp_timer_get_time();
+  phaseHeap[phase] = heap_caps_get_free_size(MALLOC_CAP_INTERNAL);
+  phasePsram[phase] = heap_caps_get_free_size(MALLOC_CAP_SPIRAM);
+  phaseRecorded[phase] = true;
+}
+
+static int previousPhase(BootPhase phase)
+{
+  for (int i = phase - 1; i >= 0; i--)
+  {
+    if (phaseRecorded[i])
+    {
+      return i;
+    }
+  }
+  return -1;
+}
+
+uint32_t bootPhaseDuration(BootPhase phase)
+{
+  if (!phaseRecorded[phase])
+  {
+    return 0;
+  }
+
+  int previous = previousPhase(phase);
+  return (uint32_t)(phaseEnd[phase] - (previous < 0 ? setupStart : phaseEnd[previous]));
+}
+
+// Internal RAM the phase consumed (positive) or gave back (negative).
+int32_t bootPhaseHeap(BootPhase phase)
+{
+  if (!phaseRecorded[phase])
+  {
+    return 0;
+  }
+  int previous = previousPhase(phase);
+  return (int32_t)((previous < 0 ? setupHeap : phaseHeap[previous]) - phaseHeap[phase]);
+}
+
+static int32_t phasePsramUse(BootPhase phase)
+{
+  int previous = previousPhase(phase);
+  return (int32_t)((previous < 0 ? setupPsram : phasePsram[previous]) - phasePsram[phase]);
+}
+
+uint32_t bootTimeToAdvertising()
+{
+  if (!phaseRecorded[BOOT_PHASE_ADV_START])
+  {
+    return 0;
+  }
+  return (uint32_t)phaseEnd[BOOT_PHASE_ADV_START];
+}
+
+bool bootProfileComplete()
+{
+  return phaseRecorded[BOOT_PHASE_ADV_START];
+}
+
+void bootProfilerPrint()
+{
+  Serial.printf("--- Perfil de boot (%s) ---\n", bleStackName());
+  bool psram = heap_caps_get_total_size(MALLOC_CAP_SPIRAM) > 0;
+  Serial.printf("  %-24s %8lu us | heap livre %lu B\n", "Antes do setup()", (unsigned long)setupStart,
+                (unsigned long)setupHeap);
+  for (int i = 0; i < BOOT_PHASE_COUNT; i++)
+  {
+    if (phaseRecorded[i])
+    {
+      Serial.printf("  %-24s %8lu us | heap %+7ld B", phaseNames[i], (unsigned long)bootPhaseDuration((BootPhase)i),
+                    (long)-bootPhaseHeap((BootPhase)i));
+      if (psram)
+      {
+        Serial.printf(" | PSRAM %+7ld B", (long)-phasePsramUse((BootPhase)i));
+      }
+      Serial.println();
+    }
+  }
+  Serial.printf("  %-24s %8lu us\n", "Até o 1º advertising", (unsigned long)bootTimeToAdvertising());
+  Serial.printf("  Heap interno livre: %lu B (maior bloco %lu B)", (unsigned long)heap_caps_get_free_size(MALLOC_CAP_INTERNAL),
+                (unsigned long)heap_caps_get_largest_free_block(MALLOC_CAP_INTERNAL));
+  if (psram)
+  {
+    Serial.printf(" | PSRAM livre: %lu B", (unsigned long)heap_caps_get_free_size(MALLOC_CAP_SPIRAM));
+  }
+  Serial.println();
+}
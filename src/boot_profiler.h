@@ -0,0 +1,24 @@
+#pragma once
+
+#include <stdint.h>
+
+enum BootPhase
+{
+  BOOT_PHASE_CONFIG,
+  BOOT_PHASE_CONSOLE,
+  BOOT_PHASE_MAC_SELECT,
+  BOOT_PHASE_BASE_MAC,
+  BOOT_PHASE_BLE_INIT,
+  BOOT_PHASE_SERVICES,
+  BOOT_PHASE_ADV_START,
+  BOOT_PHASE_TASKS,
+  BOOT_PHASE_COUNT
+};
+
+void bootProfilerStart();
+void bootProfilerMark(BootPhase phase);
+uint32_t bootPhaseDuration(BootPhase phase);
+int32_t bootPhaseHeap(BootPhase phase);
+uint32_t bootTimeToAdvertising();
+bool bootProfileComplete();
+void bootProfilerPrint();
@@ -0,0 +1,238 @@
+#include "config.h"
+
+#include <Preferences.h>
+#include <stddef.h>
+#include <string.h>
+#include "crc.h"
+#include "multi_adv.h"
+#include "signal_model.h"
+#include "gatt_server.h"
+#include "telemetry.h"
+#include "rotation_timer.h"
+#include "power.h"
+#include "fleet.h"
+
+#define CONFIG_NAMESPACE "phantomfreq"
+#define CONFIG_KEY "config"
+#define CONFIG_V1_LENGTH (offsetof(DeviceConfig, signalModel) + sizeof(uint32_t))
+
+DeviceConfig config;
+
+static Preferences prefs;
+static bool prefsOpen = false;
+
+static uint32_t configCrc(const DeviceConfig &cfg)
+{
+  return crc32((const uint8_t *)&cfg, offsetof(DeviceConfig, crc));
+}
+
+static bool openPrefs()
+{
+  if (!prefsOpen)
+  {
+    prefsOpen = prefs.begin(CONFIG_NAMESPACE, false);
+  }
+  return prefsOpen;
+}
+
+void configDefaults(DeviceConfig &cfg)
+{
+  memset(&cfg, 0, sizeof(cfg));
+  cfg.version = CONFIG_VERSION;
+  cfg.mode = MODE_AUTO_LIST;
+  cfg.macCount = 99;
+  cfg.restartInterval = 250;
+  cfg.multiAdvCount = 8;
+  cfg.multiAdvInterval = 100;
+  cfg.signalModel = SIGNAL_MODEL_STEPPED;
+  cfg.signalRateHz = 4;
+  cfg.notifyRateHz = 1;
+  cfg.maxConnections = BLE_MAX_CONNECTIONS;
+  cfg.connIntervalMs = 30;
+  cfg.connLatency = 0;
+  cfg.connTimeoutMs = 4000;
+  cfg.mtu = GATT_MAX_MTU;
+  cfg.minDwellMs = 100;
+}
+
+// The supervision timeout has to outlast two missed connection events,
+// slave latency included, or the link parameters are rejected.
+bool configConnParamsValid(const DeviceConfig &cfg)
+{
+  return cfg.connIntervalMs >= GATT_MIN_CONN_INTERVAL_MS && cfg.connIntervalMs <= GATT_MAX_CONN_INTERVAL_MS &&
+         cfg.connLatency <= GATT_MAX_CONN_LATENCY && cfg.connTimeoutMs >= GATT_MIN_CONN_TIMEOUT_MS &&
+         cfg.connTimeoutMs <= GATT_MAX_CONN_TIMEOUT_MS &&
+         cfg.connTimeoutMs > 2UL * (1 + cfg.connLatency) * cfg.connIntervalMs && cfg.mtu >= GATT_MIN_MTU &&
+         cfg.mtu <= GATT_MAX_MTU;
+}
+
+bool configSanitize(DeviceConfig &cfg)
+{
+  DeviceConfig defaults;
+  configDefaults(defaults);
+  bool changed = false;
+
+  if (cfg.mode >= MODE_COUNT)
+  {
+    cfg.mode = MODE_STATIC;
+    changed = true;
+  }
+  if (cfg.macCount < 1 || cfg.macCount > MAX_MAC_COUNT)
+  {
+    cfg.macCount = defaults.macCount;
+    changed = true;
+  }
+  if (cfg.selectedMacIndex >= cfg.macCount)
+  {
+    cfg.selectedMacIndex = 0;
+    changed = true;
+  }
+  if (cfg.useCustomMac > 1)
+  {
+    cfg.useCustomMac = 0;
+    changed = true;
+  }
+  if (cfg.restartInterval < MIN_RESTART_INTERVAL || cfg.restartInterval > MAX_RESTART_INTERVAL)
+  {
+    cfg.restartInterval = defaults.restartInterval;
+    changed = true;
+  }
+  if (cfg.hotRotation > 1 || cfg.fastBoot > 1)
+  {
+    cfg.hotRotation = cfg.hotRotation == 1;
+    cfg.fastBoot = cfg.fastBoot == 1;
+    changed = true;
+  }
+  if (cfg.multiAdvCount < 1 || cfg.multiAdvCount > MULTI_ADV_MAX_SENSORS)
+  {
+    cfg.multiAdvCount = defaults.multiAdvCount;
+    changed = true;
+  }
+  if (cfg.multiAdvInterval < MULTI_ADV_MIN_INTERVAL || cfg.multiAdvInterval > MULTI_ADV_MAX_INTERVAL)
+  {
+    cfg.multiAdvInterval = defaults.multiAdvInterval;
+    changed = true;
+  }
+  if (cfg.signalModel >= SIGNAL_MODEL_COUNT)
+  {
+    cfg.signalModel = defaults.signalModel;
+    changed = true;
+  }
+  if (cfg.signalRateHz < SIGNAL_MIN_RATE_HZ || cfg.signalRateHz > SIGNAL_MAX_RATE_HZ)
+  {
+    cfg.signalRateHz = defaults.signalRateHz;
+    changed = true;
+  }
+  if (cfg.notifyRateHz < GATT_MIN_NOTIFY_HZ || cfg.notifyRateHz > GATT_MAX_NOTIFY_HZ)
+  {
+    cfg.notifyRateHz = defaults.notifyRateHz;
+    changed = true;
+  }
+  if (cfg.rotationPhase >= ROTATION_PHASE_COUNT)
+  {
+    cfg.rotationPhase = defaults.rotationPhase;
+    changed = true;
+  }
+  if (cfg.maxConnections < 1 || cfg.maxConnections > BLE_MAX_CONNECTIONS)
+  {
+    cfg.maxConnections = defaults.maxConnections;
+    changed = true;
+  }
+  if (cfg.powerProfile >= POWER_PROFILE_COUNT || cfg.sleepGapMs > POWER_MAX_SLEEP_GAP_MS)
+  {
+    cfg.powerProfile = defaults.powerProfile;
+    cfg.sleepGapMs = defaults.sleepGapMs;
+    changed = true;
+  }
+  if (cfg.fleetRole >= FLEET_ROLE_COUNT)
+  {
+    cfg.fleetRole = defaults.fleetRole;
+    changed = true;
+  }
+  if (cfg.dwellTarget > MAX_DWELL_TARGET || cfg.minDwellMs < MIN_RESTART_INTERVAL ||
+      cfg.minDwellMs > MAX_RESTART_INTERVAL)
+  {
+    cfg.dwellTarget = defaults.dwellTarget;
+    cfg.minDwellMs = defaults.minDwellMs;
+    changed = true;
+  }
+  if (!configConnParamsValid(cfg))
+  {
+    cfg.connIntervalMs = defaults.connIntervalMs;
+    cfg.connLatency = defaults.connLatency;
+    cfg.connTimeoutMs = defaults.connTimeoutMs;
+    cfg.mtu = defaults.mtu;
+    changed = true;
+  }
+  return changed;
+}
+
+bool configFromRecord(const uint8_t *record, size_t length, DeviceConfig &out)
+{
+  if (length < CONFIG_V1_LENGTH || length > sizeof(DeviceConfig))
+  {
+    return false;
+  }
+  size_t body = length - sizeof(uint32_t);
+  uint32_t storedCrc;
+  memcpy(&storedCrc, &record[body], sizeof(storedCrc));
+  if (storedCrc != crc32(record, body))
+  {
+    return false;
+  }
+
+  DeviceConfig loaded;
+  configDefaults(loaded);
+  memcpy(&loaded, record, body);
+  if (loaded.version > CONFIG_VERSION)
+  {
+    return false;
+  }
+  out = loaded;
+  return true;
+}
+
+size_t configToRecord(const DeviceConfig &cfg, uint8_t *out)
+{
+  DeviceConfig record = cfg;
+  record.version = CONFIG_VERSION;
+  record.crc = configCrc(record);
+  memcpy(out, &record, sizeof(record));
+  return sizeof(record);
+}
+
+bool configLoad()
+{
+  if (!openPrefs())
+  {
+    return false;
+  }
+  size_t length = prefs.getBytesLength(CONFIG_KEY);
+  if (length < CONFIG_V1_LENGTH || length > sizeof(DeviceConfig))
+  {
+    return false;
+  }
+
+  uint8_t record[sizeof(DeviceConfig)];
+  if (prefs.getBytes(CONFIG_KEY, record, length) != length)
+  {
+    return false;
+  }
+  return configFromRecord(record, length, config);
+}
+
+bool configSave()
+{
+  if (!openPrefs())
+  {
+    return false;
+  }
+  config.version = CONFIG_VERSION;
+  config.crc = configCrc(config);
+  if (prefs.putBytes(CONFIG_KEY, &config, sizeof(config)) != sizeof(config))
+  {
+    return false;
+  }
+  telemetryCount(TELEMETRY_NVS_COMMITS);
+  return true;
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "identity_table.h"
+
+#define CONFIG_VERSION 9
+
+#define MIN_RESTART_INTERVAL 20
+#define MAX_RESTART_INTERVAL 30000
+#define MAX_MAC_COUNT IDENTITY_MAX_ENTRIES
+#define MAX_DWELL_TARGET 100
+
+enum OperatingMode
+{
+  MODE_AUTO_LIST = 0,
+  MODE_STATIC = 1,
+  MODE_AUTO_RANDOM = 2,
+  MODE_MULTI_ADV = 3,
+  MODE_COUNT
+};
+
+// New fields are appended right before crc: shorter records written by older
+// firmware still load, with the missing tail taken from the defaults.
+struct __attribute__((packed)) DeviceConfig
+{
+  uint16_t version;
+  uint8_t mode;
+  uint8_t useCustomMac;
+  uint8_t customMac[6];
+  uint16_t selectedMacIndex;
+  uint16_t macCount;
+  uint32_t restartInterval;
+  uint8_t hotRotation;
+  uint8_t fastBoot;
+  uint8_t multiAdvCount;
+  uint16_t multiAdvInterval;
+  uint8_t signalModel;
+  uint8_t signalRateHz;
+  uint8_t notifyRateHz;
+  uint32_t macSeed;
+  uint8_t rotationPhase;
+  uint8_t maxConnections;
+  uint16_t connIntervalMs;
+  uint16_t connLatency;
+  uint16_t connTimeoutMs;
+  uint16_t mtu;
+  uint8_t powerProfile;
+  uint16_t sleepGapMs;
+  uint8_t fleetRole;
+  uint8_t dwellTarget;
+  uint16_t minDwellMs;
+  uint32_t crc;
+};
+
+extern DeviceConfig config;
+
+void configDefaults(DeviceConfig &cfg);
+bool configSanitize(DeviceConfig &cfg);
+bool configConnParamsValid(const DeviceConfig &cfg);
+bool configFromRecord(const uint8_t *record, size_t length, DeviceConfig &out);
+size_t configToRecord(const DeviceConfig &cfg, uint8_t *out);
+bool configLoad();
+bool configSave();
@@ -0,0 +1,195 @@
+#include "console.h"
+
+#include <Arduino.h>
+#include <string.h>
+#include "freertos/task.h"
+#include "freertos/queue.h"
+
+#define CONSOLE_TASK_STACK 4096
+#define CONSOLE_TASK_PRIORITY 2
+#define CONSOLE_FRAME_TIMEOUT_MS 100
+
+static QueueHandle_t lineQueue = nullptr;
+static QueueHandle_t frameQueue = nullptr;
+static TaskHandle_t consoleTask = nullptr;
+static volatile bool keyMode = false;
+static volatile uint32_t pollMs = CONSOLE_POLL_MS;
+
+static char editBuffer[CONSOLE_LINE_MAX];
+static size_t editLength = 0;
+static bool lastWasCr = false;
+
+static ProtocolParser parser;
+static unsigned long lastFrameByte = 0;
+
+static void submit(const char *text, size_t length)
+{
+  while (length > 0 && (*text == ' ' || *text == '\t'))
+  {
+    text++;
+    length--;
+  }
+  while (length > 0 && (text[length - 1] == ' ' || text[length - 1] == '\t'))
+  {
+    length--;
+  }
+
+  ConsoleLine line;
+  memcpy(line.text, text, length);
+  line.text[length] = '\0';
+  xQueueSend(lineQueue, &line, 0);
+}
+
+static void editKey(char c)
+{
+  bool isCr = c == '\r';
+  if (c == '\n' && lastWasCr)
+  {
+    lastWasCr = false;
+    return;
+  }
+  lastWasCr = isCr;
+
+  if (c == '\r' || c == '\n')
+  {
+    Serial.print("\r\n");
+    submit(editBuffer, editLength);
+    editLength = 0;
+  }
+  else if (c == '\b' || c == 0x7F)
+  {
+    if (editLength > 0)
+    {
+      editLength--;
+      Serial.print("\b \b");
+    }
+  }
+  else if (c >= ' ' && editLength < CONSOLE_LINE_MAX - 1)
+  {
+    editBuffer[editLength++] = c;
+    Serial.write((uint8_t)c);
+  }
+}
+
+static void feedFrame(uint8_t byte)
+{
+  unsigned long now = millis();
+  if (parser.active() && now - lastFrameByte > CONSOLE_FRAME_TIMEOUT_MS)
+  {
+    parser.reset();
+  }
+  lastFrameByte = now;
+
+  uint8_t status;
+  switch (parser.feed(byte))
+  {
+  case PROTOCOL_PARSE_FRAME:
+    if (xQueueSend(frameQueue, &parser.frame(), 0) != pdTRUE)
+    {
+      status = PROTOCOL_STATUS_BUSY;
+      consoleSendFrame(PROTOCOL_OP_ERROR, &status, 1);
+    }
+    break;
+
+  case PROTOCOL_PARSE_BAD_CRC:
+    status = PROTOCOL_STATUS_BAD_CRC;
+    consoleSendFrame(PROTOCOL_OP_ERROR, &status, 1);
+    break;
+
+  case PROTOCOL_PARSE_TOO_LONG:
+    status = PROTOCOL_STATUS_TOO_LONG;
+    consoleSendFrame(PROTOCOL_OP_ERROR, &status, 1);
+    break;
+
+  default:
+    break;
+  }
+}
+
+static void consoleLoop(void *arg)
+{
+  (void)arg;
+  for (;;)
+  {
+    if (!Serial.available())
+    {
+      ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(pollMs));
+      continue;
+    }
+
+    char c = (char)Serial.read();
+    if (parser.active() || (uint8_t)c == PROTOCOL_SOF)
+    {
+      feedFrame((uint8_t)c);
+      continue;
+    }
+    if (keyMode)
+    {
+      editLength = 0;
+      if (c != '\r' && c != '\n')
+      {
+        submit(&c, 1);
+      }
+      continue;
+    }
+    editKey(c);
+  }
+}
+
+bool consoleBegin(bool startInKeyMode)
+{
+  keyMode = startInKeyMode;
+  if (consoleTask != nullptr)
+  {
+    return true;
+  }
+  lineQueue = xQueueCreate(CONSOLE_QUEUE_DEPTH, sizeof(ConsoleLine));
+  frameQueue = xQueueCreate(CONSOLE_FRAME_QUEUE_DEPTH, sizeof(ProtocolFrame));
+  if (lineQueue == nullptr || frameQueue == nullptr)
+  {
+    return false;
+  }
+  if (xTaskCreate(consoleLoop, "console", CONSOLE_TASK_STACK, nullptr, CONSOLE_TASK_PRIORITY, &consoleTask) != pdPASS)
+  {
+    return false;
+  }
+  Serial.onReceive([]() { xTaskNotifyGive(consoleTask); });
+  return true;
+}
+
+// The UART receive callback wakes the task; the poll is only a fallback,
+// so it can be long when the CPU should stay asleep.
+void consoleSetPollMs(uint32_t ms)
+{
+  pollMs = ms > 0 ? ms : CONSOLE_POLL_MS;
+}
+
+void consoleSetKeyMode(bool enabled)
+{
+  keyMode = enabled;
+}
+
+bool consoleReceive(ConsoleLine &line, TickType_t wait)
+{
+  return lineQueue != nullptr && xQueueReceive(lineQueue, &line, wait) == pdTRUE;
+}
+
+bool consoleReceiveFrame(ProtocolFrame &frame)
+{
+  return frameQueue != nullptr && xQueueReceive(frameQueue, &frame, 0) == pdTRUE;
+}
+
+void consoleSendFrame(uint8_t opcode, const uint8_t *payload, uint16_t length)
+{
+  uint8_t out[PROTOCOL_MAX_PAYLOAD + PROTOCOL_OVERHEAD];
+  if (length > PROTOCOL_MAX_PAYLOAD)
+  {
+    length = PROTOCOL_MAX_PAYLOAD;
+  }
+  Serial.write(out, protocolEncode(opcode, payload, length, out));
+}
+
+uint32_t consoleStackFree()
+{
+  return consoleTask != nullptr ? uxTaskGetStackHighWaterMark(consoleTask) : 0;
+}
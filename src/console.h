@@ -0,0 +1,23 @@
+#pragma once
+
+#include <stdint.h>
+#include "freertos/FreeRTOS.h"
+#include "protocol.h"
+
+#define CONSOLE_LINE_MAX 64
+#define CONSOLE_QUEUE_DEPTH 8
+#define CONSOLE_FRAME_QUEUE_DEPTH 2
+#define CONSOLE_POLL_MS 10
+
+struct ConsoleLine
+{
+  char text[CONSOLE_LINE_MAX];
+};
+
+bool consoleBegin(bool keyMode);
+void consoleSetKeyMode(bool keyMode);
+void consoleSetPollMs(uint32_t ms);
+bool consoleReceive(ConsoleLine &line, TickType_t wait = 0);
+bool consoleReceiveFrame(ProtocolFrame &frame);
+void consoleSendFrame(uint8_t opcode, const uint8_t *payload, uint16_t length);
+uint32_t consoleStackFree();
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "adv_payload.h"
+
+#define PROFILE_MAX_SERVICES 6
+#define PROFILE_MFR_MAX 8
+#define PROFILE_FIELD_NONE -1
+#define PROFILE_NO_COMPANY 0
+
+#define DEVICE_PROFILE_DEFAULT 0
+
+#define UUID_HEART_RATE 0x180D
+#define UUID_USER_DATA 0x181C
+#define UUID_BATTERY 0x180F
+#define UUID_DEVICE_INFO 0x180A
+#define UUID_TRANSFER 0xFD00
+
+// A band model as it appears on air. services is both the advertised UUID
+// list (first entry goes in the primary packet) and the GATT layout built
+// at boot. mfrFields follows the company ID in the manufacturer block; the
+// reading offsets index mfrFields and are patched on every update.
+struct DeviceProfile
+{
+  const char *baseName;
+  uint16_t services[PROFILE_MAX_SERVICES];
+  uint8_t serviceCount;
+  uint16_t companyId;
+  uint8_t mfrFields[PROFILE_MFR_MAX];
+  uint8_t mfrLength;
+  int8_t batteryOffset;
+  int8_t bpmOffset;
+};
+
+static constexpr DeviceProfile deviceProfiles[] = {
+    {"HW706-0047980",
+     {UUID_HEART_RATE, UUID_USER_DATA, UUID_BATTERY, UUID_DEVICE_INFO, UUID_TRANSFER}, 5,
+     0xFF05, {0x01, 0x00, 0x06, 0x00}, 4, 1, 3},
+    {"HRM-0047980",
+     {UUID_HEART_RATE, UUID_BATTERY, UUID_DEVICE_INFO, UUID_TRANSFER}, 4,
+     PROFILE_NO_COMPANY, {}, 0, PROFILE_FIELD_NONE, PROFILE_FIELD_NONE},
+};
+
+#define DEVICE_PROFILE_COUNT (sizeof(deviceProfiles) / sizeof(deviceProfiles[0]))
+
+constexpr size_t profileNameLength(const char *name, size_t index = 0)
+{
+  return name[index] == '\0' ? index : profileNameLength(name, index + 1);
+}
+
+constexpr uint8_t profileServiceIndex(const DeviceProfile &profile, uint16_t uuid, uint8_t index = 0)
+{
+  return index >= profile.serviceCount || profile.services[index] == uuid
+             ? index
+             : profileServiceIndex(profile, uuid, index + 1);
+}
+
+constexpr bool profileHasService(const DeviceProfile &profile, uint16_t uuid)
+{
+  return profileServiceIndex(profile, uuid) < profile.serviceCount;
+}
+
+constexpr uint8_t profileMfrSize(const DeviceProfile &profile)
+{
+  return profile.companyId != PROFILE_NO_COMPANY ? AD_FIELD_SIZE(2 + profile.mfrLength) : 0;
+}
+
+constexpr uint8_t profilePrimarySize(const DeviceProfile &profile)
+{
+  return AD_FIELD_SIZE(SENSOR_FLAGS_LENGTH) + profileMfrSize(profile) + AD_FIELD_SIZE(2);
+}
+
+constexpr bool profileOffsetValid(const DeviceProfile &profile, int8_t offset)
+{
+  return offset == PROFILE_FIELD_NONE ||
+         (profile.companyId != PROFILE_NO_COMPANY && offset >= 0 && offset < profile.mfrLength);
+}
+
+constexpr bool profileValid(const DeviceProfile &profile)
+{
+  return profileNameLength(profile.baseName) <= SENSOR_NAME_MAX &&
+         profile.serviceCount > 0 && profile.serviceCount <= PROFILE_MAX_SERVICES &&
+         profile.mfrLength <= PROFILE_MFR_MAX &&
+         profilePrimarySize(profile) <= ADV_PAYLOAD_MAX &&
+         AD_FIELD_SIZE(profile.serviceCount * 2) <= ADV_PAYLOAD_MAX &&
+         profileOffsetValid(profile, profile.batteryOffset) &&
+         profileOffsetValid(profile, profile.bpmOffset) &&
+         profileHasService(profile, UUID_HEART_RATE) && profileHasService(profile, UUID_BATTERY) &&
+         profileHasService(profile, UUID_DEVICE_INFO) && profileHasService(profile, UUID_TRANSFER);
+}
+
+constexpr bool profilesValid(unsigned index = 0)
+{
+  return index >= DEVICE_PROFILE_COUNT || (profileValid(deviceProfiles[index]) && profilesValid(index + 1));
+}
+
+static_assert(DEVICE_PROFILE_COUNT <= 0xFF, "the profile index is one byte in identity records");
+static_assert(profilesValid(), "every profile needs a fitting name, primary packet and UUID list, in-range "
+                               "reading offsets and the heart rate, battery, device info and transfer services");
+static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__,
+              "service UUIDs are advertised straight from their in-memory little-endian layout");
+
+inline const DeviceProfile &deviceProfile(uint8_t index)
+{
+  return deviceProfiles[index < DEVICE_PROFILE_COUNT ? index : DEVICE_PROFILE_DEFAULT];
+}
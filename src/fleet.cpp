@@ -0,0 +1,515 @@
+#include "fleet.h"
+
+#include <Arduino.h>
+#include <WiFi.h>
+#include <stddef.h>
+#include <string.h>
+#include <sys/time.h>
+#include "esp_attr.h"
+#include "esp_now.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "esp_wifi.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+
+#define FLEET_MAGIC 0x54454C46UL
+#define FLEET_VERSION 1
+#define FLEET_SHARE_MAGIC 0x52485346UL
+#define FLEET_QUEUE_DEPTH 8
+
+enum FleetMessage
+{
+  FLEET_MSG_HELLO = 1,
+  FLEET_MSG_BEACON = 2
+};
+
+struct __attribute__((packed)) FleetHeader
+{
+  uint32_t magic;
+  uint8_t version;
+  uint8_t type;
+};
+
+struct __attribute__((packed)) FleetHello
+{
+  FleetHeader header;
+  uint8_t nodeId[6];
+};
+
+// Only the first memberCount entries of members are sent.
+struct __attribute__((packed)) FleetBeacon
+{
+  FleetHeader header;
+  uint32_t sequence;
+  int64_t clockUs;
+  int64_t epochUs;
+  uint32_t dwellMs;
+  uint16_t identities;
+  uint8_t running;
+  uint8_t memberCount;
+  uint8_t members[FLEET_MAX_MEMBERS][6];
+};
+
+static_assert(sizeof(FleetBeacon) <= ESP_NOW_MAX_DATA_LEN, "the beacon must fit one ESP-NOW frame");
+
+struct FleetPacket
+{
+  int64_t receivedUs;
+  uint8_t length;
+  uint8_t data[ESP_NOW_MAX_DATA_LEN];
+};
+
+struct FleetShare
+{
+  uint32_t magic;
+  uint16_t first;
+  uint16_t count;
+  uint32_t dwellMs;
+  uint8_t running;
+  int64_t confirmedUs;
+  uint32_t checkInverse;
+};
+
+RTC_NOINIT_ATTR static FleetShare share;
+
+static const uint8_t broadcastAddr[6] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+
+static uint8_t role = FLEET_ROLE_OFF;
+static uint8_t selfId[6];
+static QueueHandle_t inbox = nullptr;
+static uint32_t revision = 0;
+static uint32_t lastSendMs = 0;
+
+static uint8_t memberIds[FLEET_MAX_MEMBERS][6];
+static uint32_t memberSeenMs[FLEET_MAX_MEMBERS];
+static uint8_t memberCount = 0;
+static uint32_t sequence = 0;
+static int64_t epochUs = 0;
+static bool running = true;
+static bool beaconDue = false;
+
+static bool synced = false;
+static bool listed = false;
+static int64_t offsetUs = 0;
+static int64_t windowMaxUs = 0;
+static uint8_t windowFill = 0;
+static int64_t lastEpochUs = 0;
+static uint32_t lastBeaconMs = 0;
+
+static bool gridPending = false;
+static int64_t gridAnchorUs = 0;
+
+// System time keeps running across esp_restart() and deep sleep, so the
+// age of a share survives reboot rotation.
+static int64_t wallUs()
+{
+  struct timeval tv;
+  gettimeofday(&tv, nullptr);
+  return (int64_t)tv.tv_sec * 1000000LL + tv.tv_usec;
+}
+
+static uint32_t shareCheck(const FleetShare &s)
+{
+  return ~(s.magic ^ ((uint32_t)s.first << 16 | s.count) ^ s.dwellMs ^ s.running ^ (uint32_t)s.confirmedUs ^
+           (uint32_t)(s.confirmedUs >> 32));
+}
+
+static bool shareStored()
+{
+  return share.magic == FLEET_SHARE_MAGIC && share.checkInverse == shareCheck(share);
+}
+
+static bool shareValid()
+{
+  int64_t age = wallUs() - share.confirmedUs;
+  return shareStored() && age >= 0 && age <= (int64_t)FLEET_SHARE_TIMEOUT_MS * 1000;
+}
+
+static void setShare(uint8_t slot, uint8_t members, uint16_t identities, uint32_t dwellMs, bool run)
+{
+  uint16_t first = (uint32_t)slot * identities / members;
+  uint16_t count = (uint32_t)(slot + 1) * identities / members - first;
+  bool same = shareValid() && share.first == first && share.count == count && share.dwellMs == dwellMs &&
+              share.running == run;
+  share.magic = FLEET_SHARE_MAGIC;
+  share.first = first;
+  share.count = count;
+  share.dwellMs = dwellMs;
+  share.running = run;
+  share.confirmedUs = wallUs();
+  share.checkInverse = shareCheck(share);
+  if (!same)
+  {
+    revision++;
+  }
+}
+
+static void clearShare()
+{
+  if (share.magic == FLEET_SHARE_MAGIC)
+  {
+    share.magic = 0;
+    revision++;
+  }
+}
+
+static void fillHeader(FleetHeader &header, uint8_t type)
+{
+  header.magic = FLEET_MAGIC;
+  header.version = FLEET_VERSION;
+  header.type = type;
+}
+
+// Runs on the WiFi task; packets are only stamped and queued here.
+static void onReceive(const uint8_t *mac, const uint8_t *data, int length)
+{
+  (void)mac;
+  FleetPacket packet;
+  packet.receivedUs = esp_timer_get_time();
+  if (length < (int)sizeof(FleetHeader) || length > ESP_NOW_MAX_DATA_LEN)
+  {
+    return;
+  }
+  const FleetHeader *header = (const FleetHeader *)data;
+  if (header->magic != FLEET_MAGIC || header->version != FLEET_VERSION)
+  {
+    return;
+  }
+  packet.length = length;
+  memcpy(packet.data, data, length);
+  xQueueSend(inbox, &packet, 0);
+}
+
+static int memberIndex(const uint8_t members[][6], uint8_t count, const uint8_t *id)
+{
+  for (int i = 0; i < count; i++)
+  {
+    if (memcmp(members[i], id, 6) == 0)
+    {
+      return i;
+    }
+  }
+  return -1;
+}
+
+static void handleHello(const FleetHello &hello, uint32_t now, uint16_t identities)
+{
+  int index = memberIndex(memberIds, memberCount, hello.nodeId);
+  if (index >= 0)
+  {
+    memberSeenMs[index] = now;
+    return;
+  }
+  if (memberCount >= FLEET_MAX_MEMBERS || memberCount >= identities)
+  {
+    return;
+  }
+  memcpy(memberIds[memberCount], hello.nodeId, 6);
+  memberSeenMs[memberCount] = now;
+  memberCount++;
+  beaconDue = true;
+}
+
+// The smallest air and queue delay gives the largest clock offset, so the
+// estimate is the maximum over a window; restarting the window every few
+// beacons lets it follow crystal drift in either direction.
+static void trackOffset(int64_t sampleUs)
+{
+  if (!synced || sampleUs > offsetUs)
+  {
+    offsetUs = sampleUs;
+  }
+  synced = true;
+  if (windowFill == 0 || sampleUs > windowMaxUs)
+  {
+    windowMaxUs = sampleUs;
+  }
+  if (++windowFill >= FLEET_OFFSET_WINDOW)
+  {
+    offsetUs = windowMaxUs;
+    windowFill = 0;
+  }
+}
+
+static void handleBeacon(const FleetPacket &packet, uint32_t now)
+{
+  const FleetBeacon &beacon = *(const FleetBeacon *)packet.data;
+  if (packet.length < offsetof(FleetBeacon, members) || beacon.memberCount == 0 ||
+      beacon.memberCount > FLEET_MAX_MEMBERS ||
+      packet.length < offsetof(FleetBeacon, members) + beacon.memberCount * 6)
+  {
+    return;
+  }
+  lastBeaconMs = now;
+  if (beacon.epochUs != lastEpochUs)
+  {
+    lastEpochUs = beacon.epochUs;
+    synced = false;
+    windowFill = 0;
+  }
+  trackOffset(beacon.clockUs - packet.receivedUs);
+
+  int slot = memberIndex(beacon.members, beacon.memberCount, selfId);
+  listed = slot >= 0;
+  if (!listed)
+  {
+    clearShare();
+    return;
+  }
+  setShare(slot, beacon.memberCount, beacon.identities, beacon.dwellMs, beacon.running);
+  if (beacon.running)
+  {
+    gridAnchorUs = beacon.epochUs - offsetUs;
+    gridPending = true;
+  }
+}
+
+static void expireMembers(uint32_t now)
+{
+  uint8_t kept = 1;
+  for (uint8_t i = 1; i < memberCount; i++)
+  {
+    if (now - memberSeenMs[i] > FLEET_MEMBER_TIMEOUT_MS)
+    {
+      beaconDue = true;
+      continue;
+    }
+    if (kept != i)
+    {
+      memcpy(memberIds[kept], memberIds[i], 6);
+      memberSeenMs[kept] = memberSeenMs[i];
+    }
+    kept++;
+  }
+  memberCount = kept;
+}
+
+static void sendBeacon(uint32_t dwellMs, uint16_t identities)
+{
+  FleetBeacon beacon;
+  fillHeader(beacon.header, FLEET_MSG_BEACON);
+  beacon.sequence = ++sequence;
+  beacon.epochUs = epochUs;
+  beacon.dwellMs = dwellMs;
+  beacon.identities = identities;
+  beacon.running = running;
+  beacon.memberCount = memberCount;
+  memcpy(beacon.members, memberIds, memberCount * 6);
+  beacon.clockUs = esp_timer_get_time();
+  esp_now_send(broadcastAddr, (const uint8_t *)&beacon, offsetof(FleetBeacon, members) + memberCount * 6);
+}
+
+static void sendHello()
+{
+  FleetHello hello;
+  fillHeader(hello.header, FLEET_MSG_HELLO);
+  memcpy(hello.nodeId, selfId, 6);
+  esp_now_send(broadcastAddr, (const uint8_t *)&hello, sizeof(hello));
+}
+
+bool fleetBegin(uint8_t fleetRole)
+{
+  if (fleetRole == FLEET_ROLE_OFF || fleetRole >= FLEET_ROLE_COUNT)
+  {
+    return false;
+  }
+  // The base MAC follows the advertised identity, so members are known by
+  // their factory MAC instead of the sender address.
+  esp_efuse_mac_get_default(selfId);
+  WiFi.mode(WIFI_STA);
+  WiFi.disconnect();
+  esp_wifi_set_channel(FLEET_CHANNEL, WIFI_SECOND_CHAN_NONE);
+  if (esp_now_init() != ESP_OK)
+  {
+    return false;
+  }
+
+  esp_now_peer_info_t peer;
+  memset(&peer, 0, sizeof(peer));
+  memcpy(peer.peer_addr, broadcastAddr, 6);
+  peer.channel = FLEET_CHANNEL;
+  peer.ifidx = WIFI_IF_STA;
+  peer.encrypt = false;
+  if (esp_now_add_peer(&peer) != ESP_OK)
+  {
+    return false;
+  }
+
+  inbox = xQueueCreate(FLEET_QUEUE_DEPTH, sizeof(FleetPacket));
+  if (inbox == nullptr)
+  {
+    return false;
+  }
+  esp_now_register_recv_cb(onReceive);
+
+  role = fleetRole;
+  if (role == FLEET_ROLE_COORDINATOR)
+  {
+    memcpy(memberIds[0], selfId, 6);
+    memberSeenMs[0] = millis();
+    memberCount = 1;
+    listed = true;
+    fleetSetRunning(true);
+  }
+  else
+  {
+    sendHello();
+    lastSendMs = millis();
+  }
+  return true;
+}
+
+void fleetLoop(uint32_t dwellMs, uint16_t identities)
+{
+  if (role == FLEET_ROLE_OFF)
+  {
+    return;
+  }
+
+  uint32_t now = millis();
+  FleetPacket packet;
+  while (xQueueReceive(inbox, &packet, 0) == pdTRUE)
+  {
+    const FleetHeader &header = *(const FleetHeader *)packet.data;
+    if (role == FLEET_ROLE_COORDINATOR && header.type == FLEET_MSG_HELLO && packet.length == sizeof(FleetHello))
+    {
+      handleHello(*(const FleetHello *)packet.data, now, identities);
+    }
+    else if (role == FLEET_ROLE_NODE && header.type == FLEET_MSG_BEACON)
+    {
+      handleBeacon(packet, now);
+    }
+  }
+
+  if (role == FLEET_ROLE_NODE)
+  {
+    if (!shareValid())
+    {
+      clearShare();
+    }
+    if (now - lastSendMs >= FLEET_HELLO_MS)
+    {
+      sendHello();
+      lastSendMs = now;
+    }
+    return;
+  }
+
+  expireMembers(now);
+  setShare(0, memberCount, identities, dwellMs, running);
+  if (beaconDue || now - lastSendMs >= FLEET_BEACON_MS)
+  {
+    sendBeacon(dwellMs, identities);
+    lastSendMs = now;
+    beaconDue = false;
+    if (running)
+    {
+      gridAnchorUs = epochUs;
+      gridPending = true;
+    }
+  }
+}
+
+bool fleetRange(uint16_t &first, uint16_t &count)
+{
+  if (!shareValid() || share.count == 0)
+  {
+    return false;
+  }
+  first = share.first;
+  count = share.count;
+  return true;
+}
+
+uint32_t fleetRevision()
+{
+  return revision;
+}
+
+uint32_t fleetDwellMs()
+{
+  return shareValid() ? share.dwellMs : 0;
+}
+
+bool fleetRunning()
+{
+  return shareValid() && share.running;
+}
+
+// Starting opens a new grid epoch, so every member begins its share in
+// the same instant.
+bool fleetSetRunning(bool run)
+{
+  if (role != FLEET_ROLE_COORDINATOR)
+  {
+    return false;
+  }
+  running = run;
+  if (run)
+  {
+    epochUs = esp_timer_get_time();
+  }
+  beaconDue = true;
+  return true;
+}
+
+bool fleetTakeGrid(int64_t &anchorUs)
+{
+  if (!gridPending)
+  {
+    return false;
+  }
+  gridPending = false;
+  anchorUs = gridAnchorUs;
+  return true;
+}
+
+uint8_t fleetMembers()
+{
+  return memberCount;
+}
+
+void fleetPrintStatus()
+{
+  if (role == FLEET_ROLE_OFF)
+  {
+    return;
+  }
+  Serial.printf("Frota ESP-NOW: %s (canal %d) | %s", fleetRoleName(role), FLEET_CHANNEL,
+                !shareValid() ? "sem parte, fora do ar" : share.running ? "rodando" : "parada");
+  if (role == FLEET_ROLE_COORDINATOR)
+  {
+    Serial.printf(" | %d membros", memberCount);
+  }
+  else if (lastBeaconMs == 0)
+  {
+    Serial.print(" | aguardando coordenador");
+  }
+  else
+  {
+    Serial.printf(" | %s | último beacon há %lu ms | offset %lld us", listed ? "na lista" : "fora da lista",
+                  (unsigned long)(millis() - lastBeaconMs), (long long)offsetUs);
+  }
+  Serial.println();
+  if (shareValid())
+  {
+    Serial.printf("Identidades da frota: %u-%u (%u) | dwell %lu ms\n", share.first,
+                  share.first + share.count - 1, share.count, (unsigned long)share.dwellMs);
+  }
+}
+
+const char *fleetRoleName(uint8_t fleetRole)
+{
+  switch (fleetRole)
+  {
+  case FLEET_ROLE_OFF:
+    return "desligada";
+  case FLEET_ROLE_COORDINATOR:
+    return "coordenador";
+  case FLEET_ROLE_NODE:
+    return "nó";
+  default:
+    return "desconhecido";
+  }
+}
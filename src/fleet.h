@@ -0,0 +1,40 @@
+#pragma once
+
+#include <stdint.h>
+
+#define FLEET_CHANNEL 1
+#define FLEET_MAX_MEMBERS 16
+#define FLEET_BEACON_MS 1000
+#define FLEET_HELLO_MS 2000
+#define FLEET_MEMBER_TIMEOUT_MS 10000
+#define FLEET_SHARE_TIMEOUT_MS (FLEET_MEMBER_TIMEOUT_MS / 2)
+#define FLEET_OFFSET_WINDOW 8
+
+enum FleetRole
+{
+  FLEET_ROLE_OFF = 0,
+  FLEET_ROLE_COORDINATOR = 1,
+  FLEET_ROLE_NODE = 2,
+  FLEET_ROLE_COUNT
+};
+
+// ESP-NOW fleet. The coordinator broadcasts a beacon once a second with
+// its clock, the rotation grid (epoch + k * dwell), the identity count, a
+// run flag and the member list; a member owns the contiguous share of the
+// identity list given by its position. Nodes broadcast a hello until they
+// stop being listed and keep their last share in RTC memory, so reboot
+// rotation has it before the radio is up. A share is dropped as soon as a
+// beacon no longer lists the node, or when no beacon has confirmed it for
+// FLEET_SHARE_TIMEOUT_MS, well before the coordinator hands it to someone
+// else; without a share fleetRunning() is false and nothing goes on air.
+bool fleetBegin(uint8_t role);
+void fleetLoop(uint32_t dwellMs, uint16_t identities);
+bool fleetRange(uint16_t &first, uint16_t &count);
+uint32_t fleetRevision();
+uint32_t fleetDwellMs();
+bool fleetRunning();
+bool fleetSetRunning(bool running);
+bool fleetTakeGrid(int64_t &anchorUs);
+uint8_t fleetMembers();
+void fleetPrintStatus();
+const char *fleetRoleName(uint8_t role);
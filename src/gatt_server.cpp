@@ -0,0 +1,241 @@
+#include "gatt_server.h"
+
+#include <Arduino.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#define HRM_FLAG_SENSOR_CONTACT 0x06
+#define HRM_FLAG_RR_INTERVAL 0x10
+#define BODY_SENSOR_LOCATION_CHEST 0x01
+
+#define GATT_MANUFACTURER "PhantomFreq"
+#define GATT_FIRMWARE_REVISION "1.0"
+#define GATT_STRING_MAX 24
+
+#define NOTIFY_TASK_STACK 4096
+#define NOTIFY_TASK_PRIORITY 3
+
+struct NotifyStats
+{
+  uint32_t sent;
+  uint32_t failed;
+  uint32_t bytes;
+  uint32_t windowStart;
+  uint32_t secondStart;
+  uint32_t secondMark;
+  uint32_t lastSecond;
+  uint32_t peakPerSecond;
+};
+
+static BleServer *gattServer = nullptr;
+static BleCharacteristic *heartRateChar = nullptr;
+static BleCharacteristic *batteryChar = nullptr;
+static TaskHandle_t notifyTask = nullptr;
+
+static volatile uint8_t notifyRateHz = GATT_MIN_NOTIFY_HZ;
+static volatile uint8_t currentBpm = 60;
+static volatile uint8_t currentBattery = 100;
+static volatile bool statsResetPending = false;
+static uint8_t publishedBattery = 0xFF;
+static NotifyStats stats;
+
+class NotifyStatusCallbacks : public BleCharacteristicCallbacks
+{
+  void onStatus(BleCharacteristic *characteristic, Status status, BleStatusCode code)
+  {
+    (void)code;
+    if (status == SUCCESS_NOTIFY)
+    {
+      stats.sent++;
+      stats.bytes += bleValueLength(characteristic);
+    }
+    else if (status == ERROR_GATT)
+    {
+      stats.failed++;
+    }
+  }
+};
+
+static NotifyStatusCallbacks notifyStatus;
+
+static BleCharacteristic *addString(BleService *service, uint16_t uuid, const char *value)
+{
+  BleCharacteristic *characteristic = service->createCharacteristic(BleUUID(uuid), BLE_PROPERTY_READ);
+  characteristic->setValue(std::string(value));
+  return characteristic;
+}
+
+static void updateHeartRate(uint8_t bpm)
+{
+  uint16_t rr = (uint16_t)((60UL * 1024UL) / (bpm > 0 ? bpm : 1));
+  uint8_t measurement[4] = {HRM_FLAG_SENSOR_CONTACT | HRM_FLAG_RR_INTERVAL, bpm, (uint8_t)(rr & 0xFF), (uint8_t)(rr >> 8)};
+  heartRateChar->setValue(measurement, sizeof(measurement));
+}
+
+static void resetStats(uint32_t now)
+{
+  memset(&stats, 0, sizeof(stats));
+  stats.windowStart = now;
+  stats.secondStart = now;
+}
+
+static void notifyLoop(void *arg)
+{
+  (void)arg;
+  TickType_t lastWake = xTaskGetTickCount();
+
+  for (;;)
+  {
+    TickType_t period = pdMS_TO_TICKS(1000 / notifyRateHz);
+    vTaskDelayUntil(&lastWake, period > 0 ? period : 1);
+
+    uint32_t now = millis();
+    if (statsResetPending)
+    {
+      statsResetPending = false;
+      resetStats(now);
+    }
+
+    updateHeartRate(currentBpm);
+    uint8_t battery = currentBattery;
+    bool batteryChanged = battery != publishedBattery;
+    if (batteryChanged)
+    {
+      publishedBattery = battery;
+      batteryChar->setValue(&publishedBattery, 1);
+    }
+
+    if (gattServer->getConnectedCount() == 0)
+    {
+      continue;
+    }
+
+    heartRateChar->notify();
+    if (batteryChanged)
+    {
+      batteryChar->notify();
+    }
+
+    if (now - stats.secondStart >= 1000)
+    {
+      stats.lastSecond = stats.sent - stats.secondMark;
+      if (stats.lastSecond > stats.peakPerSecond)
+      {
+        stats.peakPerSecond = stats.lastSecond;
+      }
+      stats.secondMark = stats.sent;
+      stats.secondStart = now;
+    }
+  }
+}
+
+void gattBegin(BleServer *server, BleService *heartRate, BleService *battery, BleService *deviceInfo,
+               const char *name)
+{
+  gattServer = server;
+
+  heartRateChar = heartRate->createCharacteristic(BleUUID((uint16_t)0x2A37), BLE_PROPERTY_NOTIFY);
+  bleAddCccd(heartRateChar);
+  heartRateChar->setCallbacks(&notifyStatus);
+  updateHeartRate(currentBpm);
+
+  BleCharacteristic *location = heartRate->createCharacteristic(BleUUID((uint16_t)0x2A38), BLE_PROPERTY_READ);
+  uint8_t chest = BODY_SENSOR_LOCATION_CHEST;
+  location->setValue(&chest, 1);
+
+  batteryChar = battery->createCharacteristic(BleUUID((uint16_t)0x2A19),
+                                              BLE_PROPERTY_READ | BLE_PROPERTY_NOTIFY);
+  bleAddCccd(batteryChar);
+  batteryChar->setCallbacks(&notifyStatus);
+  publishedBattery = currentBattery;
+  batteryChar->setValue(&publishedBattery, 1);
+
+  char model[GATT_STRING_MAX];
+  const char *serial = strchr(name, '-');
+  size_t modelLength = serial != nullptr ? (size_t)(serial - name) : strlen(name);
+  if (modelLength >= sizeof(model))
+  {
+    modelLength = sizeof(model) - 1;
+  }
+  memcpy(model, name, modelLength);
+  model[modelLength] = '\0';
+
+  addString(deviceInfo, 0x2A29, GATT_MANUFACTURER);
+  addString(deviceInfo, 0x2A24, model);
+  addString(deviceInfo, 0x2A25, serial != nullptr ? serial + 1 : name);
+  addString(deviceInfo, 0x2A26, GATT_FIRMWARE_REVISION);
+}
+
+bool gattStartNotifier(uint8_t rateHz)
+{
+  if (gattServer == nullptr)
+  {
+    return false;
+  }
+  gattSetRate(rateHz);
+  if (notifyTask != nullptr)
+  {
+    return true;
+  }
+  resetStats(millis());
+  return xTaskCreate(notifyLoop, "gatt_notify", NOTIFY_TASK_STACK, nullptr, NOTIFY_TASK_PRIORITY, &notifyTask) == pdPASS;
+}
+
+void gattSetRate(uint8_t rateHz)
+{
+  if (rateHz < GATT_MIN_NOTIFY_HZ)
+  {
+    rateHz = GATT_MIN_NOTIFY_HZ;
+  }
+  if (rateHz > GATT_MAX_NOTIFY_HZ)
+  {
+    rateHz = GATT_MAX_NOTIFY_HZ;
+  }
+  notifyRateHz = rateHz;
+}
+
+void gattSetReading(uint8_t bpm, uint8_t battery)
+{
+  currentBpm = bpm;
+  currentBattery = battery;
+}
+
+void gattResetStats()
+{
+  statsResetPending = true;
+}
+
+void gattGetCounters(uint32_t &sent, uint32_t &failed, uint32_t &bytes)
+{
+  sent = stats.sent;
+  failed = stats.failed;
+  bytes = stats.bytes;
+}
+
+void gattPrintStatus()
+{
+  if (gattServer == nullptr)
+  {
+    return;
+  }
+
+  uint32_t connected = gattServer->getConnectedCount();
+  uint32_t window = millis() - stats.windowStart;
+  Serial.printf("Clientes conectados: %lu | Notificação HR: %d Hz\n", (unsigned long)connected, notifyRateHz);
+  Serial.printf("Notificações: %lu enviadas, %lu falhas, %lu bytes em %lu ms\n",
+                (unsigned long)stats.sent, (unsigned long)stats.failed,
+                (unsigned long)stats.bytes, (unsigned long)window);
+  if (window > 0 && connected > 0)
+  {
+    float perSecond = stats.sent * 1000.0f / window;
+    Serial.printf("Vazão: %.1f notif/s (%.1f por conexão), %.0f B/s | último segundo: %lu | pico: %lu\n",
+                  perSecond, perSecond / connected, stats.bytes * 1000.0f / window,
+                  (unsigned long)stats.lastSecond, (unsigned long)stats.peakPerSecond);
+  }
+}
+
+uint32_t gattStackFree()
+{
+  return notifyTask != nullptr ? uxTaskGetStackHighWaterMark(notifyTask) : 0;
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <stdint.h>
+#include "ble_stack.h"
+
+#define GATT_MIN_NOTIFY_HZ 1
+#define GATT_MAX_NOTIFY_HZ 200
+#define GATT_MIN_CONN_INTERVAL_MS 8
+#define GATT_MAX_CONN_INTERVAL_MS 4000
+#define GATT_MAX_CONN_LATENCY 499
+#define GATT_MIN_CONN_TIMEOUT_MS 100
+#define GATT_MAX_CONN_TIMEOUT_MS 32000
+#define GATT_MIN_MTU 23
+#define GATT_MAX_MTU 517
+
+void gattBegin(BleServer *server, BleService *heartRate, BleService *battery, BleService *deviceInfo,
+               const char *name);
+bool gattStartNotifier(uint8_t rateHz);
+void gattSetRate(uint8_t rateHz);
+void gattSetReading(uint8_t bpm, uint8_t battery);
+void gattResetStats();
+void gattGetCounters(uint32_t &sent, uint32_t &failed, uint32_t &bytes);
+void gattPrintStatus();
+uint32_t gattStackFree();
@@ -0,0 +1,120 @@
+#include "gatt_transfer.h"
+
+#include <Arduino.h>
+#include <string>
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+
+static BleCharacteristic *rxChar = nullptr;
+static BleCharacteristic *txChar = nullptr;
+static QueueHandle_t frameQueue = nullptr;
+static QueueHandle_t errorQueue = nullptr;
+static ProtocolParser parser;
+static volatile uint32_t dropped = 0;
+static unsigned long lastWrite = 0;
+
+// Errors are sent from the loop with the replies, so their chunks never
+// interleave with a reply on TX.
+static void reportError(uint8_t status)
+{
+  if (xQueueSend(errorQueue, &status, 0) != pdTRUE)
+  {
+    dropped++;
+  }
+}
+
+// Runs on the BLE host task; frames are only parsed and queued here.
+class TransferCallbacks : public BleCharacteristicCallbacks
+{
+  void onWrite(BleCharacteristic *characteristic)
+  {
+    unsigned long now = millis();
+    if (parser.active() && now - lastWrite > TRANSFER_FRAME_TIMEOUT_MS)
+    {
+      parser.reset();
+    }
+    lastWrite = now;
+
+    std::string value = characteristic->getValue();
+    for (size_t i = 0; i < value.length(); i++)
+    {
+      switch (parser.feed((uint8_t)value[i]))
+      {
+      case PROTOCOL_PARSE_FRAME:
+        if (xQueueSend(frameQueue, &parser.frame(), 0) != pdTRUE)
+        {
+          dropped++;
+          reportError(PROTOCOL_STATUS_BUSY);
+        }
+        break;
+
+      case PROTOCOL_PARSE_BAD_CRC:
+        reportError(PROTOCOL_STATUS_BAD_CRC);
+        break;
+
+      case PROTOCOL_PARSE_TOO_LONG:
+        reportError(PROTOCOL_STATUS_TOO_LONG);
+        break;
+
+      default:
+        break;
+      }
+    }
+  }
+};
+
+static TransferCallbacks transferCallbacks;
+
+void transferBegin(BleService *service)
+{
+  frameQueue = xQueueCreate(TRANSFER_QUEUE_DEPTH, sizeof(ProtocolFrame));
+  errorQueue = xQueueCreate(TRANSFER_QUEUE_DEPTH, sizeof(uint8_t));
+  if (frameQueue == nullptr || errorQueue == nullptr)
+  {
+    return;
+  }
+
+  rxChar = service->createCharacteristic(BleUUID((uint16_t)TRANSFER_RX_UUID),
+                                         BLE_PROPERTY_WRITE | BLE_PROPERTY_WRITE_NR);
+  rxChar->setCallbacks(&transferCallbacks);
+
+  txChar = service->createCharacteristic(BleUUID((uint16_t)TRANSFER_TX_UUID), BLE_PROPERTY_NOTIFY);
+  bleAddCccd(txChar);
+}
+
+bool transferReceiveFrame(ProtocolFrame &frame)
+{
+  uint8_t status;
+  while (errorQueue != nullptr && xQueueReceive(errorQueue, &status, 0) == pdTRUE)
+  {
+    transferSendFrame(PROTOCOL_OP_ERROR, &status, 1);
+  }
+  return frameQueue != nullptr && xQueueReceive(frameQueue, &frame, 0) == pdTRUE;
+}
+
+// Replies are short, so they go out in default-MTU notifications and work
+// before (or without) an MTU exchange.
+void transferSendFrame(uint8_t opcode, const uint8_t *payload, uint16_t length)
+{
+  if (txChar == nullptr)
+  {
+    return;
+  }
+  uint8_t out[PROTOCOL_MAX_PAYLOAD + PROTOCOL_OVERHEAD];
+  if (length > PROTOCOL_MAX_PAYLOAD)
+  {
+    length = PROTOCOL_MAX_PAYLOAD;
+  }
+  size_t total = protocolEncode(opcode, payload, length, out);
+  for (size_t offset = 0; offset < total; offset += TRANSFER_NOTIFY_CHUNK)
+  {
+    size_t chunk = total - offset < TRANSFER_NOTIFY_CHUNK ? total - offset : TRANSFER_NOTIFY_CHUNK;
+    txChar->setValue(&out[offset], chunk);
+    txChar->notify();
+  }
+}
+
+uint32_t transferDropped()
+{
+  return dropped;
+}
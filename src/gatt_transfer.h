@@ -0,0 +1,23 @@
+#pragma once
+
+#include <stdint.h>
+#include "ble_stack.h"
+#include "protocol.h"
+
+#define TRANSFER_RX_UUID 0xFD01
+#define TRANSFER_TX_UUID 0xFD02
+#define TRANSFER_QUEUE_DEPTH 4
+#define TRANSFER_NOTIFY_CHUNK 20
+#define TRANSFER_FRAME_TIMEOUT_MS 500
+
+// Protocol frames over GATT: the central writes the same byte stream the
+// serial console takes to TRANSFER_RX (write without response, split at
+// any point) and gets replies as notifications on TRANSFER_TX. Each reply
+// acknowledges one frame, so a client can keep up to TRANSFER_QUEUE_DEPTH
+// frames in flight; one that finds the queue full is answered with
+// PROTOCOL_STATUS_BUSY and should be resent. One provisioning client at a
+// time.
+void transferBegin(BleService *service);
+bool transferReceiveFrame(ProtocolFrame &frame);
+void transferSendFrame(uint8_t opcode, const uint8_t *payload, uint16_t length);
+uint32_t transferDropped();
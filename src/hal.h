@@ -0,0 +1,17 @@
+#pragma once
+
+#include <stdint.h>
+
+// The few platform calls the pure logic needs. Board builds forward them to
+// the SDK; the host test target (-DPHANTOM_HOST) links test/host/hal_host.cpp.
+#ifdef PHANTOM_HOST
+#define RTC_NOINIT_ATTR
+uint32_t halMillis();
+uint32_t halRandom();
+#else
+#include <Arduino.h>
+#include "esp_attr.h"
+#include "esp_system.h"
+inline uint32_t halMillis() { return millis(); }
+inline uint32_t halRandom() { return esp_random(); }
+#endif
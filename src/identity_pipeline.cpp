@@ -0,0 +1,180 @@
+#include "identity_pipeline.h"
+
+#include <Arduino.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+
+#if portNUM_PROCESSORS > 1
+#define PIPELINE_AFFINITY PIPELINE_CORE
+#else
+#define PIPELINE_AFFINITY tskNO_AFFINITY
+#endif
+
+static PreparedIdentity slots[2];
+static IdentityProducer produce = nullptr;
+static TaskHandle_t producerTask = nullptr;
+static SemaphoreHandle_t stateLock = nullptr;
+static portMUX_TYPE slotMux = portMUX_INITIALIZER_UNLOCKED;
+static uint8_t current = 0;
+static bool ready = false;
+static bool sparePicked = false;
+static volatile uint32_t generation = 0;
+static volatile bool active = false;
+static volatile uint32_t misses = 0;
+static volatile uint32_t lastPrepareUs = 0;
+static volatile uint32_t maxPrepareUs = 0;
+
+// The spare slot is only written while it is not marked ready, so the loop
+// never swaps in a half-built identity. A flush during a fill bumps the
+// generation, and the stale result is rebuilt for the identity it already
+// picked.
+static void producerLoop(void *arg)
+{
+  (void)arg;
+  for (;;)
+  {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    portENTER_CRITICAL(&slotMux);
+    bool filled = ready;
+    portEXIT_CRITICAL(&slotMux);
+    if (filled)
+    {
+      continue;
+    }
+
+    uint32_t started;
+    uint8_t spare;
+    bool keepPick;
+    do
+    {
+      portENTER_CRITICAL(&slotMux);
+      started = generation;
+      spare = current ^ 1;
+      keepPick = sparePicked;
+      portEXIT_CRITICAL(&slotMux);
+
+      unsigned long start = micros();
+      produce(slots[spare], keepPick);
+      portENTER_CRITICAL(&slotMux);
+      sparePicked = true;
+      portEXIT_CRITICAL(&slotMux);
+      lastPrepareUs = micros() - start;
+      if (lastPrepareUs > maxPrepareUs)
+      {
+        maxPrepareUs = lastPrepareUs;
+      }
+    } while (started != generation);
+
+    portENTER_CRITICAL(&slotMux);
+    ready = started == generation;
+    portEXIT_CRITICAL(&slotMux);
+  }
+}
+
+bool pipelineBegin(IdentityProducer producer)
+{
+  produce = producer;
+  if (stateLock == nullptr)
+  {
+    stateLock = xSemaphoreCreateMutex();
+    if (stateLock == nullptr)
+    {
+      return false;
+    }
+  }
+  if (producerTask == nullptr &&
+      xTaskCreatePinnedToCore(producerLoop, "id_pipeline", PIPELINE_TASK_STACK, nullptr, PIPELINE_TASK_PRIORITY,
+                              &producerTask, PIPELINE_AFFINITY) != pdPASS)
+  {
+    producerTask = nullptr;
+    return false;
+  }
+  misses = 0;
+  maxPrepareUs = 0;
+  portENTER_CRITICAL(&slotMux);
+  sparePicked = false;
+  portEXIT_CRITICAL(&slotMux);
+  active = true;
+  pipelineFlush();
+  return true;
+}
+
+void pipelineStop()
+{
+  active = false;
+}
+
+bool pipelineActive()
+{
+  return active;
+}
+
+PreparedIdentity *pipelineSwap()
+{
+  if (!active)
+  {
+    return nullptr;
+  }
+  portENTER_CRITICAL(&slotMux);
+  bool taken = ready;
+  if (taken)
+  {
+    current ^= 1;
+    ready = false;
+    sparePicked = false;
+  }
+  portEXIT_CRITICAL(&slotMux);
+
+  if (!taken)
+  {
+    misses++;
+    return nullptr;
+  }
+  xTaskNotifyGive(producerTask);
+  return &slots[current];
+}
+
+void pipelineFlush()
+{
+  if (producerTask == nullptr)
+  {
+    return;
+  }
+  portENTER_CRITICAL(&slotMux);
+  generation++;
+  ready = false;
+  portEXIT_CRITICAL(&slotMux);
+  xTaskNotifyGive(producerTask);
+}
+
+void pipelineLock()
+{
+  if (stateLock != nullptr)
+  {
+    xSemaphoreTake(stateLock, portMAX_DELAY);
+  }
+}
+
+void pipelineUnlock()
+{
+  if (stateLock != nullptr)
+  {
+    xSemaphoreGive(stateLock);
+  }
+}
+
+uint32_t pipelineMisses()
+{
+  return misses;
+}
+
+uint32_t pipelineLastPrepareUs()
+{
+  return lastPrepareUs;
+}
+
+uint32_t pipelineMaxPrepareUs()
+{
+  return maxPrepareUs;
+}
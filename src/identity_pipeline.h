@@ -0,0 +1,46 @@
+#pragma once
+
+#include <stdint.h>
+#include "adv_payload.h"
+#include "identity_table.h"
+
+#ifndef PIPELINE_CORE
+#define PIPELINE_CORE 0
+#endif
+#define PIPELINE_TASK_STACK 4096
+#define PIPELINE_TASK_PRIORITY 1
+
+// Everything hot rotation needs to put the next identity on air.
+struct PreparedIdentity
+{
+  uint16_t index;
+  const IdentityEntry *identity;
+  uint8_t addr[6];
+  uint8_t profile;
+  char name[SENSOR_NAME_MAX + 1];
+  uint8_t bpm;
+  uint8_t battery;
+  SensorPayload payload;
+};
+
+// keepPick asks for the identity already in next to be rebuilt (after a
+// flush) rather than a new one picked.
+typedef void (*IdentityProducer)(PreparedIdentity &next, bool keepPick);
+
+// Double buffer between a producer task pinned to PIPELINE_CORE and the
+// rotation loop on the other core. The producer fills the spare slot while
+// the current one is on air; pipelineSwap() hands it over and returns the
+// old slot for refilling, or nullptr when the producer is late (counted as
+// a miss). pipelineFlush() rebuilds the spare slot for new settings but
+// keeps the identity it holds. State the producer shares with the loop is touched only between
+// pipelineLock()/pipelineUnlock(); both are no-ops until pipelineBegin.
+bool pipelineBegin(IdentityProducer producer);
+void pipelineStop();
+bool pipelineActive();
+PreparedIdentity *pipelineSwap();
+void pipelineFlush();
+void pipelineLock();
+void pipelineUnlock();
+uint32_t pipelineMisses();
+uint32_t pipelineLastPrepareUs();
+uint32_t pipelineMaxPrepareUs();
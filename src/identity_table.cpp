@@ -0,0 +1,476 @@
+#include "identity_table.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include "esp_attr.h"
+#include "esp_partition.h"
+#include "crc.h"
+#include "device_profile.h"
+#include "signal_model.h"
+
+#define IDENTITY_MAGIC 0x44494650
+#define IDENTITY_VERSION 2
+#define IDENTITY_VERSION_V1 1
+#define IDENTITY_VERIFIED_MAGIC 0x56444950UL
+
+struct IdentityHeader
+{
+  uint32_t magic;
+  uint16_t version;
+  uint16_t entrySize;
+  uint32_t count;
+  uint32_t entriesCrc;
+  uint32_t headerCrc;
+};
+
+static_assert(sizeof(IdentityHeader) <= IDENTITY_HEADER_SIZE, "identity header must fit its reserved space");
+
+// The entry CRC takes a pass over the whole table, so the header that last
+// passed it is remembered in RTC memory and reboot rotation maps it
+// straight away. Any upload rewrites the header, and with it this key.
+struct VerifiedTable
+{
+  uint32_t magic;
+  uint32_t headerCrc;
+  uint32_t checkInverse;
+};
+
+RTC_NOINIT_ATTR static VerifiedTable verified;
+
+static const uint8_t builtinMacs[][6] = {
+
+    {0xC2, 0x52, 0xF5, 0xC7, 0xD6, 0xFE},
+    {0xD2, 0x4F, 0x3A, 0x77, 0x22, 0x10},
+    {0xE2, 0x91, 0xAB, 0x12, 0x34, 0x54},
+    {0xC6, 0x34, 0xA7, 0x89, 0x10, 0x20},
+    {0xD6, 0x89, 0xB1, 0x43, 0x21, 0x8E},
+    {0xE6, 0x11, 0x44, 0x66, 0x99, 0xA8},
+    {0xC4, 0x12, 0x88, 0x55, 0x44, 0x64},
+    {0xD4, 0xDE, 0xAD, 0xBE, 0xEF, 0xFE},
+    {0xE4, 0x00, 0x11, 0x22, 0x33, 0x42},
+    {0xC8, 0xA1, 0xB2, 0xC3, 0xD4, 0xE2},
+    {0xD8, 0x55, 0x66, 0x77, 0x88, 0x96},
+    {0xE8, 0x99, 0x88, 0x77, 0x66, 0x52},
+    {0xCA, 0xBC, 0xDE, 0xF0, 0x12, 0x32},
+    {0xDA, 0x45, 0x67, 0x89, 0xAB, 0xCA},
+    {0xEA, 0x11, 0x22, 0x33, 0x44, 0x52},
+    {0xCC, 0x9F, 0x8E, 0x7D, 0x6C, 0x58},
+    {0xDC, 0x4A, 0x3B, 0x2C, 0x1D, 0x0C},
+    {0xEC, 0xFE, 0xDC, 0xBA, 0x98, 0x74},
+    {0xCE, 0x01, 0x23, 0x45, 0x67, 0x86},
+    {0xF6, 0x5D, 0x5E, 0x5F, 0x60, 0x60},
+    {0xCA, 0x61, 0x62, 0x63, 0x64, 0x64},
+    {0xD2, 0x13, 0x24, 0x35, 0x46, 0x54},
+    {0xE2, 0xF1, 0xE2, 0xD3, 0xC4, 0xB2},
+    {0xC2, 0x11, 0x33, 0x55, 0x77, 0x96},
+    {0xF2, 0x10, 0x20, 0x30, 0x40, 0x4E},
+    {0xF6, 0x01, 0x02, 0x03, 0x04, 0x02},
+    {0xF6, 0xAB, 0xCD, 0xEF, 0x12, 0x32},
+    {0xF8, 0x55, 0xAA, 0x55, 0xAA, 0x52},
+    {0xFA, 0x99, 0x00, 0x99, 0x00, 0x96},
+    {0xFC, 0xDE, 0xAD, 0xFA, 0xCE, 0xFE},
+    {0xFE, 0xCA, 0xFE, 0xBA, 0xBE, 0xFE},
+    {0xC2, 0x11, 0x22, 0x33, 0x44, 0x52},
+    {0xD2, 0x66, 0x77, 0x88, 0x99, 0xA8},
+    {0xE2, 0x10, 0x32, 0x54, 0x76, 0x96},
+    {0xC6, 0x89, 0x67, 0x45, 0x23, 0xFE},
+    {0xD6, 0x0F, 0x1E, 0x2D, 0x3C, 0x48},
+    {0xE6, 0x12, 0x34, 0x56, 0x78, 0x8E},
+    {0xC4, 0x55, 0x44, 0x33, 0x22, 0x0E},
+    {0xD4, 0xF0, 0xF1, 0xF2, 0xF3, 0xF2},
+    {0xE4, 0x04, 0x03, 0x02, 0x01, 0xFE},
+    {0xC8, 0x0A, 0x0B, 0x0C, 0x0D, 0x0C},
+    {0xD8, 0xAA, 0xBB, 0xCC, 0xDD, 0xEC},
+    {0xE8, 0x1A, 0x2B, 0x3C, 0x4D, 0x5C},
+    {0xCA, 0xFE, 0xED, 0xBE, 0xEF, 0xFE},
+    {0xDA, 0x99, 0x88, 0x77, 0x66, 0x52},
+    {0xEA, 0x22, 0x44, 0x66, 0x88, 0xA8},
+    {0xCC, 0x77, 0x66, 0x55, 0x44, 0x30},
+    {0xDC, 0xAB, 0xCD, 0xEF, 0x01, 0x20},
+    {0xEC, 0xBA, 0xDC, 0xFE, 0x10, 0x30},
+    {0xCE, 0x01, 0x10, 0x01, 0x10, 0xFE},
+    {0xDE, 0x42, 0x24, 0x42, 0x24, 0x40},
+    {0xEE, 0x69, 0x96, 0x69, 0x96, 0x66},
+    {0xC2, 0x0F, 0x0E, 0x0D, 0x0C, 0x08},
+    {0xD2, 0xFF, 0xEE, 0xDD, 0xCC, 0xB8},
+    {0xE2, 0x1B, 0x2C, 0x3D, 0x4E, 0x5C},
+    {0xF2, 0xBE, 0xEF, 0xBE, 0xEF, 0xBC},
+    {0xC2, 0x88, 0x99, 0xAA, 0xBB, 0xCA},
+    {0xD2, 0x33, 0x44, 0x55, 0x66, 0x76},
+    {0xE2, 0x77, 0x88, 0x99, 0xAA, 0xBA},
+    {0xF2, 0x11, 0x22, 0x33, 0x44, 0x54},
+    {0xC2, 0xAA, 0xBB, 0xCC, 0xDD, 0xEC},
+    {0xD2, 0x12, 0x34, 0x56, 0x78, 0x98},
+    {0xE2, 0xAB, 0xCD, 0xEF, 0x01, 0x20},
+    {0xF2, 0x99, 0x88, 0x77, 0x66, 0x52},
+    {0xC6, 0x11, 0x22, 0x33, 0x44, 0x54},
+    {0xD6, 0xAA, 0xBB, 0xCC, 0xDD, 0xEC},
+    {0xE6, 0x12, 0x34, 0x56, 0x78, 0x98},
+    {0xF6, 0x99, 0x88, 0x77, 0x66, 0x52},
+    {0xCA, 0x11, 0x22, 0x33, 0x44, 0x54},
+    {0xDA, 0xAA, 0xBB, 0xCC, 0xDD, 0xEC},
+    {0xEA, 0x12, 0x34, 0x56, 0x78, 0x98},
+    {0xFA, 0x99, 0x88, 0x77, 0x66, 0x52},
+    {0xCE, 0x11, 0x22, 0x33, 0x44, 0x54},
+    {0xDE, 0xAA, 0xBB, 0xCC, 0xDD, 0xEC},
+    {0xEE, 0x12, 0x34, 0x56, 0x78, 0x98},
+    {0xFE, 0x99, 0x88, 0x77, 0x66, 0x52},
+    {0xC2, 0x01, 0x02, 0x03, 0x04, 0x04},
+    {0xD2, 0x05, 0x06, 0x07, 0x08, 0x08},
+    {0xE2, 0x09, 0x0A, 0x0B, 0x0C, 0x0C},
+    {0xF2, 0x0D, 0x0E, 0x0F, 0x10, 0x10},
+    {0xC4, 0x11, 0x12, 0x13, 0x14, 0x14},
+    {0xD4, 0x15, 0x16, 0x17, 0x18, 0x18},
+    {0xE4, 0x19, 0x1A, 0x1B, 0x1C, 0x1C},
+    {0xF4, 0x1D, 0x1E, 0x1F, 0x20, 0x20},
+    {0xC8, 0x21, 0x22, 0x23, 0x24, 0x24},
+    {0xD8, 0x25, 0x26, 0x27, 0x28, 0x28},
+    {0xE8, 0x29, 0x2A, 0x2B, 0x2C, 0x2C},
+    {0xF8, 0x2D, 0x2E, 0x2F, 0x30, 0x30},
+    {0xCC, 0x31, 0x32, 0x33, 0x34, 0x34},
+    {0xDC, 0x35, 0x36, 0x37, 0x38, 0x38},
+    {0xEC, 0x39, 0x3A, 0x3B, 0x3C, 0x3C},
+    {0xFC, 0x3D, 0x3E, 0x3F, 0x40, 0x40},
+    {0xC2, 0x41, 0x42, 0x43, 0x44, 0x44},
+    {0xD2, 0x45, 0x46, 0x47, 0x48, 0x48},
+    {0xE2, 0x49, 0x4A, 0x4B, 0x4C, 0x4C},
+    {0xF2, 0x4D, 0x4E, 0x4F, 0x50, 0x50},
+    {0xC6, 0x51, 0x52, 0x53, 0x54, 0x54},
+    {0xD6, 0x55, 0x56, 0x57, 0x58, 0x58},
+    {0xE6, 0x59, 0x5A, 0x5B, 0x5C, 0x5C}};
+
+#define BUILTIN_COUNT (sizeof(builtinMacs) / sizeof(builtinMacs[0]))
+
+static IdentityEntry builtinTable[BUILTIN_COUNT];
+
+static const esp_partition_t *partition = nullptr;
+static spi_flash_mmap_handle_t mapHandle;
+static bool mapped = false;
+static bool uploading = false;
+static uint16_t uploadCount = 0;
+
+static const IdentityEntry *entries = builtinTable;
+static uint16_t *uniqueIndex = nullptr;
+static uint16_t entryCount = 0;
+static uint16_t duplicateCount = 0;
+static bool duplicatesChecked = true;
+static IdentitySource source = IDENTITY_SOURCE_BUILTIN;
+static uint16_t tableVersion = IDENTITY_VERSION;
+
+static uint32_t headerCrc(const IdentityHeader &header)
+{
+  return crc32((const uint8_t *)&header, offsetof(IdentityHeader, headerCrc));
+}
+
+static uint32_t macHash(const uint8_t *mac)
+{
+  uint32_t hash = 2166136261UL;
+  for (int i = 0; i < 6; i++)
+  {
+    hash ^= mac[i];
+    hash *= 16777619UL;
+  }
+  return hash;
+}
+
+// Builds uniqueIndex over the raw records, keeping the first occurrence
+// of each MAC. The index stays unallocated when there is nothing to skip,
+// so lookups go straight to the mapped records. Without memory for the
+// hash table the records are served as they are, flagged unchecked.
+static void deduplicate(uint16_t rawCount)
+{
+  free(uniqueIndex);
+  uniqueIndex = nullptr;
+  duplicateCount = 0;
+  entryCount = rawCount;
+  duplicatesChecked = false;
+
+  uint32_t capacity = 1;
+  while (capacity < 2UL * rawCount)
+  {
+    capacity <<= 1;
+  }
+  uint16_t *slots = (uint16_t *)malloc(capacity * sizeof(uint16_t));
+  uint16_t *index = (uint16_t *)malloc(rawCount * sizeof(uint16_t));
+  if (slots == nullptr || index == nullptr)
+  {
+    free(slots);
+    free(index);
+    return;
+  }
+  memset(slots, 0xFF, capacity * sizeof(uint16_t));
+  duplicatesChecked = true;
+
+  uint16_t unique = 0;
+  for (uint16_t i = 0; i < rawCount; i++)
+  {
+    uint32_t slot = macHash(entries[i].mac) & (capacity - 1);
+    bool duplicate = false;
+    while (slots[slot] != 0xFFFF)
+    {
+      if (memcmp(entries[slots[slot]].mac, entries[i].mac, 6) == 0)
+      {
+        duplicate = true;
+        break;
+      }
+      slot = (slot + 1) & (capacity - 1);
+    }
+    if (duplicate)
+    {
+      duplicateCount++;
+      continue;
+    }
+    slots[slot] = i;
+    index[unique++] = i;
+  }
+  free(slots);
+
+  if (duplicateCount == 0)
+  {
+    free(index);
+    return;
+  }
+  uniqueIndex = index;
+  entryCount = unique;
+}
+
+static void unmapPartition()
+{
+  if (mapped)
+  {
+    spi_flash_munmap(mapHandle);
+    mapped = false;
+  }
+}
+
+static void useBuiltin()
+{
+  unmapPartition();
+  for (size_t i = 0; i < BUILTIN_COUNT; i++)
+  {
+    IdentityEntry &entry = builtinTable[i];
+    memset(&entry, 0, sizeof(entry));
+    memcpy(entry.mac, builtinMacs[i], 6);
+    entry.battery = IDENTITY_BATTERY_GENERATOR;
+  }
+  entries = builtinTable;
+  source = IDENTITY_SOURCE_BUILTIN;
+  tableVersion = IDENTITY_VERSION;
+  deduplicate(BUILTIN_COUNT);
+}
+
+static bool mapPartition()
+{
+  if (partition == nullptr)
+  {
+    return false;
+  }
+
+  IdentityHeader header;
+  if (esp_partition_read(partition, 0, &header, sizeof(header)) != ESP_OK ||
+      header.magic != IDENTITY_MAGIC ||
+      (header.version != IDENTITY_VERSION && header.version != IDENTITY_VERSION_V1) ||
+      header.entrySize != sizeof(IdentityEntry) || header.headerCrc != headerCrc(header) ||
+      header.count == 0 || header.count > IDENTITY_MAX_ENTRIES ||
+      IDENTITY_HEADER_SIZE + header.count * sizeof(IdentityEntry) > partition->size)
+  {
+    return false;
+  }
+
+  const void *base;
+  size_t mapSize = IDENTITY_HEADER_SIZE + header.count * sizeof(IdentityEntry);
+  if (esp_partition_mmap(partition, 0, mapSize, SPI_FLASH_MMAP_DATA, &base, &mapHandle) != ESP_OK)
+  {
+    return false;
+  }
+  const uint8_t *records = (const uint8_t *)base + IDENTITY_HEADER_SIZE;
+  bool known = verified.magic == IDENTITY_VERIFIED_MAGIC && verified.headerCrc == header.headerCrc &&
+               verified.checkInverse == ~header.headerCrc;
+  if (!known && crc32(records, header.count * sizeof(IdentityEntry)) != header.entriesCrc)
+  {
+    spi_flash_munmap(mapHandle);
+    return false;
+  }
+  verified.magic = IDENTITY_VERIFIED_MAGIC;
+  verified.headerCrc = header.headerCrc;
+  verified.checkInverse = ~header.headerCrc;
+  mapped = true;
+  entries = (const IdentityEntry *)records;
+  source = IDENTITY_SOURCE_PARTITION;
+  tableVersion = header.version;
+  deduplicate(header.count);
+  return true;
+}
+
+void identityTableBegin()
+{
+  unmapPartition();
+  if (partition == nullptr)
+  {
+    partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA,
+                                         (esp_partition_subtype_t)IDENTITY_PARTITION_SUBTYPE,
+                                         IDENTITY_PARTITION_LABEL);
+  }
+  if (!mapPartition())
+  {
+    useBuiltin();
+  }
+}
+
+IdentitySource identitySource()
+{
+  return source;
+}
+
+uint16_t identityCount()
+{
+  return entryCount;
+}
+
+uint16_t identityDuplicates()
+{
+  return duplicateCount;
+}
+
+bool identityDuplicatesChecked()
+{
+  return duplicatesChecked;
+}
+
+const IdentityEntry &identityAt(uint16_t index)
+{
+  if (index >= entryCount)
+  {
+    index = 0;
+  }
+  return entries[uniqueIndex != nullptr ? uniqueIndex[index] : index];
+}
+
+uint8_t identityProfile(const IdentityEntry &entry)
+{
+  if (tableVersion == IDENTITY_VERSION_V1 || entry.profile >= DEVICE_PROFILE_COUNT)
+  {
+    return DEVICE_PROFILE_DEFAULT;
+  }
+  return entry.profile;
+}
+
+void identityName(const IdentityEntry &entry, char *out, size_t outSize)
+{
+  const char *baseName = deviceProfile(identityProfile(entry)).baseName;
+  // Version 1 suffixes run on into the byte that now holds the profile.
+  size_t suffixMax = tableVersion == IDENTITY_VERSION_V1 ? IDENTITY_V1_NAME_SUFFIX_MAX : IDENTITY_NAME_SUFFIX_MAX;
+  size_t suffixLength = strnlen(entry.nameSuffix, suffixMax);
+  const char *separator = strchr(baseName, '-');
+  size_t prefixLength = separator != nullptr ? (size_t)(separator - baseName) + 1 : 0;
+
+  if (suffixLength == 0 || prefixLength + suffixLength >= outSize)
+  {
+    strncpy(out, baseName, outSize - 1);
+    out[outSize - 1] = '\0';
+    return;
+  }
+  memcpy(out, baseName, prefixLength);
+  memcpy(&out[prefixLength], entry.nameSuffix, suffixLength);
+  out[prefixLength + suffixLength] = '\0';
+}
+
+uint8_t identityBpm(const IdentityEntry &entry, uint8_t generatorBpm)
+{
+  if (entry.bpmBaseline == IDENTITY_BPM_GENERATOR)
+  {
+    return generatorBpm;
+  }
+  int bpm = entry.bpmBaseline + (int)generatorBpm - IDENTITY_REFERENCE_BPM;
+  if (bpm < SIGNAL_MIN_BPM)
+    bpm = SIGNAL_MIN_BPM;
+  if (bpm > SIGNAL_MAX_BPM)
+    bpm = SIGNAL_MAX_BPM;
+  return (uint8_t)bpm;
+}
+
+uint8_t identityBattery(const IdentityEntry &entry, uint8_t generatorBattery)
+{
+  return entry.battery == IDENTITY_BATTERY_GENERATOR ? generatorBattery : entry.battery;
+}
+
+uint8_t identityWeight(const IdentityEntry &entry)
+{
+  return entry.weight != 0 ? entry.weight : 1;
+}
+
+bool identityUploadBegin(uint16_t count)
+{
+  if (partition == nullptr || count == 0 || count > IDENTITY_MAX_ENTRIES)
+  {
+    return false;
+  }
+
+  useBuiltin();
+  size_t eraseSize = IDENTITY_HEADER_SIZE + count * sizeof(IdentityEntry);
+  eraseSize = (eraseSize + 0xFFF) & ~(size_t)0xFFF;
+  uploading = esp_partition_erase_range(partition, 0, eraseSize) == ESP_OK;
+  uploadCount = uploading ? count : 0;
+  return uploading;
+}
+
+bool identityUploadWrite(uint16_t start, const uint8_t *records, uint16_t count)
+{
+  if (!uploading || count == 0 || (uint32_t)start + count > uploadCount)
+  {
+    return false;
+  }
+  return esp_partition_write(partition, IDENTITY_HEADER_SIZE + start * sizeof(IdentityEntry),
+                             records, count * sizeof(IdentityEntry)) == ESP_OK;
+}
+
+static bool uploadedCrc(uint32_t &crc)
+{
+  uint8_t chunk[256];
+  crc = 0;
+  size_t total = uploadCount * sizeof(IdentityEntry);
+  for (size_t offset = 0; offset < total; offset += sizeof(chunk))
+  {
+    size_t length = total - offset < sizeof(chunk) ? total - offset : sizeof(chunk);
+    if (esp_partition_read(partition, IDENTITY_HEADER_SIZE + offset, chunk, length) != ESP_OK)
+    {
+      return false;
+    }
+    crc = crc32(chunk, length, crc);
+  }
+  return true;
+}
+
+bool identityUploadCrc(uint32_t &crc)
+{
+  return uploading && uploadedCrc(crc);
+}
+
+bool identityUploadCommit()
+{
+  if (!uploading)
+  {
+    return false;
+  }
+  uploading = false;
+
+  uint32_t crc;
+  if (!uploadedCrc(crc))
+  {
+    return false;
+  }
+
+  IdentityHeader header;
+  memset(&header, 0, sizeof(header));
+  header.magic = IDENTITY_MAGIC;
+  header.version = IDENTITY_VERSION;
+  header.entrySize = sizeof(IdentityEntry);
+  header.count = uploadCount;
+  header.entriesCrc = crc;
+  header.headerCrc = headerCrc(header);
+  if (esp_partition_write(partition, 0, &header, sizeof(header)) != ESP_OK)
+  {
+    return false;
+  }
+  return mapPartition();
+}
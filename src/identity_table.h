@@ -0,0 +1,57 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define IDENTITY_PARTITION_LABEL "identities"
+#define IDENTITY_PARTITION_SUBTYPE 0x40
+#define IDENTITY_PARTITION_SIZE 0x40000
+#define IDENTITY_HEADER_SIZE 32
+#define IDENTITY_MAX_ENTRIES ((IDENTITY_PARTITION_SIZE - IDENTITY_HEADER_SIZE) / 16)
+
+#define IDENTITY_NAME_SUFFIX_MAX 6
+#define IDENTITY_V1_NAME_SUFFIX_MAX 7
+#define IDENTITY_BPM_GENERATOR 0
+#define IDENTITY_BATTERY_GENERATOR 0xFF
+#define IDENTITY_REFERENCE_BPM 60
+
+// One flash record. An empty name suffix, a zero BPM baseline or battery
+// 0xFF leave that field to the profile's base name and the signal
+// generator. Profile indexes deviceProfiles; version 1 tables had a 7-char
+// suffix in its place and always use the default profile. Weight scales
+// how often the identity is scheduled; 0 counts as 1.
+struct __attribute__((packed)) IdentityEntry
+{
+  uint8_t mac[6];
+  char nameSuffix[IDENTITY_NAME_SUFFIX_MAX];
+  uint8_t profile;
+  uint8_t bpmBaseline;
+  uint8_t battery;
+  uint8_t weight;
+};
+
+static_assert(sizeof(IdentityEntry) == 16, "identity records are 16 bytes on flash");
+
+enum IdentitySource
+{
+  IDENTITY_SOURCE_BUILTIN,
+  IDENTITY_SOURCE_PARTITION
+};
+
+void identityTableBegin();
+IdentitySource identitySource();
+uint16_t identityCount();
+uint16_t identityDuplicates();
+bool identityDuplicatesChecked();
+const IdentityEntry &identityAt(uint16_t index);
+
+uint8_t identityProfile(const IdentityEntry &entry);
+void identityName(const IdentityEntry &entry, char *out, size_t outSize);
+uint8_t identityBpm(const IdentityEntry &entry, uint8_t generatorBpm);
+uint8_t identityBattery(const IdentityEntry &entry, uint8_t generatorBattery);
+uint8_t identityWeight(const IdentityEntry &entry);
+
+bool identityUploadBegin(uint16_t count);
+bool identityUploadWrite(uint16_t start, const uint8_t *records, uint16_t count);
+bool identityUploadCrc(uint32_t &crc);
+bool identityUploadCommit();
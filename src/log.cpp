@@ -0,0 +1,115 @@
+#include "log.h"
+
+#include <Arduino.h>
+#include <stdarg.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/ringbuf.h"
+
+static RingbufHandle_t ring = nullptr;
+static TaskHandle_t drainTask = nullptr;
+static volatile uint32_t queuedBytes = 0;
+static volatile uint32_t drainedBytes = 0;
+static volatile uint32_t droppedBytes = 0;
+static portMUX_TYPE countMux = portMUX_INITIALIZER_UNLOCKED;
+
+static void drainLoop(void *arg)
+{
+  (void)arg;
+  uint32_t reportedDrops = 0;
+  for (;;)
+  {
+    size_t length = 0;
+    uint8_t *chunk = (uint8_t *)xRingbufferReceiveUpTo(ring, &length, portMAX_DELAY, LOG_DRAIN_CHUNK);
+    if (chunk == nullptr)
+    {
+      continue;
+    }
+    Serial.write(chunk, length);
+    vRingbufferReturnItem(ring, chunk);
+    drainedBytes += length;
+
+    uint32_t drops = droppedBytes;
+    if (drops != reportedDrops)
+    {
+      Serial.printf("[log] %lu bytes descartados (buffer cheio)\n", (unsigned long)(drops - reportedDrops));
+      reportedDrops = drops;
+    }
+  }
+}
+
+void logBegin()
+{
+  if (ring == nullptr)
+  {
+    ring = xRingbufferCreate(LOG_RING_SIZE, RINGBUF_TYPE_BYTEBUF);
+  }
+}
+
+bool logStartDrain()
+{
+  if (ring == nullptr)
+  {
+    return false;
+  }
+  if (drainTask != nullptr)
+  {
+    return true;
+  }
+  return xTaskCreate(drainLoop, "log_drain", LOG_TASK_STACK, nullptr, LOG_TASK_PRIORITY, &drainTask) == pdPASS;
+}
+
+void logWrite(const char *fmt, ...)
+{
+  char line[LOG_LINE_MAX];
+  va_list args;
+  va_start(args, fmt);
+  int length = vsnprintf(line, sizeof(line), fmt, args);
+  va_end(args);
+  if (length <= 0)
+  {
+    return;
+  }
+  if ((size_t)length >= sizeof(line))
+  {
+    length = sizeof(line) - 1;
+  }
+
+  if (ring == nullptr)
+  {
+    Serial.write((const uint8_t *)line, length);
+    return;
+  }
+
+  bool queued = xRingbufferSend(ring, line, length, 0) == pdTRUE;
+  portENTER_CRITICAL(&countMux);
+  if (queued)
+  {
+    queuedBytes += length;
+  }
+  else
+  {
+    droppedBytes += length;
+  }
+  portEXIT_CRITICAL(&countMux);
+}
+
+// Used before esp_restart(); returns at once when nothing is pending.
+void logFlush(uint32_t timeoutMs)
+{
+  if (drainTask == nullptr)
+  {
+    return;
+  }
+  uint32_t start = millis();
+  while (drainedBytes != queuedBytes && millis() - start < timeoutMs)
+  {
+    vTaskDelay(1);
+  }
+  Serial.flush();
+}
+
+uint32_t logDropped()
+{
+  return droppedBytes;
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <stdint.h>
+
+#define LOG_LEVEL_NONE 0
+#define LOG_LEVEL_ERROR 1
+#define LOG_LEVEL_WARN 2
+#define LOG_LEVEL_INFO 3
+#define LOG_LEVEL_DEBUG 4
+
+// Messages above PHANTOM_LOG_LEVEL are compiled out together with their
+// format strings; build with -DPHANTOM_LOG_LEVEL=4 to get the debug lines.
+#ifndef PHANTOM_LOG_LEVEL
+#define PHANTOM_LOG_LEVEL LOG_LEVEL_INFO
+#endif
+
+#define LOG_RING_SIZE 2048
+#define LOG_LINE_MAX 160
+#define LOG_DRAIN_CHUNK 128
+#define LOG_TASK_STACK 2560
+#define LOG_TASK_PRIORITY 1
+#define LOG_FLUSH_MS 200
+
+#define LOG_AT(level, ...)                \
+  do                                      \
+  {                                       \
+    if ((level) <= PHANTOM_LOG_LEVEL)     \
+    {                                     \
+      logWrite(__VA_ARGS__);              \
+    }                                     \
+  } while (0)
+
+#define LOG_ERROR(...) LOG_AT(LOG_LEVEL_ERROR, __VA_ARGS__)
+#define LOG_WARN(...) LOG_AT(LOG_LEVEL_WARN, __VA_ARGS__)
+#define LOG_INFO(...) LOG_AT(LOG_LEVEL_INFO, __VA_ARGS__)
+#define LOG_DEBUG(...) LOG_AT(LOG_LEVEL_DEBUG, __VA_ARGS__)
+
+// Lines are formatted into a ring buffer and never wait for the UART.
+// Nothing is printed until logStartDrain() starts the low-priority task
+// that copies the ring to Serial; until logBegin() lines go straight out.
+void logBegin();
+bool logStartDrain();
+void logWrite(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+void logFlush(uint32_t timeoutMs);
+uint32_t logDropped();
@@ -0,0 +1,200 @@
+#include "mac_generator.h"
+
+#include <ctype.h>
+#include <stddef.h>
+#include <string.h>
+#include "hal.h"
+
+#define MAC_GENERATOR_MAGIC 0x5046474D
+
+struct MacGeneratorState
+{
+  uint32_t magic;
+  uint32_t seed;
+  uint32_t rng;
+  uint32_t issued;
+  uint32_t rejected;
+  uint32_t checksum;
+  uint8_t bloom[MAC_BLOOM_BITS / 8];
+};
+
+RTC_NOINIT_ATTR static MacGeneratorState generator;
+
+static uint32_t headerChecksum()
+{
+  const uint8_t *bytes = (const uint8_t *)&generator;
+  uint32_t hash = 2166136261UL;
+  for (size_t i = 0; i < offsetof(MacGeneratorState, checksum); i++)
+  {
+    hash ^= bytes[i];
+    hash *= 16777619UL;
+  }
+  return hash;
+}
+
+static void commit()
+{
+  generator.checksum = headerChecksum();
+}
+
+static uint32_t nextWord()
+{
+  if (generator.seed == 0)
+  {
+    return halRandom();
+  }
+  uint32_t x = generator.rng;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  generator.rng = x;
+  return x;
+}
+
+static uint64_t macHash(const uint8_t *mac)
+{
+  uint64_t hash = 14695981039346656037ULL;
+  for (int i = 0; i < 6; i++)
+  {
+    hash ^= mac[i];
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+// Marks the address in the filter; false if every bit was already set,
+// i.e. the address was (probably) issued before.
+static bool bloomInsert(const uint8_t *mac)
+{
+  uint64_t hash = macHash(mac);
+  uint32_t h1 = (uint32_t)hash;
+  uint32_t h2 = (uint32_t)(hash >> 32) | 1;
+  bool fresh = false;
+  for (uint32_t k = 0; k < MAC_BLOOM_HASHES; k++)
+  {
+    uint32_t bit = (h1 + k * h2) % MAC_BLOOM_BITS;
+    uint8_t mask = 1 << (bit & 7);
+    if (!(generator.bloom[bit >> 3] & mask))
+    {
+      generator.bloom[bit >> 3] |= mask;
+      fresh = true;
+    }
+  }
+  return fresh;
+}
+
+void macGeneratorReset(uint32_t seed)
+{
+  memset(&generator, 0, sizeof(generator));
+  generator.magic = MAC_GENERATOR_MAGIC;
+  generator.seed = seed;
+  generator.rng = seed;
+  commit();
+}
+
+void macGeneratorBegin(uint32_t seed)
+{
+  if (generator.magic != MAC_GENERATOR_MAGIC || generator.checksum != headerChecksum() || generator.seed != seed)
+  {
+    macGeneratorReset(seed);
+  }
+}
+
+// Byte 0 is C0 | random | 02: random-static top bits once on air, locally
+// administered and unicast so it is also accepted as the base MAC. Byte 5
+// leaves room for the +2 Bluetooth offset without wrapping.
+void macGeneratorNext(uint8_t *mac)
+{
+  if (generator.issued >= MAC_BLOOM_CAPACITY)
+  {
+    uint32_t rng = generator.rng;
+    uint32_t rejected = generator.rejected;
+    macGeneratorReset(generator.seed);
+    generator.rng = rng;
+    generator.rejected = rejected;
+  }
+
+  for (;;)
+  {
+    uint32_t high = nextWord();
+    uint32_t low = nextWord();
+    mac[0] = 0xC2 | (high & 0x3C);
+    mac[1] = high >> 8;
+    mac[2] = high >> 16;
+    mac[3] = high >> 24;
+    mac[4] = low;
+    mac[5] = low >> 8;
+
+    uint8_t fill = mac[1] | mac[2] | mac[3] | mac[4] | mac[5] | (mac[0] & 0x3C);
+    uint8_t ones = mac[1] & mac[2] & mac[3] & mac[4] & (mac[0] | 0xC3);
+    bool degenerate = fill == 0 || ones == 0xFF;
+    if (!degenerate && mac[5] < 0xFE && bloomInsert(mac))
+    {
+      break;
+    }
+    generator.rejected++;
+  }
+
+  generator.issued++;
+  commit();
+}
+
+bool macGeneratorSeeded()
+{
+  return generator.seed != 0;
+}
+
+uint32_t macGeneratorIssued()
+{
+  return generator.issued;
+}
+
+uint32_t macGeneratorRejected()
+{
+  return generator.rejected;
+}
+
+static int hexValue(char c)
+{
+  if (c >= '0' && c <= '9')
+    return c - '0';
+  if (c >= 'A' && c <= 'F')
+    return c - 'A' + 10;
+  return -1;
+}
+
+bool macParse(const char *text, uint8_t *mac)
+{
+  char compact[17];
+  size_t length = 0;
+  for (; *text != '\0'; text++)
+  {
+    if (isspace((unsigned char)*text))
+    {
+      continue;
+    }
+    if (length == sizeof(compact))
+    {
+      return false;
+    }
+    compact[length++] = toupper((unsigned char)*text);
+  }
+  if (length != sizeof(compact))
+  {
+    return false;
+  }
+
+  uint8_t parsed[6];
+  for (int i = 0; i < 6; i++)
+  {
+    int high = hexValue(compact[i * 3]);
+    int low = hexValue(compact[i * 3 + 1]);
+    if (high < 0 || low < 0 || (i < 5 && compact[i * 3 + 2] != ':'))
+    {
+      return false;
+    }
+    parsed[i] = (uint8_t)(high << 4 | low);
+  }
+  memcpy(mac, parsed, 6);
+  return true;
+}
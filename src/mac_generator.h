@@ -0,0 +1,20 @@
+#pragma once
+
+#include <stdint.h>
+
+#define MAC_BLOOM_BITS 8192
+#define MAC_BLOOM_HASHES 4
+#define MAC_BLOOM_CAPACITY 1024
+
+// seed 0 draws from halRandom(); any other value replays the same
+// xorshift sequence, continuing across restarts through RTC memory.
+void macGeneratorBegin(uint32_t seed);
+void macGeneratorReset(uint32_t seed);
+void macGeneratorNext(uint8_t *mac);
+bool macGeneratorSeeded();
+uint32_t macGeneratorIssued();
+uint32_t macGeneratorRejected();
+
+// "AA:BB:CC:DD:EE:FF" in either case; whitespace anywhere is ignored. mac is
+// only written when the whole text is valid.
+bool macParse(const char *text, uint8_t *mac);
@@ -1,217 +1,151 @@
 #include <Arduino.h>
-#include <BLEDevice.h>
-#include <BLEServer.h>
-#include <BLEUtils.h>
-#include <BLEAdvertising.h>
 #include <EEPROM.h>
-#include "esp_bt_device.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "esp_system.h"
+#include "ble_stack.h"
+#include "multi_adv.h"
+#include "boot_profiler.h"
+#include "rtc_state.h"
+#include "config.h"
+#include "adv_payload.h"
+#include "device_profile.h"
+#include "advertiser.h"
+#include "signal_model.h"
+#include "gatt_server.h"
+#include "console.h"
+#include "identity_table.h"
+#include "scheduler.h"
+#include "mac_generator.h"
+#include "sync_line.h"
+#include "receiver.h"
+#include "sweep.h"
+#include "telemetry.h"
+#include "rotation_timer.h"
+#include "log.h"
+#include "trace_replay.h"
+#include "gatt_transfer.h"
+#include "power.h"
+#include "identity_pipeline.h"
+#include "fleet.h"
 
 #define EEPROM_SIZE 64
-#define EEPROM_ADDR 0
-#define EEPROM_BPM_ADDR 1
-#define EEPROM_DIR_ADDR 2
 #define EEPROM_MODE_ADDR 3
 #define EEPROM_SELECTED_MAC_ADDR 4
 #define EEPROM_USE_CUSTOM_MAC_ADDR 5
 #define EEPROM_CUSTOM_MAC_ADDR 6
 #define EEPROM_MAC_COUNT_ADDR 12
 #define EEPROM_RESTART_INTERVAL_ADDR 16
+#define EEPROM_HOT_ROTATION_ADDR 20
+#define EEPROM_MULTI_ADV_COUNT_ADDR 21
+#define EEPROM_MULTI_ADV_INTERVAL_ADDR 22
+#define EEPROM_FAST_BOOT_ADDR 24
+
+#define BT_MAC_OFFSET 2
 
-#define DEVICE_NAME "HW706-0047980"
 bool autoRestart = true;
 bool staticMode = false;
 int selectedMacIndex = 0;
-unsigned long restartInterval = 250;
-
-unsigned long lastMenuCheck = 0;
-const unsigned long MENU_CHECK_INTERVAL = 100;
+bool multiAdvMode = false;
+
+SensorPayload basePayload;
+SensorPayload *sensorPayload = &basePayload;
+uint8_t activeMac[6];
+const IdentityEntry *activeIdentity = nullptr;
+IdentityScheduler hotScheduler;
+uint16_t schedulerBase = 0;
+uint16_t schedulerWanted = 0;
+uint8_t activeProfile = DEVICE_PROFILE_DEFAULT;
+char activeName[SENSOR_NAME_MAX + 1] = "";
+unsigned long lastSignalUpdate = 0;
+uint32_t rotationCount = 0;
+bool restartPending = false;
+bool fleetWaiting = false;
+volatile uint16_t dwellObservations = 0;
+volatile bool dwellTargetReached = false;
+unsigned long dwellStartedAt = 0;
+
+bool signalLiveUpdates()
+{
+  return config.signalModel != SIGNAL_MODEL_STEPPED && !(autoRestart && !config.hotRotation);
+}
 
-unsigned long bootStartTime = 0;
-unsigned long bootCompleteTime = 0;
-bool bootTimeRecorded = false;
+// Adaptive dwell needs the rotation edge to be this board's alone: a
+// leader's early edge would throw its followers off the grid, a follower
+// rotates on the leader's, and a fleet on the coordinator's. Only a free
+// board, which does not drive the sync line, qualifies.
+bool adaptiveDwellActive()
+{
+  return config.dwellTarget > 0 && autoRestart && !multiAdvMode && config.rotationPhase == ROTATION_PHASE_FREE &&
+         config.fleetRole == FLEET_ROLE_OFF;
+}
 
 uint8_t getNextBPM()
 {
-  uint8_t bpm = EEPROM.read(EEPROM_BPM_ADDR);
-  uint8_t dir = EEPROM.read(EEPROM_DIR_ADDR);
-
-  if (bpm < 60 || bpm > 180)
-    bpm = 60;
-  if (dir > 1)
-    dir = 0;
+  if (!signalLiveUpdates())
+  {
+    signalAdvance(cycleState.signal, config.restartInterval);
+    cycleStateCommit();
+  }
+  return cycleState.signal.bpm;
+}
 
-  if (dir == 0)
+// The identities this board may put on air: its fleet share, or the whole
+// active list. A fleet member without a share owns none.
+bool ownedIdentities(uint16_t &first, uint16_t &count)
+{
+  first = 0;
+  count = config.macCount;
+  if (config.fleetRole == FLEET_ROLE_OFF)
   {
-    bpm++;
-    if (bpm >= 180)
-    {
-      bpm = 180;
-      dir = 1;
-    }
+    return true;
   }
-  else
+  if (!fleetRange(first, count) || first >= config.macCount)
+  {
+    first = 0;
+    count = 0;
+    return false;
+  }
+  if (first + count > config.macCount)
   {
-    bpm--;
-    if (bpm <= 60)
-    {
-      bpm = 60;
-      dir = 0;
-    }
-  }
-
-  EEPROM.write(EEPROM_BPM_ADDR, bpm);
-  EEPROM.write(EEPROM_DIR_ADDR, dir);
-  EEPROM.commit();
-
-  return bpm;
-}
-
-int macCount = 99;
-uint8_t mac_list[99][6] = {
-    {0xC2, 0x52, 0xF5, 0xC7, 0xD6, 0xFE},
-    {0xD2, 0x4F, 0x3A, 0x77, 0x22, 0x10},
-    {0xE2, 0x91, 0xAB, 0x12, 0x34, 0x54},
-    {0xC6, 0x34, 0xA7, 0x89, 0x10, 0x20},
-    {0xD6, 0x89, 0xB1, 0x43, 0x21, 0x8E},
-    {0xE6, 0x11, 0x44, 0x66, 0x99, 0xA8},
-    {0xC4, 0x12, 0x88, 0x55, 0x44, 0x64},
-    {0xD4, 0xDE, 0xAD, 0xBE, 0xEF, 0xFE},
-    {0xE4, 0x00, 0x11, 0x22, 0x33, 0x42},
-    {0xC8, 0xA1, 0xB2, 0xC3, 0xD4, 0xE2},
-    {0xD8, 0x55, 0x66, 0x77, 0x88, 0x96},
-    {0xE8, 0x99, 0x88, 0x77, 0x66, 0x52},
-    {0xCA, 0xBC, 0xDE, 0xF0, 0x12, 0x32},
-    {0xDA, 0x45, 0x67, 0x89, 0xAB, 0xCA},
-    {0xEA, 0x11, 0x22, 0x33, 0x44, 0x52},
-    {0xCC, 0x9F, 0x8E, 0x7D, 0x6C, 0x58},
-    {0xDC, 0x4A, 0x3B, 0x2C, 0x1D, 0x0C},
-    {0xEC, 0xFE, 0xDC, 0xBA, 0x98, 0x74},
-    {0xCE, 0x01, 0x23, 0x45, 0x67, 0x86},
-    {0xF6, 0x5D, 0x5E, 0x5F, 0x60, 0x60},
-    {0xCA, 0x61, 0x62, 0x63, 0x64, 0x64},
-    {0xD2, 0x13, 0x24, 0x35, 0x46, 0x54},
-    {0xE2, 0xF1, 0xE2, 0xD3, 0xC4, 0xB2},
-    {0xC2, 0x11, 0x33, 0x55, 0x77, 0x96},
-    {0xF2, 0x10, 0x20, 0x30, 0x40, 0x4E},
-    {0xF6, 0x01, 0x02, 0x03, 0x04, 0x02},
-    {0xF6, 0xAB, 0xCD, 0xEF, 0x12, 0x32},
-    {0xF8, 0x55, 0xAA, 0x55, 0xAA, 0x52},
-    {0xFA, 0x99, 0x00, 0x99, 0x00, 0x96},
-    {0xFC, 0xDE, 0xAD, 0xFA, 0xCE, 0xFE},
-    {0xFE, 0xCA, 0xFE, 0xBA, 0xBE, 0xFE},
-    {0xC2, 0x11, 0x22, 0x33, 0x44, 0x52},
-    {0xD2, 0x66, 0x77, 0x88, 0x99, 0xA8},
-    {0xE2, 0x10, 0x32, 0x54, 0x76, 0x96},
-    {0xC6, 0x89, 0x67, 0x45, 0x23, 0xFE},
-    {0xD6, 0x0F, 0x1E, 0x2D, 0x3C, 0x48},
-    {0xE6, 0x12, 0x34, 0x56, 0x78, 0x8E},
-    {0xC4, 0x55, 0x44, 0x33, 0x22, 0x0E},
-    {0xD4, 0xF0, 0xF1, 0xF2, 0xF3, 0xF2},
-    {0xE4, 0x04, 0x03, 0x02, 0x01, 0xFE},
-    {0xC8, 0x0A, 0x0B, 0x0C, 0x0D, 0x0C},
-    {0xD8, 0xAA, 0xBB, 0xCC, 0xDD, 0xEC},
-    {0xE8, 0x1A, 0x2B, 0x3C, 0x4D, 0x5C},
-    {0xCA, 0xFE, 0xED, 0xBE, 0xEF, 0xFE},
-    {0xDA, 0x99, 0x88, 0x77, 0x66, 0x52},
-    {0xEA, 0x22, 0x44, 0x66, 0x88, 0xA8},
-    {0xCC, 0x77, 0x66, 0x55, 0x44, 0x30},
-    {0xDC, 0xAB, 0xCD, 0xEF, 0x01, 0x20},
-    {0xEC, 0xBA, 0xDC, 0xFE, 0x10, 0x30},
-    {0xCE, 0x01, 0x10, 0x01, 0x10, 0xFE},
-    {0xDE, 0x42, 0x24, 0x42, 0x24, 0x40},
-    {0xEE, 0x69, 0x96, 0x69, 0x96, 0x66},
-    {0xC2, 0x0F, 0x0E, 0x0D, 0x0C, 0x08},
-    {0xD2, 0xFF, 0xEE, 0xDD, 0xCC, 0xB8},
-    {0xE2, 0x1B, 0x2C, 0x3D, 0x4E, 0x5C},
-    {0xF2, 0xBE, 0xEF, 0xBE, 0xEF, 0xBC},
-    {0xC2, 0x88, 0x99, 0xAA, 0xBB, 0xCA},
-    {0xD2, 0x33, 0x44, 0x55, 0x66, 0x76},
-    {0xE2, 0x77, 0x88, 0x99, 0xAA, 0xBA},
-    {0xF2, 0x11, 0x22, 0x33, 0x44, 0x54},
-    {0xC2, 0xAA, 0xBB, 0xCC, 0xDD, 0xEC},
-    {0xD2, 0x12, 0x34, 0x56, 0x78, 0x98},
-    {0xE2, 0xAB, 0xCD, 0xEF, 0x01, 0x20},
-    {0xF2, 0x99, 0x88, 0x77, 0x66, 0x52},
-    {0xC6, 0x11, 0x22, 0x33, 0x44, 0x54},
-    {0xD6, 0xAA, 0xBB, 0xCC, 0xDD, 0xEC},
-    {0xE6, 0x12, 0x34, 0x56, 0x78, 0x98},
-    {0xF6, 0x99, 0x88, 0x77, 0x66, 0x52},
-    {0xCA, 0x11, 0x22, 0x33, 0x44, 0x54},
-    {0xDA, 0xAA, 0xBB, 0xCC, 0xDD, 0xEC},
-    {0xEA, 0x12, 0x34, 0x56, 0x78, 0x98},
-    {0xFA, 0x99, 0x88, 0x77, 0x66, 0x52},
-    {0xCE, 0x11, 0x22, 0x33, 0x44, 0x54},
-    {0xDE, 0xAA, 0xBB, 0xCC, 0xDD, 0xEC},
-    {0xEE, 0x12, 0x34, 0x56, 0x78, 0x98},
-    {0xFE, 0x99, 0x88, 0x77, 0x66, 0x52},
-    {0xC2, 0x01, 0x02, 0x03, 0x04, 0x04},
-    {0xD2, 0x05, 0x06, 0x07, 0x08, 0x08},
-    {0xE2, 0x09, 0x0A, 0x0B, 0x0C, 0x0C},
-    {0xF2, 0x0D, 0x0E, 0x0F, 0x10, 0x10},
-    {0xC4, 0x11, 0x12, 0x13, 0x14, 0x14},
-    {0xD4, 0x15, 0x16, 0x17, 0x18, 0x18},
-    {0xE4, 0x19, 0x1A, 0x1B, 0x1C, 0x1C},
-    {0xF4, 0x1D, 0x1E, 0x1F, 0x20, 0x20},
-    {0xC8, 0x21, 0x22, 0x23, 0x24, 0x24},
-    {0xD8, 0x25, 0x26, 0x27, 0x28, 0x28},
-    {0xE8, 0x29, 0x2A, 0x2B, 0x2C, 0x2C},
-    {0xF8, 0x2D, 0x2E, 0x2F, 0x30, 0x30},
-    {0xCC, 0x31, 0x32, 0x33, 0x34, 0x34},
-    {0xDC, 0x35, 0x36, 0x37, 0x38, 0x38},
-    {0xEC, 0x39, 0x3A, 0x3B, 0x3C, 0x3C},
-    {0xFC, 0x3D, 0x3E, 0x3F, 0x40, 0x40},
-    {0xC2, 0x41, 0x42, 0x43, 0x44, 0x44},
-    {0xD2, 0x45, 0x46, 0x47, 0x48, 0x48},
-    {0xE2, 0x49, 0x4A, 0x4B, 0x4C, 0x4C},
-    {0xF2, 0x4D, 0x4E, 0x4F, 0x50, 0x50},
-    {0xC6, 0x51, 0x52, 0x53, 0x54, 0x54},
-    {0xD6, 0x55, 0x56, 0x57, 0x58, 0x58},
-    {0xE6, 0x59, 0x5A, 0x5B, 0x5C, 0x5C}};
+    count = config.macCount - first;
+  }
+  return true;
+}
 
 int getNextMacIndex()
 {
-  int idx = EEPROM.read(EEPROM_ADDR);
+  int idx = cycleState.macIndex;
+  uint16_t first, count;
+  if (!ownedIdentities(first, count))
+  {
+    return idx < config.macCount ? idx : 0;
+  }
 
-  if (idx >= macCount)
+  if (idx < first || idx >= first + count)
   {
-    idx = 0;
+    idx = first;
   }
 
-  idx = (idx + 1) % macCount;
-  EEPROM.write(EEPROM_ADDR, idx);
-  EEPROM.commit();
+  if (cycleState.dwellLeft > 1)
+  {
+    cycleState.dwellLeft--;
+  }
+  else
+  {
+    idx = first + (idx - first + 1) % count;
+    cycleState.dwellLeft = identityWeight(identityAt(idx));
+  }
+  cycleState.macIndex = idx;
+  cycleStateCommit();
 
-  Serial.printf("DEBUG: Próximo MAC index: %d (macCount: %d)\n", idx, macCount);
+  LOG_DEBUG("Próximo MAC index: %d (macCount: %d)\n", idx, config.macCount);
   return idx;
 }
 
-uint8_t customMac[6] = {0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
-
 bool useCustomMac = false;
 bool useRandomMac = false;
 
-void generateRandomMac(uint8_t *mac)
-{
-  mac[0] = (random(0, 64) << 2) | 0x02;
-
-  while (mac[0] == 0x00 || mac[0] == 0xFF || (mac[0] & 0x01) == 1)
-  {
-    mac[0] = (random(0, 64) << 2) | 0x02;
-  }
-
-  for (int i = 1; i < 6; i++)
-  {
-    mac[i] = random(0, 256);
-    while (mac[i] == 0xFF && i < 5)
-    {
-      mac[i] = random(0, 256);
-    }
-  }
-}
-
 void showMenu()
 {
 
@@ -224,61 +158,64 @@ void showMenu()
   Serial.println("5 - Digitar MAC customizado");
   Serial.println("6 - Listar MACs funcionais");
   Serial.println("7 - Mostrar status atual");
-  Serial.println("8 - Definir quantidade de MACs da lista (1-99)");
-  Serial.println("9 - Definir intervalo de restart (270-30000ms)");
+  Serial.printf("8 - Definir quantidade de MACs da lista (1-%d)\n", identityCount());
+  Serial.println("9 - Definir intervalo de restart (20-30000ms)");
   Serial.println("10 - Reiniciar dispositivo");
+  Serial.println("11 - Alternar rotação a quente (sem reiniciar)");
+  Serial.println("12 - Modo multi-sensor (BLE 5, vários sensores simultâneos)");
+  Serial.println("13 - Alternar boot rápido nos modos automáticos");
+  Serial.println("14 - Modelo de sinal de BPM/bateria");
+  Serial.printf("15 - Taxa de notificação GATT (%d-%d Hz)\n", GATT_MIN_NOTIFY_HZ, GATT_MAX_NOTIFY_HZ);
+  Serial.println("16 - Semente dos MACs randômicos (0 = hardware)");
+  Serial.printf("17 - Executar varredura de parâmetros (%d passos de %lu s)\n", (int)SWEEP_STEP_COUNT,
+                SWEEP_STEP_MS / 1000);
+  Serial.printf("18 - Sincronismo de rotação (atual: %s)\n", rotationPhaseName(config.rotationPhase));
+  Serial.printf("19 - Conexões GATT simultâneas e parâmetros de conexão (até %d)\n", BLE_MAX_CONNECTIONS);
+  Serial.printf("20 - Reproduzir trace gravado (%lu registros)\n", (unsigned long)traceRecordCount());
+  Serial.println("21 - Perfil de energia e consumo estimado por modo");
+  Serial.printf("22 - Frota ESP-NOW (atual: %s)\n", fleetRoleName(config.fleetRole));
+  Serial.println("23 - Dwell adaptativo (troca antecipada após scan requests/conexões)");
+  Serial.println("T - Telemetria (também durante os modos automáticos)");
   Serial.println("----------------------------------------------");
-  Serial.printf("MACs ativos: %d/99\n", macCount);
-  Serial.printf("Intervalo de restart: %lu ms\n", restartInterval);
+  Serial.printf("MACs ativos: %d/%d%s\n", config.macCount, identityCount(),
+                identityDuplicatesChecked() ? "" : " (duplicadas não verificadas)");
+  Serial.printf("Intervalo de restart: %lu ms\n", (unsigned long)config.restartInterval);
+  Serial.printf("Rotação a quente: %s\n", config.hotRotation ? "ativada" : "desativada");
+  Serial.printf("Modelo de sinal: %s (%d Hz)\n", signalModelName(config.signalModel), config.signalRateHz);
   Serial.print("\nEscolha uma opção: ");
 }
 
-bool parseCustomMac(String macStr, uint8_t *macArray)
+void listMacs()
 {
-  macStr.trim();
-  macStr.toUpperCase();
-
-  macStr.replace(" ", "");
-
-  if (macStr.length() != 17)
+  Serial.println("\n=== LISTA DE MACs DISPONÍVEIS ===");
+  Serial.printf("Origem: %s | %d identidades", identitySource() == IDENTITY_SOURCE_PARTITION ? "partição" : "lista interna",
+                identityCount());
+  if (identityDuplicates() > 0)
   {
-    return false;
+    Serial.printf(" (%d duplicadas ignoradas)", identityDuplicates());
   }
-
-  if (macStr.charAt(2) != ':' || macStr.charAt(5) != ':' ||
-      macStr.charAt(8) != ':' || macStr.charAt(11) != ':' ||
-      macStr.charAt(14) != ':')
+  if (!identityDuplicatesChecked())
   {
-    return false;
+    Serial.print(" (duplicadas não verificadas: sem memória)");
   }
-
-  for (int i = 0; i < 6; i++)
+  Serial.println();
+  for (int i = 0; i < config.macCount; i++)
   {
-    String byteStr = macStr.substring(i * 3, i * 3 + 2);
-
-    for (int j = 0; j < 2; j++)
+    const IdentityEntry &entry = identityAt(i);
+    char name[SENSOR_NAME_MAX + 1];
+    identityName(entry, name, sizeof(name));
+    Serial.printf("%02d: %02X:%02X:%02X:%02X:%02X:%02X | %s", i,
+                  entry.mac[0], entry.mac[1], entry.mac[2],
+                  entry.mac[3], entry.mac[4], entry.mac[5], name);
+    if (entry.bpmBaseline != IDENTITY_BPM_GENERATOR)
     {
-      char c = byteStr.charAt(j);
-      if (!((c >= '0' && c <= '9') || (c >= 'A' && c <= 'F')))
-      {
-        return false;
-      }
+      Serial.printf(" | BPM base %d", entry.bpmBaseline);
     }
-
-    macArray[i] = (uint8_t)strtol(byteStr.c_str(), NULL, 16);
-  }
-
-  return true;
-}
-
-void listMacs()
-{
-  Serial.println("\n=== LISTA DE MACs DISPONÍVEIS ===");
-  for (int i = 0; i < macCount; i++)
-  {
-    Serial.printf("%02d: %02X:%02X:%02X:%02X:%02X:%02X\n", i,
-                  mac_list[i][0], mac_list[i][1], mac_list[i][2],
-                  mac_list[i][3], mac_list[i][4], mac_list[i][5]);
+    if (entry.battery != IDENTITY_BATTERY_GENERATOR)
+    {
+      Serial.printf(" | Bateria %d%%", entry.battery);
+    }
+    Serial.println();
   }
   Serial.println("===============================");
 }
@@ -287,13 +224,19 @@ void showStatus()
 {
   Serial.println("\n=== STATUS ATUAL ===");
 
-  if (bootTimeRecorded)
+  if (bootProfileComplete())
   {
-    unsigned long totalBootTime = bootCompleteTime - bootStartTime;
-    Serial.printf("Último tempo de boot: %lu ms\n", totalBootTime);
+    Serial.printf("Último tempo de boot: %lu ms\n", (unsigned long)(bootTimeToAdvertising() / 1000));
+    Serial.printf("Boot rápido: %s\n", config.fastBoot ? "ativado" : "desativado");
+    bootProfilerPrint();
   }
 
-  if (autoRestart)
+  if (multiAdvMode)
+  {
+    Serial.println("Modo: Multi-sensor (advertising estendido)");
+    multiAdvPrintStatus();
+  }
+  else if (autoRestart)
   {
     if (useRandomMac)
     {
@@ -303,7 +246,40 @@ void showStatus()
     {
       Serial.println("Modo: Automático com Lista Pré-definida");
     }
-    Serial.printf("Intervalo de restart: %lu ms\n", restartInterval);
+    Serial.printf("Intervalo de restart: %lu ms\n", (unsigned long)config.restartInterval);
+    Serial.printf("Rotação a quente: %s\n", config.hotRotation ? "ativada" : "desativada");
+    Serial.printf("Sincronismo de rotação: %s\n", rotationPhaseName(config.rotationPhase));
+    if (hotScheduler.active() && hotScheduler.count() < schedulerWanted)
+    {
+      Serial.printf("Escalonador: %d de %d identidades (limite %d), as demais fora da rotação a quente\n",
+                    hotScheduler.count(), schedulerWanted, SCHEDULER_MAX_IDENTITIES);
+    }
+    if (config.hotRotation)
+    {
+      Serial.printf("Prazos perdidos: %lu", (unsigned long)rotationTimerMissed());
+      if (config.rotationPhase == ROTATION_PHASE_FOLLOWER)
+      {
+        Serial.printf(" | erro de fase: %ld us", (long)rotationTimerPhaseError());
+      }
+      Serial.println();
+    }
+    if (telemetry.jitterSamples > 0)
+    {
+      Serial.printf("Jitter de rotação: min %ld us, médio %lu us, max %ld us\n", (long)telemetry.jitterMinUs,
+                    (unsigned long)(telemetry.jitterAbsSumUs / telemetry.jitterSamples), (long)telemetry.jitterMaxUs);
+    }
+    if (adaptiveDwellActive())
+    {
+      Serial.printf("Dwell adaptativo: %d observações, mínimo %u ms | %lu scan requests, %lu rotações antecipadas\n",
+                    config.dwellTarget, config.minDwellMs, (unsigned long)telemetry.counters[TELEMETRY_SCAN_REQUESTS],
+                    (unsigned long)telemetry.counters[TELEMETRY_EARLY_ROTATIONS]);
+    }
+    if (pipelineActive())
+    {
+      Serial.printf("Pipeline (núcleo %d): preparo %lu us, pico %lu us | %lu trocas sem identidade pronta\n",
+                    PIPELINE_CORE, (unsigned long)pipelineLastPrepareUs(), (unsigned long)pipelineMaxPrepareUs(),
+                    (unsigned long)pipelineMisses());
+    }
   }
   else
   {
@@ -314,13 +290,16 @@ void showStatus()
   {
     Serial.println("Tipo MAC: Customizado");
     Serial.printf("MAC Atual: %02X:%02X:%02X:%02X:%02X:%02X\n",
-                  customMac[0], customMac[1], customMac[2],
-                  customMac[3], customMac[4], customMac[5]);
+                  config.customMac[0], config.customMac[1], config.customMac[2],
+                  config.customMac[3], config.customMac[4], config.customMac[5]);
   }
   else if (useRandomMac && autoRestart)
   {
     Serial.println("Tipo MAC: Randômico");
-    const uint8_t *currentMac = esp_bt_dev_get_address();
+    Serial.printf("Gerador: %s | %lu emitidos, %lu repetições descartadas\n",
+                  macGeneratorSeeded() ? "semente fixa" : "hardware",
+                  (unsigned long)macGeneratorIssued(), (unsigned long)macGeneratorRejected());
+    const uint8_t *currentMac = config.hotRotation ? activeMac : bleStackAddress();
     Serial.printf("MAC Atual: %02X:%02X:%02X:%02X:%02X:%02X\n",
                   currentMac[0], currentMac[1], currentMac[2],
                   currentMac[3], currentMac[4], currentMac[5]);
@@ -329,326 +308,1807 @@ void showStatus()
   {
     Serial.println("Tipo MAC: Da Lista");
     Serial.printf("MAC Index Atual: %d\n", selectedMacIndex);
+    const uint8_t *mac = identityAt(selectedMacIndex).mac;
     Serial.printf("MAC Atual: %02X:%02X:%02X:%02X:%02X:%02X\n",
-                  mac_list[selectedMacIndex][0], mac_list[selectedMacIndex][1], mac_list[selectedMacIndex][2],
-                  mac_list[selectedMacIndex][3], mac_list[selectedMacIndex][4], mac_list[selectedMacIndex][5]);
+                  mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+    Serial.printf("Nome anunciado: %s | perfil %d de %d\n", activeName, activeProfile, (int)DEVICE_PROFILE_COUNT);
+  }
+
+  Serial.printf("Modelo de sinal: %s | BPM %d | Bateria %d%%\n", signalModelName(config.signalModel),
+                cycleState.signal.bpm, cycleState.signal.battery);
+  if (config.signalModel != SIGNAL_MODEL_STEPPED)
+  {
+    Serial.printf("Atualização do advertising: %d Hz\n", config.signalRateHz);
   }
 
+  gattPrintStatus();
+  if (traceActive())
+  {
+    Serial.printf("Trace: registro %lu/%lu a %dx | %lu atrasos de leitura\n", (unsigned long)tracePosition() + 1,
+                  (unsigned long)traceRecordCount(), traceSpeed(), (unsigned long)traceUnderruns());
+  }
+  Serial.printf("Conexões: %d/%d | intervalo %u ms, latência %u, timeout %u ms, MTU %u\n", bleStackConnections(),
+                config.maxConnections, config.connIntervalMs, config.connLatency, config.connTimeoutMs, config.mtu);
+  fleetPrintStatus();
+  Serial.printf("Energia: perfil %s, light sleep %s, deep sleep entre ciclos %u ms | estimado %.1f mA\n",
+                powerProfileName(config.powerProfile), powerLightSleepActive() ? "ativo" : "inativo", config.sleepGapMs,
+                powerEstimateUa(config.mode, config, bootTimeToAdvertising() / 1000) / 1000.0);
+
   unsigned long uptime = millis();
   Serial.printf("Tempo ativo: %lu ms (%.2f segundos)\n", uptime, uptime / 1000.0);
 
   Serial.println("==================");
 }
 
-void processMenuCommand()
+bool applySignalModel(int model, int rateHz)
 {
-  if (Serial.available())
+  if (model < 0 || model >= SIGNAL_MODEL_COUNT || rateHz < SIGNAL_MIN_RATE_HZ || rateHz > SIGNAL_MAX_RATE_HZ)
   {
-    String input = Serial.readStringUntil('\n');
-    input.trim();
-    int choice = input.toInt();
+    return false;
+  }
+  config.signalModel = model;
+  config.signalRateHz = rateHz;
+  configSave();
+  signalInit(cycleState.signal, config.signalModel, cycleState.signal.bpm, cycleState.signal.battery, esp_random());
+  cycleStateCommit();
+  lastSignalUpdate = millis();
+  return true;
+}
 
-    switch (choice)
-    {
-    case 1:
-      autoRestart = true;
-      staticMode = false;
-      useCustomMac = false;
-      useRandomMac = false;
-      EEPROM.write(EEPROM_MODE_ADDR, 0);
-      EEPROM.write(EEPROM_USE_CUSTOM_MAC_ADDR, 0);
-      EEPROM.commit();
-      Serial.println("Modo automático com lista pré-definida ativado! Reiniciando...");
-      delay(restartInterval);
-      esp_restart();
-      break;
+bool applyNotifyRate(int rateHz)
+{
+  if (rateHz < GATT_MIN_NOTIFY_HZ || rateHz > GATT_MAX_NOTIFY_HZ)
+  {
+    return false;
+  }
+  config.notifyRateHz = rateHz;
+  configSave();
+  gattSetRate(config.notifyRateHz);
+  gattResetStats();
+  return true;
+}
 
-    case 2:
-      autoRestart = true;
-      staticMode = false;
-      useCustomMac = false;
-      useRandomMac = true;
-      EEPROM.write(EEPROM_MODE_ADDR, 2);
-      EEPROM.write(EEPROM_USE_CUSTOM_MAC_ADDR, 0);
-      EEPROM.commit();
-      Serial.println("Modo automático com MAC randômico ativado! Reiniciando...");
-      delay(1000);
-      esp_restart();
-      break;
+BleConnParams connParamsFromConfig()
+{
+  BleConnParams params = {config.connIntervalMs, config.connLatency, config.connTimeoutMs, config.mtu};
+  return params;
+}
 
-    case 3:
-      autoRestart = false;
-      staticMode = true;
-      useRandomMac = false;
-      EEPROM.write(EEPROM_MODE_ADDR, 1);
-      EEPROM.commit();
-      Serial.println("Modo estático ativado! Dispositivo não irá mais reiniciar automaticamente.");
-      showMenu();
-      break;
+bool applyConnParams(int maxConnections, int intervalMs, int latency, int timeoutMs, int mtu)
+{
+  DeviceConfig candidate = config;
+  candidate.connIntervalMs = intervalMs;
+  candidate.connLatency = latency;
+  candidate.connTimeoutMs = timeoutMs;
+  candidate.mtu = mtu;
+  if (maxConnections < 1 || maxConnections > BLE_MAX_CONNECTIONS || intervalMs < 0 || intervalMs > 0xFFFF ||
+      latency < 0 || latency > 0xFFFF || timeoutMs < 0 || timeoutMs > 0xFFFF || mtu < 0 || mtu > 0xFFFF ||
+      !configConnParamsValid(candidate))
+  {
+    return false;
+  }
+  candidate.maxConnections = maxConnections;
+  config = candidate;
+  bleStackSetConnParams(connParamsFromConfig());
+  if (!multiAdvMode)
+  {
+    advertiserSetConnectable(bleStackConnections() < config.maxConnections);
+  }
+  return configSave();
+}
 
-    case 4:
-    {
-      Serial.print("\n Digite o índice do MAC da lista (0-98): ");
-      while (!Serial.available())
-      {
-        delay(10);
-      }
-      input = Serial.readStringUntil('\n');
-      input.trim();
-      int macIndex = input.toInt();
-      if (macIndex >= 0 && macIndex < macCount)
-      {
-        selectedMacIndex = macIndex;
-        useCustomMac = false;
-        useRandomMac = false;
-
-        EEPROM.write(EEPROM_SELECTED_MAC_ADDR, selectedMacIndex);
-        EEPROM.write(EEPROM_USE_CUSTOM_MAC_ADDR, 0);
-        EEPROM.write(EEPROM_MODE_ADDR, 1);
-        EEPROM.commit();
-
-        Serial.printf("MAC %d selecionado: %02X:%02X:%02X:%02X:%02X:%02X\n", macIndex,
-                      mac_list[macIndex][0], mac_list[macIndex][1], mac_list[macIndex][2],
-                      mac_list[macIndex][3], mac_list[macIndex][4], mac_list[macIndex][5]);
-        Serial.println("Reiniciando para aplicar o novo MAC...");
-        delay(1000);
-        esp_restart();
-      }
-      else
-      {
-        Serial.println("Índice inválido! Use valores entre 0 e 98.");
-      }
-      showMenu();
-      break;
-    }
+bool applyTracePlayback(uint8_t speed, bool repeat)
+{
+  if (speed == 0)
+  {
+    traceStop();
+    return true;
+  }
+  if (!staticMode)
+  {
+    return false;
+  }
+  return traceStart(speed, repeat, millis());
+}
 
-    case 5:
-    {
-      Serial.println("Digite o MAC no formato AA:BB:CC:DD:EE:FF");
-      Serial.print("MAC customizado: ");
-      while (!Serial.available())
-      {
-        delay(10);
-      }
-      input = Serial.readStringUntil('\n');
+bool applyMacSeed(uint32_t seed)
+{
+  config.macSeed = seed;
+  macGeneratorReset(config.macSeed);
+  return configSave();
+}
 
-      if (parseCustomMac(input, customMac))
-      {
-        useCustomMac = true;
-        staticMode = true;
-        autoRestart = false;
-        useRandomMac = false;
-
-        EEPROM.write(EEPROM_MODE_ADDR, 1);
-        EEPROM.write(EEPROM_USE_CUSTOM_MAC_ADDR, 1);
-        for (int i = 0; i < 6; i++)
-        {
-          EEPROM.write(EEPROM_CUSTOM_MAC_ADDR + i, customMac[i]);
-        }
-        EEPROM.commit();
-
-        Serial.printf("MAC customizado válido: %02X:%02X:%02X:%02X:%02X:%02X\n",
-                      customMac[0], customMac[1], customMac[2],
-                      customMac[3], customMac[4], customMac[5]);
-        Serial.println("Reiniciando para aplicar o MAC customizado...");
-        delay(1000);
-        esp_restart();
-      }
-      else
-      {
-        Serial.println("Formato de MAC inválido! Use o formato AA:BB:CC:DD:EE:FF");
-        Serial.println("Exemplo: C2:52:F5:C7:D6:00");
-      }
-      showMenu();
-      break;
-    }
+enum MenuState
+{
+  MENU_IDLE,
+  MENU_AWAIT_MAC_INDEX,
+  MENU_AWAIT_CUSTOM_MAC,
+  MENU_AWAIT_MAC_COUNT,
+  MENU_AWAIT_RESTART_INTERVAL,
+  MENU_AWAIT_MULTI_COUNT,
+  MENU_AWAIT_MULTI_INTERVAL,
+  MENU_AWAIT_SIGNAL_MODEL,
+  MENU_AWAIT_SIGNAL_RATE,
+  MENU_AWAIT_NOTIFY_RATE,
+  MENU_AWAIT_MAC_SEED,
+  MENU_AWAIT_ROTATION_PHASE,
+  MENU_AWAIT_CONN_PARAMS,
+  MENU_AWAIT_TRACE_SPEED,
+  MENU_AWAIT_POWER_PROFILE,
+  MENU_AWAIT_FLEET_ROLE,
+  MENU_AWAIT_ADAPTIVE_DWELL
+};
 
-    case 6:
-      listMacs();
-      showMenu();
-      break;
+MenuState menuState = MENU_IDLE;
+int menuPendingValue = 0;
 
-    case 7:
-      showStatus();
-      showMenu();
-      break;
+void handleMenuChoice(int choice)
+{
+  switch (choice)
+  {
+  case 1:
+    autoRestart = true;
+    staticMode = false;
+    useCustomMac = false;
+    useRandomMac = false;
+    config.mode = MODE_AUTO_LIST;
+    config.useCustomMac = 0;
+    configSave();
+    Serial.println("Modo automático com lista pré-definida ativado! Reiniciando...");
+    delay(config.restartInterval);
+    esp_restart();
+    break;
 
-    case 8:
-    {
-      Serial.printf("\nQuantidade atual de MACs: %d\n", macCount);
-      Serial.print("Digite a nova quantidade (1-99): ");
-      while (!Serial.available())
-      {
-        delay(10);
-      }
-      input = Serial.readStringUntil('\n');
-      input.trim();
-      int newCount = input.toInt();
+  case 2:
+    autoRestart = true;
+    staticMode = false;
+    useCustomMac = false;
+    useRandomMac = true;
+    config.mode = MODE_AUTO_RANDOM;
+    config.useCustomMac = 0;
+    configSave();
+    Serial.println("Modo automático com MAC randômico ativado! Reiniciando...");
+    delay(1000);
+    esp_restart();
+    break;
 
-      if (newCount >= 1 && newCount <= 99)
-      {
-        macCount = newCount;
-        EEPROM.write(EEPROM_MAC_COUNT_ADDR, macCount);
-        EEPROM.commit();
+  case 3:
+    autoRestart = false;
+    staticMode = true;
+    useRandomMac = false;
+    config.mode = MODE_STATIC;
+    configSave();
+    Serial.println("Modo estático ativado! Dispositivo não irá mais reiniciar automaticamente.");
+    showMenu();
+    break;
 
-        Serial.printf("Quantidade de MACs definida para: %d\n", macCount);
-        Serial.println("Agora o sistema usará apenas os primeiros " + String(macCount) + " MACs da lista.");
+  case 4:
+    Serial.printf("\n Digite o índice do MAC da lista (0-%d): ", config.macCount - 1);
+    menuState = MENU_AWAIT_MAC_INDEX;
+    break;
 
-        if (selectedMacIndex >= macCount)
-        {
-          selectedMacIndex = 0;
-          EEPROM.write(EEPROM_SELECTED_MAC_ADDR, selectedMacIndex);
-          EEPROM.commit();
-          Serial.println("MAC selecionado resetado para índice 0 (fora do novo range).");
-        }
-      }
-      else
-      {
-        Serial.println("Valor inválido! Use valores entre 1 e 99.");
-      }
-      showMenu();
-      break;
-    }
+  case 5:
+    Serial.println("Digite o MAC no formato AA:BB:CC:DD:EE:FF");
+    Serial.print("MAC customizado: ");
+    menuState = MENU_AWAIT_CUSTOM_MAC;
+    break;
 
-    case 9:
+  case 6:
+    listMacs();
+    showMenu();
+    break;
+
+  case 7:
+    showStatus();
+    showMenu();
+    break;
+
+  case 8:
+    Serial.printf("\nQuantidade atual de MACs: %d\n", config.macCount);
+    Serial.printf("Digite a nova quantidade (1-%d): ", identityCount());
+    menuState = MENU_AWAIT_MAC_COUNT;
+    break;
+
+  case 9:
+    Serial.printf("\nIntervalo atual de restart: %lu ms\n", (unsigned long)config.restartInterval);
+    Serial.print("Digite o novo intervalo em ms: ");
+    menuState = MENU_AWAIT_RESTART_INTERVAL;
+    break;
+
+  case 10:
+    Serial.println("Reiniciando dispositivo...");
+    delay(1000);
+    esp_restart();
+    break;
+
+  case 11:
+    config.hotRotation = !config.hotRotation;
+    configSave();
+    if (config.hotRotation)
     {
-      Serial.printf("\nIntervalo atual de restart: %lu ms\n", restartInterval);
-      Serial.print("Digite o novo intervalo em ms: ");
-      while (!Serial.available())
-      {
-        delay(10);
-      }
-      input = Serial.readStringUntil('\n');
-      input.trim();
-      unsigned long newInterval = input.toInt();
+      Serial.println("Rotação a quente ativada! Os modos automáticos trocarão de identidade sem reiniciar.");
+    }
+    else
+    {
+      Serial.println("Rotação a quente desativada! Os modos automáticos voltarão a reiniciar a cada troca.");
+    }
+    showMenu();
+    break;
 
-      if (newInterval >= 1 && newInterval <= 30000)
-      {
-        restartInterval = newInterval;
-        EEPROM.put(EEPROM_RESTART_INTERVAL_ADDR, restartInterval);
-        EEPROM.commit();
-        Serial.printf("Intervalo de restart definido para: %lu ms\n", restartInterval);
-        Serial.println("Esta configuração foi salva e será aplicada no próximo modo automático.");
-      }
-      else
-      {
-        Serial.println("Valor inválido! Respeite o intervalo de tempo mínimo e máximo.");
-      }
+  case 12:
+    if (!multiAdvSupported())
+    {
+      Serial.println("Este chip não suporta advertising estendido (requer ESP32-C3/S3 com BLE 5).");
       showMenu();
       break;
     }
+    Serial.printf("\nQuantidade de sensores simultâneos (1-%d): ", MULTI_ADV_MAX_SENSORS);
+    menuState = MENU_AWAIT_MULTI_COUNT;
+    break;
+
+  case 13:
+    config.fastBoot = !config.fastBoot;
+    configSave();
+    Serial.printf("Boot rápido %s! Nos modos automáticos o boot %s.\n",
+                  config.fastBoot ? "ativado" : "desativado",
+                  config.fastBoot ? "não esperará o console e adiará os logs" : "voltará a esperar o console");
+    showMenu();
+    break;
 
-    case 10:
-      Serial.println("Reiniciando dispositivo...");
-      delay(1000);
-      esp_restart();
-      break;
+  case 14:
+    Serial.println("\nModelos de sinal:");
+    for (int i = 0; i < SIGNAL_MODEL_COUNT; i++)
+    {
+      Serial.printf("  %d - %s\n", i, signalModelName(i));
+    }
+    Serial.printf("Modelo (0-%d): ", SIGNAL_MODEL_COUNT - 1);
+    menuState = MENU_AWAIT_SIGNAL_MODEL;
+    break;
+
+  case 15:
+    Serial.printf("\nTaxa atual de notificação: %d Hz\n", config.notifyRateHz);
+    Serial.printf("Digite a nova taxa (%d-%d Hz): ", GATT_MIN_NOTIFY_HZ, GATT_MAX_NOTIFY_HZ);
+    menuState = MENU_AWAIT_NOTIFY_RATE;
+    break;
+
+  case 16:
+    Serial.printf("\nSemente atual: %lu (%s)\n", (unsigned long)config.macSeed,
+                  config.macSeed != 0 ? "sequência reproduzível" : "esp_random");
+    Serial.print("Digite a nova semente (0 = hardware): ");
+    menuState = MENU_AWAIT_MAC_SEED;
+    break;
+
+  case 17:
+    Serial.println("\nIniciando varredura. O receptor deve estar ligado e conectado à linha de sync.");
+    Serial.println("Digite 'M' durante a varredura para cancelar.");
+    Serial.flush();
+    if (config.rotationPhase != ROTATION_PHASE_FOLLOWER)
+    {
+      syncOutputBegin();
+    }
+    sweepStart();
+    esp_restart();
+    break;
 
-    default:
-      Serial.println("Opção inválida!");
-      showMenu();
+  case 18:
+    Serial.println("\nSincronismo de rotação:");
+    for (int i = 0; i < ROTATION_PHASE_COUNT; i++)
+    {
+      Serial.printf("  %d - %s\n", i, rotationPhaseName(i));
+    }
+    Serial.printf("Os pulsos usam o GPIO %d; ligue os GNDs entre as placas.\n", PHANTOM_SYNC_PIN);
+    Serial.printf("Modo (0-%d): ", ROTATION_PHASE_COUNT - 1);
+    menuState = MENU_AWAIT_ROTATION_PHASE;
+    break;
+
+  case 19:
+    Serial.printf("\nAtual: %d conexões, intervalo %u ms, latência %u, timeout %u ms, MTU %u\n",
+                  config.maxConnections, config.connIntervalMs, config.connLatency, config.connTimeoutMs, config.mtu);
+    Serial.println("Digite: conexões intervalo_ms latência timeout_ms MTU");
+    Serial.printf("Limites: 1-%d, %d-%d ms, 0-%d, %d-%d ms, %d-%d: ", BLE_MAX_CONNECTIONS, GATT_MIN_CONN_INTERVAL_MS,
+                  GATT_MAX_CONN_INTERVAL_MS, GATT_MAX_CONN_LATENCY, GATT_MIN_CONN_TIMEOUT_MS, GATT_MAX_CONN_TIMEOUT_MS,
+                  GATT_MIN_MTU, GATT_MAX_MTU);
+    menuState = MENU_AWAIT_CONN_PARAMS;
+    break;
+
+  case 20:
+    if (traceRecordCount() == 0)
+    {
+      Serial.println("Nenhum trace gravado na partição.");
       break;
     }
+    Serial.printf("\nTrace: %lu registros, %.1f s em 1x\n", (unsigned long)traceRecordCount(),
+                  traceDurationMs() / 1000.0);
+    Serial.printf("Velocidade (1-%d, 0 = parar; 'L' ao final repete): ", TRACE_MAX_SPEED);
+    menuState = MENU_AWAIT_TRACE_SPEED;
+    break;
+
+  case 21:
+    Serial.println();
+    powerPrintEstimates(config, bootTimeToAdvertising() / 1000);
+    Serial.println("Perfis: 0 - desempenho, 1 - baixo consumo (80 MHz, DFS e light sleep)");
+    Serial.printf("Digite: perfil gap_ms (deep sleep entre reinícios, 0-%d): ", POWER_MAX_SLEEP_GAP_MS);
+    menuState = MENU_AWAIT_POWER_PROFILE;
+    break;
+
+  case 22:
+    Serial.println();
+    fleetPrintStatus();
+    for (int i = 0; i < FLEET_ROLE_COUNT; i++)
+    {
+      Serial.printf("  %d - %s\n", i, fleetRoleName(i));
+    }
+    Serial.println("No coordenador: 'P' pausa e 'R' retoma a frota.");
+    Serial.printf("Papel (0-%d): ", FLEET_ROLE_COUNT - 1);
+    menuState = MENU_AWAIT_FLEET_ROLE;
+    break;
+
+  case 23:
+    Serial.printf("\nAtual: %d observações (0 = desligado), mínimo %u ms; o máximo é o intervalo de restart.\n",
+                  config.dwellTarget, config.minDwellMs);
+    Serial.println("Só vale com sincronismo livre e sem frota.");
+    Serial.printf("Digite: observações (0-%d) mínimo_ms (%d-%d): ", MAX_DWELL_TARGET, MIN_RESTART_INTERVAL,
+                  MAX_RESTART_INTERVAL);
+    menuState = MENU_AWAIT_ADAPTIVE_DWELL;
+    break;
+
+  default:
+    Serial.println("Opção inválida!");
+    showMenu();
+    break;
   }
 }
 
-class MyServerCallbacks : public BLEServerCallbacks
+void handleMenuAnswer(const char *input)
 {
-  void onConnect(BLEServer *pServer)
+  MenuState state = menuState;
+  menuState = MENU_IDLE;
+
+  switch (state)
   {
-    Serial.println("Cliente conectado!");
-  }
-  void onDisconnect(BLEServer *pServer)
+  case MENU_AWAIT_MAC_INDEX:
   {
-    Serial.println("Cliente desconectado!");
-  }
-};
-
-void setup()
-{
-  bootStartTime = millis();
+    int macIndex = atoi(input);
+    if (macIndex >= 0 && macIndex < config.macCount)
+    {
+      selectedMacIndex = macIndex;
+      useCustomMac = false;
+      useRandomMac = false;
 
-  Serial.begin(115200);
-  delay(2000);
+      config.selectedMacIndex = selectedMacIndex;
+      config.useCustomMac = 0;
+      config.mode = MODE_STATIC;
+      configSave();
 
-  Serial.println("\n=== INICIANDO BOOT ===");
-  Serial.printf("Tempo de início: %lu ms\n", bootStartTime);
+      const uint8_t *mac = identityAt(macIndex).mac;
+      Serial.printf("MAC %d selecionado: %02X:%02X:%02X:%02X:%02X:%02X\n", macIndex,
+                    mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+      Serial.println("Reiniciando para aplicar o novo MAC...");
+      delay(1000);
+      esp_restart();
+    }
+    else
+    {
+      Serial.printf("Índice inválido! Use valores entre 0 e %d.\n", config.macCount - 1);
+    }
+    break;
+  }
 
-  EEPROM.begin(EEPROM_SIZE);
+  case MENU_AWAIT_CUSTOM_MAC:
+  {
+    uint8_t parsedMac[6];
+    if (macParse(input, parsedMac))
+    {
+      useCustomMac = true;
+      staticMode = true;
+      autoRestart = false;
+      useRandomMac = false;
 
-  uint8_t mode = EEPROM.read(EEPROM_MODE_ADDR);
-  uint8_t storedMacIndex = EEPROM.read(EEPROM_SELECTED_MAC_ADDR);
-  uint8_t storedUseCustom = EEPROM.read(EEPROM_USE_CUSTOM_MAC_ADDR);
+      memcpy(config.customMac, parsedMac, 6);
+      config.mode = MODE_STATIC;
+      config.useCustomMac = 1;
+      configSave();
 
-  uint8_t storedMacCount = EEPROM.read(EEPROM_MAC_COUNT_ADDR);
-  if (storedMacCount >= 1 && storedMacCount <= 99)
-  {
-    macCount = storedMacCount;
-    Serial.printf("Quantidade de MACs carregada: %d\n", macCount);
-  }
-  else
-  {
-    EEPROM.write(EEPROM_MAC_COUNT_ADDR, macCount);
-    EEPROM.commit();
+      Serial.printf("MAC customizado válido: %02X:%02X:%02X:%02X:%02X:%02X\n",
+                    config.customMac[0], config.customMac[1], config.customMac[2],
+                    config.customMac[3], config.customMac[4], config.customMac[5]);
+      Serial.println("Reiniciando para aplicar o MAC customizado...");
+      delay(1000);
+      esp_restart();
+    }
+    else
+    {
+      Serial.println("Formato de MAC inválido! Use o formato AA:BB:CC:DD:EE:FF");
+      Serial.println("Exemplo: C2:52:F5:C7:D6:00");
+    }
+    break;
   }
 
-  unsigned long storedInterval;
-  EEPROM.get(EEPROM_RESTART_INTERVAL_ADDR, storedInterval);
-  if (storedInterval >= 250 && storedInterval <= 30000)
-  {
-    restartInterval = storedInterval;
-    Serial.printf("Intervalo de restart carregado: %lu ms\n", restartInterval);
-  }
-  else
+  case MENU_AWAIT_MAC_COUNT:
   {
-    EEPROM.put(EEPROM_RESTART_INTERVAL_ADDR, restartInterval);
-    EEPROM.commit();
+    int newCount = atoi(input);
+    if (newCount >= 1 && newCount <= identityCount())
+    {
+      config.macCount = newCount;
+
+      Serial.printf("Quantidade de MACs definida para: %d\n", config.macCount);
+      Serial.println("Agora o sistema usará apenas os primeiros " + String(config.macCount) + " MACs da lista.");
+      if (config.macCount > SCHEDULER_MAX_IDENTITIES)
+      {
+        Serial.printf("Aviso: a rotação a quente só escalona as primeiras %d identidades.\n",
+                      SCHEDULER_MAX_IDENTITIES);
+      }
+
+      if (selectedMacIndex >= config.macCount)
+      {
+        selectedMacIndex = 0;
+        config.selectedMacIndex = 0;
+        Serial.println("MAC selecionado resetado para índice 0 (fora do novo range).");
+      }
+      configSave();
+    }
+    else
+    {
+      Serial.printf("Valor inválido! Use valores entre 1 e %d.\n", identityCount());
+    }
+    break;
+  }
+
+  case MENU_AWAIT_RESTART_INTERVAL:
+  {
+    unsigned long newInterval = strtoul(input, NULL, 10);
+    if (newInterval >= MIN_RESTART_INTERVAL && newInterval <= MAX_RESTART_INTERVAL)
+    {
+      config.restartInterval = newInterval;
+      configSave();
+      Serial.printf("Intervalo de restart definido para: %lu ms\n", (unsigned long)config.restartInterval);
+      Serial.println("Esta configuração foi salva e será aplicada no próximo modo automático.");
+    }
+    else
+    {
+      Serial.println("Valor inválido! Respeite o intervalo de tempo mínimo e máximo.");
+    }
+    break;
+  }
+
+  case MENU_AWAIT_MULTI_COUNT:
+    menuPendingValue = atoi(input);
+    Serial.printf("\nIntervalo de advertising base em ms (%d-%d): ", MULTI_ADV_MIN_INTERVAL, MULTI_ADV_MAX_INTERVAL);
+    menuState = MENU_AWAIT_MULTI_INTERVAL;
+    return;
+
+  case MENU_AWAIT_MULTI_INTERVAL:
+  {
+    int newCount = menuPendingValue;
+    int newInterval = atoi(input);
+    if (newCount >= 1 && newCount <= MULTI_ADV_MAX_SENSORS &&
+        newInterval >= MULTI_ADV_MIN_INTERVAL && newInterval <= MULTI_ADV_MAX_INTERVAL)
+    {
+      config.multiAdvCount = newCount;
+      config.multiAdvInterval = newInterval;
+      config.mode = MODE_MULTI_ADV;
+      config.useCustomMac = 0;
+      configSave();
+      Serial.printf("Modo multi-sensor ativado com %d sensores a partir de %d ms! Reiniciando...\n",
+                    config.multiAdvCount, config.multiAdvInterval);
+      delay(1000);
+      esp_restart();
+    }
+    else
+    {
+      Serial.println("Valores inválidos! Respeite os limites de quantidade e intervalo.");
+    }
+    break;
+  }
+
+  case MENU_AWAIT_SIGNAL_MODEL:
+    menuPendingValue = atoi(input);
+    Serial.printf("\nTaxa de atualização em Hz (%d-%d): ", SIGNAL_MIN_RATE_HZ, SIGNAL_MAX_RATE_HZ);
+    menuState = MENU_AWAIT_SIGNAL_RATE;
+    return;
+
+  case MENU_AWAIT_SIGNAL_RATE:
+  {
+    if (applySignalModel(menuPendingValue, atoi(input)))
+    {
+      Serial.printf("Modelo de sinal '%s' a %d Hz aplicado!\n", signalModelName(config.signalModel), config.signalRateHz);
+    }
+    else
+    {
+      Serial.println("Valores inválidos! Respeite os limites de modelo e taxa.");
+    }
+    break;
+  }
+
+  case MENU_AWAIT_NOTIFY_RATE:
+  {
+    if (applyNotifyRate(atoi(input)))
+    {
+      Serial.printf("Notificações de frequência cardíaca a %d Hz!\n", config.notifyRateHz);
+    }
+    else
+    {
+      Serial.println("Valor inválido! Respeite os limites de taxa.");
+    }
+    break;
+  }
+
+  case MENU_AWAIT_ROTATION_PHASE:
+  {
+    int phase = atoi(input);
+    if (input[0] >= '0' && input[0] <= '9' && phase < ROTATION_PHASE_COUNT)
+    {
+      config.rotationPhase = phase;
+      configSave();
+      Serial.printf("Sincronismo '%s' salvo, aplicado no próximo boot.\n", rotationPhaseName(config.rotationPhase));
+    }
+    else
+    {
+      Serial.println("Valor inválido!");
+    }
+    break;
+  }
+
+  case MENU_AWAIT_CONN_PARAMS:
+  {
+    int maxConnections, intervalMs, latency, timeoutMs, mtu;
+    if (sscanf(input, "%d %d %d %d %d", &maxConnections, &intervalMs, &latency, &timeoutMs, &mtu) == 5 &&
+        applyConnParams(maxConnections, intervalMs, latency, timeoutMs, mtu))
+    {
+      Serial.printf("Até %d conexões, aplicado às próximas conexões!\n", config.maxConnections);
+    }
+    else
+    {
+      Serial.println("Valores inválidos! O timeout deve passar de 2 x (1 + latência) x intervalo.");
+    }
+    break;
+  }
+
+  case MENU_AWAIT_POWER_PROFILE:
+  {
+    int profile, gapMs = 0;
+    int fields = sscanf(input, "%d %d", &profile, &gapMs);
+    if (fields >= 1 && profile >= 0 && profile < POWER_PROFILE_COUNT && gapMs >= 0 && gapMs <= POWER_MAX_SLEEP_GAP_MS)
+    {
+      config.powerProfile = profile;
+      config.sleepGapMs = gapMs;
+      configSave();
+      Serial.printf("Perfil '%s' salvo, aplicado no próximo boot.\n", powerProfileName(config.powerProfile));
+      powerPrintEstimates(config, bootTimeToAdvertising() / 1000);
+    }
+    else
+    {
+      Serial.println("Valores inválidos!");
+    }
+    break;
+  }
+
+  case MENU_AWAIT_FLEET_ROLE:
+  {
+    int role = atoi(input);
+    char command = toupper(input[0]);
+    if ((command == 'P' || command == 'R') && input[1] == '\0')
+    {
+      if (fleetSetRunning(command == 'R'))
+      {
+        Serial.println(command == 'R' ? "Frota retomada em uma nova época!" : "Frota pausada.");
+      }
+      else
+      {
+        Serial.println("Só o coordenador controla a frota.");
+      }
+    }
+    else if (input[0] >= '0' && input[0] <= '9' && role < FLEET_ROLE_COUNT)
+    {
+      config.fleetRole = role;
+      configSave();
+      Serial.printf("Papel '%s' salvo, aplicado no próximo boot.\n", fleetRoleName(config.fleetRole));
+    }
+    else
+    {
+      Serial.println("Valor inválido!");
+    }
+    break;
+  }
+
+  case MENU_AWAIT_ADAPTIVE_DWELL:
+  {
+    int target;
+    int minMs = config.minDwellMs;
+    int fields = sscanf(input, "%d %d", &target, &minMs);
+    if (fields >= 1 && target >= 0 && target <= MAX_DWELL_TARGET && minMs >= MIN_RESTART_INTERVAL &&
+        minMs <= MAX_RESTART_INTERVAL)
+    {
+      config.dwellTarget = target;
+      config.minDwellMs = minMs;
+      configSave();
+      Serial.println("Dwell adaptativo salvo, aplicado no próximo boot.");
+    }
+    else
+    {
+      Serial.println("Valores inválidos!");
+    }
+    break;
+  }
+
+  case MENU_AWAIT_TRACE_SPEED:
+  {
+    char *end;
+    long speed = strtol(input, &end, 10);
+    bool repeat = *end == 'l' || *end == 'L';
+    if (end != input && speed >= 0 && speed <= TRACE_MAX_SPEED && applyTracePlayback(speed, repeat))
+    {
+      if (speed == 0)
+      {
+        Serial.println("Reprodução interrompida.");
+      }
+      else
+      {
+        Serial.printf("Reproduzindo a %ldx%s!\n", speed, repeat ? " em repetição" : "");
+      }
+    }
+    else
+    {
+      Serial.println("Valor inválido!");
+    }
+    break;
+  }
+
+  case MENU_AWAIT_MAC_SEED:
+  {
+    char *end;
+    unsigned long seed = strtoul(input, &end, 0);
+    if (end == input || *end != '\0')
+    {
+      Serial.println("Valor inválido! Digite um número.");
+    }
+    else
+    {
+      applyMacSeed(seed);
+      Serial.printf("Semente %lu aplicada, histórico de MACs reiniciado!\n", seed);
+    }
+    break;
+  }
+
+  default:
+    break;
+  }
+  showMenu();
+}
+
+bool checkForTelemetryRequest(const char *input)
+{
+  if ((input[0] == 't' || input[0] == 'T') && input[1] == '\0')
+  {
+    telemetryPrint();
+    return true;
+  }
+  return false;
+}
+
+void processMenuCommand(const char *input)
+{
+  if (menuState == MENU_IDLE && checkForTelemetryRequest(input))
+  {
+    Serial.print("\nEscolha uma opção: ");
+  }
+  else if (menuState != MENU_IDLE)
+  {
+    handleMenuAnswer(input);
+  }
+  else if (input[0] != '\0')
+  {
+    handleMenuChoice(atoi(input));
+  }
+}
+
+void deriveBleAddress(const uint8_t *baseMac, uint8_t *bleAddr)
+{
+  memcpy(bleAddr, baseMac, 6);
+  bleAddr[5] += BT_MAC_OFFSET;
+  bleAddr[0] |= 0xC0;
+}
+
+uint8_t pickBattery()
+{
+  if (config.signalModel != SIGNAL_MODEL_STEPPED)
+  {
+    return cycleState.signal.battery;
+  }
+  uint8_t batteryLevels[] = {0, 25, 50, 75, 100};
+  int index = random(0, 5);
+  return batteryLevels[index];
+}
+
+uint8_t activeBpm(uint8_t generatorBpm)
+{
+  return activeIdentity != nullptr ? identityBpm(*activeIdentity, generatorBpm) : generatorBpm;
+}
+
+uint8_t activeBattery(uint8_t generatorBattery)
+{
+  return activeIdentity != nullptr ? identityBattery(*activeIdentity, generatorBattery) : generatorBattery;
+}
+
+void describeIdentity(const IdentityEntry *identity, char *name, size_t nameSize, uint8_t &profile)
+{
+  if (identity != nullptr)
+  {
+    profile = identityProfile(*identity);
+    identityName(*identity, name, nameSize);
+  }
+  else
+  {
+    profile = DEVICE_PROFILE_DEFAULT;
+    strncpy(name, deviceProfile(profile).baseName, nameSize - 1);
+    name[nameSize - 1] = '\0';
+  }
+}
+
+// True when the name or the profile changed, i.e. the payload has to be
+// rebuilt rather than patched.
+bool updateActiveName()
+{
+  char name[sizeof(activeName)];
+  uint8_t profile;
+  describeIdentity(activeIdentity, name, sizeof(name), profile);
+  if (strcmp(name, activeName) == 0 && profile == activeProfile)
+  {
+    return false;
+  }
+  strcpy(activeName, name);
+  activeProfile = profile;
+  return true;
+}
+
+bool nameAdvertised()
+{
+  return !(sweepActive() && sweepCurrent().layout == SWEEP_LAYOUT_NO_NAME);
+}
+
+const char *advertisedName()
+{
+  return nameAdvertised() ? activeName : nullptr;
+}
+
+void readingFor(const IdentityEntry *identity, uint16_t index, uint8_t &bpm, uint8_t &battery)
+{
+  if (hotScheduler.active() && identity != nullptr)
+  {
+    bpm = hotScheduler.bpm(index - schedulerBase);
+    battery = hotScheduler.battery(index - schedulerBase);
+    return;
+  }
+  uint8_t generatorBpm = getNextBPM();
+  uint8_t generatorBattery = pickBattery();
+  bpm = identity != nullptr ? identityBpm(*identity, generatorBpm) : generatorBpm;
+  battery = identity != nullptr ? identityBattery(*identity, generatorBattery) : generatorBattery;
+}
+
+void nextReading(uint8_t &bpm, uint8_t &battery)
+{
+  readingFor(activeIdentity, selectedMacIndex, bpm, battery);
+}
+
+void selectNextAutoMac(uint8_t *mac)
+{
+  if (useRandomMac)
+  {
+    macGeneratorNext(mac);
+    activeIdentity = nullptr;
+  }
+  else
+  {
+    selectedMacIndex = hotScheduler.active() ? schedulerBase + hotScheduler.next(millis()) : getNextMacIndex();
+    activeIdentity = &identityAt(selectedMacIndex);
+    memcpy(mac, activeIdentity->mac, 6);
+  }
+}
+
+void applyHotIdentity(const uint8_t *mac)
+{
+  uint8_t bleAddr[6];
+  deriveBleAddress(mac, bleAddr);
+  memcpy(activeMac, bleAddr, 6);
+  advertiserSetAddress(bleAddr);
+}
+
+// Whether a list index picked earlier may still go on air: inside the
+// scheduler's window, or else this node's share of the table.
+bool identityStillOwned(uint16_t index)
+{
+  if (hotScheduler.active())
+  {
+    return index >= schedulerBase && index - schedulerBase < hotScheduler.count();
+  }
+  uint16_t first, count;
+  return ownedIdentities(first, count) && index >= first && index < first + count;
+}
+
+// Producer side of hot rotation: picks the identity and builds its
+// payload off the rotation path, usually on the pipeline task. A kept pick
+// skips the scheduler and generator, which already counted it; a list
+// index this node no longer owns is picked again.
+void prepareIdentity(PreparedIdentity &next, bool keepPick)
+{
+  uint8_t mac[6];
+  bool newAddr = true;
+  pipelineLock();
+  if (useRandomMac)
+  {
+    if (keepPick && next.identity == nullptr)
+    {
+      newAddr = false;
+    }
+    else
+    {
+      macGeneratorNext(mac);
+    }
+    next.identity = nullptr;
+    next.index = 0;
+  }
+  else
+  {
+    if (!keepPick || next.identity == nullptr || !identityStillOwned(next.index))
+    {
+      next.index = hotScheduler.active() ? schedulerBase + hotScheduler.next(millis()) : getNextMacIndex();
+    }
+    next.identity = &identityAt(next.index);
+    memcpy(mac, next.identity->mac, 6);
+  }
+  readingFor(next.identity, next.index, next.bpm, next.battery);
+  describeIdentity(next.identity, next.name, sizeof(next.name), next.profile);
+  pipelineUnlock();
+
+  if (newAddr)
+  {
+    deriveBleAddress(mac, next.addr);
+  }
+  next.payload.build(next.profile, nameAdvertised() ? next.name : nullptr, next.bpm, next.battery);
+}
+
+// The radio side: swap in the prepared identity and push it. Only when the
+// producer is late is the identity prepared here, inline.
+void rotateIdentity()
+{
+  static PreparedIdentity fallback;
+  syncPulse();
+  telemetryCount(TELEMETRY_ROTATIONS);
+  unsigned long rotationStart = micros();
+
+  PreparedIdentity *next = pipelineSwap();
+  if (next == nullptr)
+  {
+    prepareIdentity(fallback, false);
+    next = &fallback;
+  }
+  if (next->identity != nullptr)
+  {
+    selectedMacIndex = next->index;
+  }
+  activeIdentity = next->identity;
+  bool layoutChanged = next->profile != activeProfile || strcmp(next->name, activeName) != 0;
+  strcpy(activeName, next->name);
+  activeProfile = next->profile;
+  sensorPayload = &next->payload;
+  uint8_t bpm = next->bpm;
+  uint8_t battery = next->battery;
+
+  advertiserStop();
+  memcpy(activeMac, next->addr, 6);
+  advertiserSetAddress(next->addr);
+  advertiserSetPayload(sensorPayload->adv);
+  if (layoutChanged)
+  {
+    advertiserSetScanResponse(sensorPayload->scanRsp);
+  }
+  dwellObservations = 0;
+  advertiserStart();
+  gattSetReading(bpm, battery);
+
+  unsigned long rotationTime = micros() - rotationStart;
+  rotationCount++;
+  LOG_DEBUG("Identidade %02X:%02X:%02X:%02X:%02X:%02X | BPM %d | Bateria %d%% | troca em %lu us\n",
+            activeMac[0], activeMac[1], activeMac[2],
+            activeMac[3], activeMac[4], activeMac[5],
+            bpm, battery, rotationTime);
+}
+
+void updateSignal(unsigned long now)
+{
+  bool scheduled = autoRestart && hotScheduler.active();
+  if (!(scheduled || signalLiveUpdates()) || now - lastSignalUpdate < 1000UL / config.signalRateHz)
+  {
+    return;
+  }
+
+  uint8_t bpm;
+  uint8_t battery;
+  pipelineLock();
+  if (scheduled)
+  {
+    hotScheduler.step(now);
+    bpm = hotScheduler.bpm(selectedMacIndex - schedulerBase);
+    battery = hotScheduler.battery(selectedMacIndex - schedulerBase);
+  }
+  else
+  {
+    signalAdvance(cycleState.signal, now - lastSignalUpdate);
+    cycleStateCommit();
+    bpm = activeBpm(cycleState.signal.bpm);
+    battery = activeBattery(cycleState.signal.battery);
+  }
+  pipelineUnlock();
+  lastSignalUpdate = now;
+
+  sensorPayload->setBpm(bpm);
+  sensorPayload->setBattery(battery);
+  advertiserSetPayload(sensorPayload->adv);
+  gattSetReading(bpm, battery);
+}
+
+// Records that fell due since the last poll are applied in order, but only
+// the last identity and reading reach the radio.
+void replayTrace(unsigned long now)
+{
+  TraceRecord record;
+  bool due = false;
+  uint16_t identity = TRACE_IDENTITY_KEEP;
+  uint8_t bpm = 0;
+  uint8_t battery = 0;
+  while (traceNext(now, record))
+  {
+    due = true;
+    if (record.identity != TRACE_IDENTITY_KEEP && record.identity < identityCount())
+    {
+      identity = record.identity;
+    }
+    bpm = record.bpm;
+    battery = record.battery;
+  }
+  if (!due)
+  {
+    if (!traceActive())
+    {
+      LOG_INFO("Trace concluído (%lu registros, %lu atrasos de leitura)\n", (unsigned long)traceRecordCount(),
+               (unsigned long)traceUnderruns());
+      lastSignalUpdate = now;
+    }
+    return;
+  }
+
+  bool switched = identity != TRACE_IDENTITY_KEEP && &identityAt(identity) != activeIdentity;
+  if (switched)
+  {
+    selectedMacIndex = identity;
+    activeIdentity = &identityAt(identity);
+    advertiserStop();
+    applyHotIdentity(activeIdentity->mac);
+  }
+  if (switched && updateActiveName())
+  {
+    sensorPayload->build(activeProfile, advertisedName(), bpm, battery);
+    advertiserSetScanResponse(sensorPayload->scanRsp);
+  }
+  else
+  {
+    sensorPayload->setBpm(bpm);
+    sensorPayload->setBattery(battery);
+  }
+  advertiserSetPayload(sensorPayload->adv);
+  if (switched)
+  {
+    advertiserStart();
+  }
+  gattSetReading(bpm, battery);
+}
+
+bool startHotScheduler()
+{
+  uint16_t count;
+  pipelineLock();
+  ownedIdentities(schedulerBase, count);
+  schedulerWanted = count;
+  if (!hotScheduler.begin(count, config.restartInterval, millis(), esp_random()))
+  {
+    pipelineUnlock();
+    return false;
+  }
+  // The scheduler tables are sized at build time; past them the tail of the
+  // list never goes on air in hot rotation, so say so instead of hiding it.
+  if (hotScheduler.count() < count)
+  {
+    LOG_WARN("Escalonador limitado a %d de %d identidades: as últimas %d ficam fora da rotação a quente\n",
+             hotScheduler.count(), count, count - hotScheduler.count());
+  }
+  for (uint16_t i = 0; i < hotScheduler.count(); i++)
+  {
+    const IdentityEntry &identity = identityAt(schedulerBase + i);
+    hotScheduler.setProfile(i, identity.bpmBaseline, identity.battery,
+                            identity.battery != IDENTITY_BATTERY_GENERATOR, identityWeight(identity));
+  }
+  if (selectedMacIndex < schedulerBase || selectedMacIndex >= schedulerBase + count)
+  {
+    selectedMacIndex = schedulerBase;
+  }
+  pipelineUnlock();
+  pipelineFlush();
+  return true;
+}
+
+bool fleetAllowsRotation()
+{
+  uint16_t first, count;
+  return config.fleetRole == FLEET_ROLE_OFF || (fleetRunning() && ownedIdentities(first, count));
+}
+
+// Picks up what the coordinator pushed: share, dwell and run state when the
+// revision moves, the rotation grid on every beacon. A pushed dwell is
+// applied but not saved.
+void followFleet()
+{
+  static uint32_t seenRevision = UINT32_MAX;
+  if (config.fleetRole == FLEET_ROLE_OFF)
+  {
+    return;
+  }
+  fleetLoop(config.restartInterval, config.macCount);
+
+  uint32_t revision = fleetRevision();
+  if (revision != seenRevision)
+  {
+    // The revision starts at 0 on every boot, so past 0 the share differs
+    // from the one this boot started with.
+    bool shareMoved = revision != 0;
+    seenRevision = revision;
+    uint32_t dwellMs = fleetDwellMs();
+    if (dwellMs >= MIN_RESTART_INTERVAL && dwellMs <= MAX_RESTART_INTERVAL && dwellMs != config.restartInterval)
+    {
+      config.restartInterval = dwellMs;
+      hotScheduler.setDwell(dwellMs);
+      rotationTimerSetPeriod(dwellMs);
+    }
+    if (hotScheduler.active() || (autoRestart && config.hotRotation && !useRandomMac))
+    {
+      startHotScheduler();
+    }
+    // Multi-sensor mode builds its sensor set from the share at boot.
+    if (multiAdvMode && (multiAdvSensorCount() > 0 ? shareMoved : fleetAllowsRotation()))
+    {
+      LOG_INFO("Parte da frota mudou, reiniciando o modo multi-sensor\n");
+      logFlush(LOG_FLUSH_MS);
+      esp_restart();
+    }
+    if (autoRestart && !fleetAllowsRotation())
+    {
+      advertiserStop();
+      fleetWaiting = true;
+    }
+    else if (autoRestart && (fleetWaiting || shareMoved))
+    {
+      // The identity on air may belong to another member by now. Reboot
+      // rotation restarts from the wait loop right away.
+      fleetWaiting = !config.hotRotation;
+      if (config.hotRotation)
+      {
+        rotateIdentity();
+      }
+    }
+  }
+
+  int64_t anchorUs;
+  if (fleetTakeGrid(anchorUs) && autoRestart && config.hotRotation)
+  {
+    rotationTimerAnchor(anchorUs);
+  }
+}
+
+// Everything that can change at runtime is applied here; the rest is saved
+// and waits for the next boot, which the reply flags with a 1.
+bool applyConfigRecord(DeviceConfig incoming, uint8_t &rebootNeeded)
+{
+  configSanitize(incoming);
+  rebootNeeded = incoming.mode != config.mode || incoming.useCustomMac != config.useCustomMac ||
+                 memcmp(incoming.customMac, config.customMac, 6) != 0 ||
+                 incoming.selectedMacIndex != config.selectedMacIndex || incoming.hotRotation != config.hotRotation ||
+                 incoming.fastBoot != config.fastBoot || incoming.multiAdvCount != config.multiAdvCount ||
+                 incoming.multiAdvInterval != config.multiAdvInterval || incoming.rotationPhase != config.rotationPhase ||
+                 incoming.powerProfile != config.powerProfile || incoming.fleetRole != config.fleetRole ||
+                 (incoming.dwellTarget == 0) != (config.dwellTarget == 0);
+
+  DeviceConfig previous = config;
+  config = incoming;
+  if (config.macCount > identityCount())
+  {
+    config.macCount = identityCount();
+  }
+  if (config.selectedMacIndex >= config.macCount)
+  {
+    config.selectedMacIndex = 0;
+  }
+
+  hotScheduler.setDwell(config.restartInterval);
+  rotationTimerSetPeriod(config.restartInterval);
+  if (config.macCount != previous.macCount && hotScheduler.active())
+  {
+    startHotScheduler();
+  }
+  if (config.signalModel != previous.signalModel || config.signalRateHz != previous.signalRateHz)
+  {
+    signalInit(cycleState.signal, config.signalModel, cycleState.signal.bpm, cycleState.signal.battery, esp_random());
+    cycleStateCommit();
+    lastSignalUpdate = millis();
+  }
+  if (config.notifyRateHz != previous.notifyRateHz)
+  {
+    gattSetRate(config.notifyRateHz);
+    gattResetStats();
+  }
+  if (config.macSeed != previous.macSeed)
+  {
+    macGeneratorReset(config.macSeed);
+  }
+  bleStackSetConnParams(connParamsFromConfig());
+  if (!multiAdvMode)
+  {
+    advertiserSetConnectable(bleStackConnections() < config.maxConnections);
+  }
+  return configSave();
+}
+
+// Beginning and committing an upload remap the identity table. The producer
+// is held off while that happens and anything it prepared from the old
+// mapping is thrown away, so no entry pointer outlives the table it was in.
+bool beginIdentities(uint16_t count)
+{
+  pipelineLock();
+  activeIdentity = nullptr;
+  bool begun = identityUploadBegin(count);
+  pipelineUnlock();
+  pipelineFlush();
+  return begun;
+}
+
+void warnUncheckedDuplicates()
+{
+  if (!identityDuplicatesChecked())
+  {
+    LOG_WARN("Sem memória para procurar MACs duplicados nas %d identidades: repetidas podem ir ao ar\n",
+             identityCount());
+  }
+}
+
+uint8_t commitIdentities(uint8_t *reply, uint16_t capacity, uint16_t &replyLength)
+{
+  if (capacity < 4)
+  {
+    return PROTOCOL_STATUS_TOO_LONG;
+  }
+  pipelineLock();
+  activeIdentity = nullptr;
+  bool committed = identityUploadCommit();
+  pipelineUnlock();
+  pipelineFlush();
+  if (!committed)
+  {
+    return PROTOCOL_STATUS_STORAGE_ERROR;
+  }
+  warnUncheckedDuplicates();
+  config.macCount = identityCount();
+  if (hotScheduler.active())
+  {
+    startHotScheduler();
+  }
+  if (config.selectedMacIndex >= config.macCount)
+  {
+    config.selectedMacIndex = 0;
+  }
+  if (selectedMacIndex >= config.macCount)
+  {
+    selectedMacIndex = 0;
+  }
+  protocolPutU16(&reply[0], identityCount());
+  protocolPutU16(&reply[2], identityDuplicates());
+  replyLength = 4;
+  return configSave() ? PROTOCOL_STATUS_OK : PROTOCOL_STATUS_STORAGE_ERROR;
+}
+
+uint8_t executeCommand(uint8_t opcode, const uint8_t *data, uint16_t length,
+                       uint8_t *reply, uint16_t capacity, uint16_t &replyLength)
+{
+  replyLength = 0;
+
+  switch (opcode)
+  {
+  case PROTOCOL_OP_PING:
+    if (capacity < 3)
+    {
+      return PROTOCOL_STATUS_TOO_LONG;
+    }
+    reply[0] = PROTOCOL_VERSION;
+    protocolPutU16(&reply[1], PROTOCOL_MAX_PAYLOAD);
+    replyLength = 3;
+    return PROTOCOL_STATUS_OK;
+
+  case PROTOCOL_OP_LOAD_IDENTITIES:
+  {
+    if (length < 2 || length != 2 + data[1] * 6)
+    {
+      return PROTOCOL_STATUS_BAD_LENGTH;
+    }
+    uint8_t count = data[1];
+    if (data[0] != 0 || count == 0)
+    {
+      return PROTOCOL_STATUS_BAD_VALUE;
+    }
+    if (!beginIdentities(count))
+    {
+      return PROTOCOL_STATUS_STORAGE_ERROR;
+    }
+    for (uint8_t i = 0; i < count; i++)
+    {
+      IdentityEntry entry;
+      memset(&entry, 0, sizeof(entry));
+      memcpy(entry.mac, &data[2 + i * 6], 6);
+      entry.battery = IDENTITY_BATTERY_GENERATOR;
+      if (!identityUploadWrite(i, (const uint8_t *)&entry, 1))
+      {
+        return PROTOCOL_STATUS_STORAGE_ERROR;
+      }
+    }
+    return commitIdentities(reply, capacity, replyLength);
+  }
+
+  case PROTOCOL_OP_IDENTITY_BEGIN:
+    if (length != 2)
+    {
+      return PROTOCOL_STATUS_BAD_LENGTH;
+    }
+    if (protocolGetU16(data) == 0 || protocolGetU16(data) > IDENTITY_MAX_ENTRIES)
+    {
+      return PROTOCOL_STATUS_BAD_VALUE;
+    }
+    return beginIdentities(protocolGetU16(data)) ? PROTOCOL_STATUS_OK : PROTOCOL_STATUS_STORAGE_ERROR;
+
+  case PROTOCOL_OP_IDENTITY_WRITE:
+    if (length < 2 + sizeof(IdentityEntry) || (length - 2) % sizeof(IdentityEntry) != 0)
+    {
+      return PROTOCOL_STATUS_BAD_LENGTH;
+    }
+    return identityUploadWrite(protocolGetU16(data), &data[2], (length - 2) / sizeof(IdentityEntry))
+               ? PROTOCOL_STATUS_OK
+               : PROTOCOL_STATUS_BAD_VALUE;
+
+  case PROTOCOL_OP_IDENTITY_COMMIT:
+  {
+    uint32_t crc;
+    if (length != 0 && length != 4)
+    {
+      return PROTOCOL_STATUS_BAD_LENGTH;
+    }
+    if (length == 4 && (!identityUploadCrc(crc) || crc != protocolGetU32(data)))
+    {
+      return PROTOCOL_STATUS_BAD_CRC;
+    }
+    return commitIdentities(reply, capacity, replyLength);
+  }
+
+  case PROTOCOL_OP_SET_INTERVAL:
+  {
+    if (length != 4)
+    {
+      return PROTOCOL_STATUS_BAD_LENGTH;
+    }
+    uint32_t interval = protocolGetU32(data);
+    if (interval < MIN_RESTART_INTERVAL || interval > MAX_RESTART_INTERVAL)
+    {
+      return PROTOCOL_STATUS_BAD_VALUE;
+    }
+    config.restartInterval = interval;
+    hotScheduler.setDwell(interval);
+    rotationTimerSetPeriod(interval);
+    return configSave() ? PROTOCOL_STATUS_OK : PROTOCOL_STATUS_STORAGE_ERROR;
+  }
+
+  case PROTOCOL_OP_SET_SIGNAL_MODEL:
+    if (length != 2)
+    {
+      return PROTOCOL_STATUS_BAD_LENGTH;
+    }
+    return applySignalModel(data[0], data[1]) ? PROTOCOL_STATUS_OK : PROTOCOL_STATUS_BAD_VALUE;
+
+  case PROTOCOL_OP_SET_NOTIFY_RATE:
+    if (length != 1)
+    {
+      return PROTOCOL_STATUS_BAD_LENGTH;
+    }
+    return applyNotifyRate(data[0]) ? PROTOCOL_STATUS_OK : PROTOCOL_STATUS_BAD_VALUE;
+
+  case PROTOCOL_OP_GET_TELEMETRY:
+  {
+    if (length > 1)
+    {
+      return PROTOCOL_STATUS_BAD_LENGTH;
+    }
+    replyLength = telemetryEncode(reply, capacity);
+    if (replyLength == 0)
+    {
+      return PROTOCOL_STATUS_TOO_LONG;
+    }
+    if (length == 1 && (data[0] & TELEMETRY_CLEAR_AFTER_READ))
+    {
+      telemetryReset();
+    }
+    return PROTOCOL_STATUS_OK;
+  }
+
+  case PROTOCOL_OP_TRACE_BEGIN:
+    if (length != 4)
+    {
+      return PROTOCOL_STATUS_BAD_LENGTH;
+    }
+    if (protocolGetU32(data) == 0 || protocolGetU32(data) > TRACE_MAX_RECORDS)
+    {
+      return PROTOCOL_STATUS_BAD_VALUE;
+    }
+    return traceUploadBegin(protocolGetU32(data)) ? PROTOCOL_STATUS_OK : PROTOCOL_STATUS_STORAGE_ERROR;
+
+  case PROTOCOL_OP_TRACE_WRITE:
+    if (length < 4 + sizeof(TraceRecord) || (length - 4) % sizeof(TraceRecord) != 0)
+    {
+      return PROTOCOL_STATUS_BAD_LENGTH;
+    }
+    return traceUploadWrite(protocolGetU32(data), &data[4], (length - 4) / sizeof(TraceRecord))
+               ? PROTOCOL_STATUS_OK
+               : PROTOCOL_STATUS_BAD_VALUE;
+
+  case PROTOCOL_OP_TRACE_COMMIT:
+  {
+    uint32_t crc;
+    if (length != 0 && length != 4)
+    {
+      return PROTOCOL_STATUS_BAD_LENGTH;
+    }
+    if (capacity < 8)
+    {
+      return PROTOCOL_STATUS_TOO_LONG;
+    }
+    if (length == 4 && (!traceUploadCrc(crc) || crc != protocolGetU32(data)))
+    {
+      return PROTOCOL_STATUS_BAD_CRC;
+    }
+    if (!traceUploadCommit())
+    {
+      return PROTOCOL_STATUS_STORAGE_ERROR;
+    }
+    protocolPutU32(&reply[0], traceRecordCount());
+    protocolPutU32(&reply[4], traceDurationMs());
+    replyLength = 8;
+    return PROTOCOL_STATUS_OK;
+  }
+
+  case PROTOCOL_OP_CONFIG_READ:
+    if (length != 0)
+    {
+      return PROTOCOL_STATUS_BAD_LENGTH;
+    }
+    if (capacity < sizeof(DeviceConfig))
+    {
+      return PROTOCOL_STATUS_TOO_LONG;
+    }
+    replyLength = configToRecord(config, reply);
+    return PROTOCOL_STATUS_OK;
+
+  case PROTOCOL_OP_CONFIG_WRITE:
+  {
+    DeviceConfig incoming;
+    if (!configFromRecord(data, length, incoming))
+    {
+      return PROTOCOL_STATUS_BAD_CRC;
+    }
+    if (!applyConfigRecord(incoming, reply[0]))
+    {
+      return PROTOCOL_STATUS_STORAGE_ERROR;
+    }
+    replyLength = 1;
+    return PROTOCOL_STATUS_OK;
+  }
+
+  case PROTOCOL_OP_FLEET_CONTROL:
+    if (length != 1)
+    {
+      return PROTOCOL_STATUS_BAD_LENGTH;
+    }
+    return fleetSetRunning(data[0] != 0) ? PROTOCOL_STATUS_OK : PROTOCOL_STATUS_BAD_VALUE;
+
+  case PROTOCOL_OP_TRACE_PLAY:
+    if (length != 2)
+    {
+      return PROTOCOL_STATUS_BAD_LENGTH;
+    }
+    if (data[0] > TRACE_MAX_SPEED)
+    {
+      return PROTOCOL_STATUS_BAD_VALUE;
+    }
+    return applyTracePlayback(data[0], data[1] & TRACE_PLAY_REPEAT) ? PROTOCOL_STATUS_OK : PROTOCOL_STATUS_BAD_VALUE;
+
+  case PROTOCOL_OP_SET_CONN_PARAMS:
+    if (length != 9)
+    {
+      return PROTOCOL_STATUS_BAD_LENGTH;
+    }
+    return applyConnParams(data[0], protocolGetU16(&data[1]), protocolGetU16(&data[3]), protocolGetU16(&data[5]),
+                           protocolGetU16(&data[7]))
+               ? PROTOCOL_STATUS_OK
+               : PROTOCOL_STATUS_BAD_VALUE;
+
+  case PROTOCOL_OP_SET_MAC_SEED:
+    if (length != 4)
+    {
+      return PROTOCOL_STATUS_BAD_LENGTH;
+    }
+    return applyMacSeed(protocolGetU32(data)) ? PROTOCOL_STATUS_OK : PROTOCOL_STATUS_STORAGE_ERROR;
+
+  case PROTOCOL_OP_SET_MODE:
+    if (length != 1)
+    {
+      return PROTOCOL_STATUS_BAD_LENGTH;
+    }
+    if (data[0] >= MODE_COUNT || (data[0] == MODE_MULTI_ADV && !multiAdvSupported()))
+    {
+      return PROTOCOL_STATUS_BAD_VALUE;
+    }
+    config.mode = data[0];
+    if (config.mode != MODE_STATIC)
+    {
+      config.useCustomMac = 0;
+    }
+    if (!configSave())
+    {
+      return PROTOCOL_STATUS_STORAGE_ERROR;
+    }
+    restartPending = true;
+    return PROTOCOL_STATUS_OK;
+
+  case PROTOCOL_OP_GET_COUNTERS:
+  {
+    if (capacity < 31)
+    {
+      return PROTOCOL_STATUS_TOO_LONG;
+    }
+    uint32_t sent, failed, bytes;
+    gattGetCounters(sent, failed, bytes);
+    protocolPutU32(&reply[0], millis());
+    protocolPutU32(&reply[4], bootTimeToAdvertising());
+    reply[8] = config.mode;
+    protocolPutU16(&reply[9], selectedMacIndex);
+    protocolPutU16(&reply[11], config.macCount);
+    protocolPutU32(&reply[13], rotationCount);
+    reply[17] = cycleState.signal.bpm;
+    reply[18] = cycleState.signal.battery;
+    protocolPutU32(&reply[19], sent);
+    protocolPutU32(&reply[23], failed);
+    protocolPutU32(&reply[27], bytes);
+    replyLength = 31;
+    return PROTOCOL_STATUS_OK;
+  }
+
+  default:
+    return PROTOCOL_STATUS_UNKNOWN_OPCODE;
   }
+}
+
+// Batch payload: repeated (opcode, length u16, data). The reply carries an
+// overall status followed by one (opcode, length u16, status, data) entry
+// per executed command.
+uint16_t executeBatch(const ProtocolFrame &frame, uint8_t *reply, uint16_t capacity)
+{
+  uint16_t offset = 0;
+  uint16_t replyLength = 1;
+  reply[0] = PROTOCOL_STATUS_OK;
 
-  if (mode > 2)
+  while (offset < frame.length)
   {
-    mode = 1;
-    EEPROM.write(EEPROM_MODE_ADDR, mode);
-    EEPROM.commit();
+    if (frame.length - offset < 3)
+    {
+      reply[0] = PROTOCOL_STATUS_BAD_LENGTH;
+      break;
+    }
+    uint8_t opcode = frame.payload[offset];
+    uint16_t length = protocolGetU16(&frame.payload[offset + 1]);
+    offset += 3;
+    if (length > frame.length - offset || capacity - replyLength < 4)
+    {
+      reply[0] = PROTOCOL_STATUS_BAD_LENGTH;
+      break;
+    }
+
+    uint8_t *entry = &reply[replyLength];
+    uint16_t dataLength = 0;
+    entry[0] = opcode;
+    entry[3] = opcode == PROTOCOL_OP_BATCH
+                   ? (uint8_t)PROTOCOL_STATUS_UNKNOWN_OPCODE
+                   : executeCommand(opcode, &frame.payload[offset], length,
+                                    &entry[4], capacity - replyLength - 4, dataLength);
+    protocolPutU16(&entry[1], dataLength + 1);
+    replyLength += 4 + dataLength;
+    offset += length;
   }
+  return replyLength;
+}
+
+typedef void (*FrameSender)(uint8_t opcode, const uint8_t *payload, uint16_t length);
 
-  if (storedMacIndex < macCount)
+void handleProtocolFrame(const ProtocolFrame &frame, FrameSender send)
+{
+  static uint8_t reply[PROTOCOL_MAX_PAYLOAD];
+  uint16_t replyLength;
+
+  if (frame.opcode == PROTOCOL_OP_BATCH)
   {
-    selectedMacIndex = storedMacIndex;
+    replyLength = executeBatch(frame, reply, sizeof(reply));
   }
   else
   {
-    selectedMacIndex = 0;
-    EEPROM.write(EEPROM_SELECTED_MAC_ADDR, selectedMacIndex);
-    EEPROM.commit();
-    Serial.println("MAC index resetado para 0 (valor inválido na EEPROM)");
+    reply[0] = executeCommand(frame.opcode, frame.payload, frame.length, &reply[1], sizeof(reply) - 1, replyLength);
+    replyLength++;
   }
+  send(frame.opcode | PROTOCOL_REPLY_FLAG, reply, replyLength);
 
-  if (storedUseCustom == 1)
+  if (restartPending)
   {
-    useCustomMac = true;
-    for (int i = 0; i < 6; i++)
-    {
-      customMac[i] = EEPROM.read(EEPROM_CUSTOM_MAC_ADDR + i);
-    }
+    logFlush(LOG_FLUSH_MS);
+    esp_restart();
+  }
+}
+
+void processProtocolFrames()
+{
+  static ProtocolFrame frame;
+  while (consoleReceiveFrame(frame))
+  {
+    handleProtocolFrame(frame, consoleSendFrame);
+  }
+  while (transferReceiveFrame(frame))
+  {
+    handleProtocolFrame(frame, transferSendFrame);
+  }
+}
+
+bool startMultiAdv()
+{
+  static SimulatedSensor initial[MULTI_ADV_MAX_SENSORS];
+  uint16_t first, count;
+  if (!ownedIdentities(first, count))
+  {
+    return false;
+  }
+  for (int i = 0; i < config.multiAdvCount; i++)
+  {
+    SimulatedSensor &sensor = initial[i];
+    const IdentityEntry &identity = identityAt(first + (selectedMacIndex + i) % count);
+    deriveBleAddress(identity.mac, sensor.addr);
+    identityName(identity, sensor.name, sizeof(sensor.name));
+    sensor.identity = identity;
+    sensor.profile = identityProfile(identity);
+    uint8_t bpm = identity.bpmBaseline != IDENTITY_BPM_GENERATOR ? IDENTITY_REFERENCE_BPM : 60 + (i * 7) % 120;
+    signalInit(sensor.signal, config.signalModel, bpm, pickBattery(), esp_random());
+    sensor.signal.bpmDir = i % 2;
+    sensor.signal.elapsedMs = i * 7919UL;
+    sensor.intervalMs = config.multiAdvInterval + (i % 8) * 5;
+    sensor.weight = identityWeight(identity);
+  }
+  unsigned long updateMs = config.signalModel == SIGNAL_MODEL_STEPPED ? MULTI_ADV_UPDATE_MS : 1000UL / config.signalRateHz;
+  return multiAdvBegin(initial, config.multiAdvCount, config.restartInterval, updateMs);
+}
+
+// Scan requests and connects on the identity on air, both from the BLE host
+// task. Reaching the target ends the dwell once its minimum has passed; the
+// restart interval stays the cap.
+void onIdentityObserved()
+{
+  if (!adaptiveDwellActive() || ++dwellObservations != config.dwellTarget)
+  {
+    return;
+  }
+  if (!config.hotRotation)
+  {
+    dwellTargetReached = true;
+  }
+  else if (rotationTimerCutShort(config.minDwellMs))
+  {
+    telemetryCount(TELEMETRY_EARLY_ROTATIONS);
+  }
+}
+
+void onScanRequest()
+{
+  telemetryCount(TELEMETRY_SCAN_REQUESTS);
+  onIdentityObserved();
+}
+
+// Every connect stops the controller's advertising; it is restarted at once,
+// connectable while there is a free slot and scannable-only at the limit.
+void onConnectionChanged(bool connected, uint8_t connections)
+{
+  telemetryCount(connected ? TELEMETRY_CONNECTS : TELEMETRY_DISCONNECTS);
+  if (connected)
+  {
+    gattResetStats();
+    onIdentityObserved();
+  }
+  LOG_INFO("Cliente %s (%d/%d conexões)\n", connected ? "conectado" : "desconectado", connections,
+           config.maxConnections);
+  if (multiAdvMode || fleetWaiting)
+  {
+    return;
+  }
+  advertiserSetConnectable(connections < config.maxConnections);
+  advertiserStart();
+}
+
+void importLegacyEeprom(DeviceConfig &cfg)
+{
+  EEPROM.begin(EEPROM_SIZE);
+
+  cfg.mode = EEPROM.read(EEPROM_MODE_ADDR);
+  cfg.selectedMacIndex = EEPROM.read(EEPROM_SELECTED_MAC_ADDR);
+  cfg.useCustomMac = EEPROM.read(EEPROM_USE_CUSTOM_MAC_ADDR) == 1;
+  for (int i = 0; i < 6; i++)
+  {
+    cfg.customMac[i] = EEPROM.read(EEPROM_CUSTOM_MAC_ADDR + i);
+  }
+  cfg.macCount = EEPROM.read(EEPROM_MAC_COUNT_ADDR);
+  uint32_t storedInterval;
+  EEPROM.get(EEPROM_RESTART_INTERVAL_ADDR, storedInterval);
+  cfg.restartInterval = storedInterval;
+  cfg.hotRotation = EEPROM.read(EEPROM_HOT_ROTATION_ADDR) == 1;
+  cfg.fastBoot = EEPROM.read(EEPROM_FAST_BOOT_ADDR) == 1;
+  cfg.multiAdvCount = EEPROM.read(EEPROM_MULTI_ADV_COUNT_ADDR);
+  uint16_t storedMultiInterval;
+  EEPROM.get(EEPROM_MULTI_ADV_INTERVAL_ADDR, storedMultiInterval);
+  cfg.multiAdvInterval = storedMultiInterval;
+
+  EEPROM.end();
+}
+
+void setup()
+{
+#ifdef PHANTOM_ROLE_RECEIVER
+  receiverBegin();
+  return;
+#endif
+
+  bootProfilerStart();
+
+  Serial.begin(115200);
+  logBegin();
+  telemetryBegin();
+
+  LOG_INFO("\n=== INICIANDO BOOT ===\n");
+  LOG_INFO("Tempo de início: %lu ms\n", millis());
+
+  bool configChanged = false;
+  if (!configLoad())
+  {
+    configDefaults(config);
+    importLegacyEeprom(config);
+    configChanged = true;
+    LOG_INFO("Configuração ausente ou inválida, importada da EEPROM legada\n");
+  }
+  else if (config.version != CONFIG_VERSION)
+  {
+    configChanged = true;
+    LOG_INFO("Configuração da versão %d atualizada para a versão %d\n", config.version, CONFIG_VERSION);
+  }
+  if (configSanitize(config))
+  {
+    configChanged = true;
+    LOG_INFO("Configuração corrigida (valores fora do intervalo)\n");
   }
 
-  Serial.println("--- Configurando modo de operação ---");
-  if (mode == 1)
+  identityTableBegin();
+  traceBegin();
+  macGeneratorBegin(config.macSeed);
+  LOG_INFO("Identidades: %d (%s, %d duplicadas ignoradas)\n", identityCount(),
+          identitySource() == IDENTITY_SOURCE_PARTITION ? "partição" : "lista interna", identityDuplicates());
+  warnUncheckedDuplicates();
+  if (config.macCount > identityCount())
+  {
+    config.macCount = identityCount();
+    configChanged = true;
+  }
+  if (config.selectedMacIndex >= config.macCount)
+  {
+    config.selectedMacIndex = 0;
+    configChanged = true;
+  }
+
+  if (config.mode == MODE_MULTI_ADV && !multiAdvSupported())
+  {
+    LOG_INFO("Modo multi-sensor indisponível neste chip, usando modo automático com lista\n");
+    config.mode = MODE_AUTO_LIST;
+    configChanged = true;
+  }
+
+  if (configChanged)
+  {
+    configSave();
+  }
+
+  // A free board leaves the line alone unless a sweep is marking its steps
+  // for the receiver.
+  if (config.rotationPhase == ROTATION_PHASE_FOLLOWER)
+  {
+    syncInputBegin(SWEEP_BOUNDARY_MIN_US);
+  }
+  else if (config.rotationPhase == ROTATION_PHASE_LEADER || sweepActive())
+  {
+    syncOutputBegin();
+  }
+
+  if (sweepActive())
+  {
+    sweepApply(config);
+    LOG_INFO("Varredura: passo %d/%d\n", sweepStepIndex() + 1, (int)SWEEP_STEP_COUNT);
+  }
+
+  uint8_t mode = config.mode;
+  selectedMacIndex = config.selectedMacIndex;
+  useCustomMac = config.useCustomMac == 1;
+  LOG_INFO("Quantidade de MACs carregada: %d\n", config.macCount);
+  LOG_INFO("Intervalo de restart carregado: %lu ms\n", (unsigned long)config.restartInterval);
+
+  if (!cycleStateLoad())
+  {
+    cycleStateReset(selectedMacIndex);
+    LOG_INFO("Estado de ciclo reiniciado (memória RTC inválida)\n");
+  }
+  if (cycleState.signal.model != config.signalModel)
+  {
+    signalInit(cycleState.signal, config.signalModel, cycleState.signal.bpm, cycleState.signal.battery, esp_random());
+    cycleStateCommit();
+  }
+  if (powerBegin(config.powerProfile) || powerLowActive())
+  {
+    LOG_INFO("Perfil de energia: %s (light sleep %s)\n", powerProfileName(config.powerProfile),
+             powerLightSleepActive() ? "ativo" : "indisponível neste build");
+  }
+  bootProfilerMark(BOOT_PHASE_CONFIG);
+
+  if (!(config.fastBoot && mode != MODE_STATIC))
+  {
+    delay(2000);
+    logStartDrain();
+  }
+  bootProfilerMark(BOOT_PHASE_CONSOLE);
+
+  LOG_INFO("--- Configurando modo de operação ---\n");
+  if (mode == MODE_STATIC)
   {
     autoRestart = false;
     staticMode = true;
     useRandomMac = false;
-    Serial.println("=== INICIANDO EM MODO ESTÁTICO ===");
+    LOG_INFO("=== INICIANDO EM MODO ESTÁTICO ===\n");
+  }
+  else if (mode == MODE_MULTI_ADV)
+  {
+    autoRestart = false;
+    staticMode = false;
+    useCustomMac = false;
+    useRandomMac = false;
+    multiAdvMode = true;
+    LOG_INFO("=== INICIANDO EM MODO MULTI-SENSOR ===\n");
+    LOG_INFO(">>> Digite 'M' ou '2' a qualquer momento para voltar ao menu <<<\n");
   }
-  else if (mode == 2)
+  else if (mode == MODE_AUTO_RANDOM)
   {
     autoRestart = true;
     staticMode = false;
     useCustomMac = false;
     useRandomMac = true;
-    Serial.println("=== INICIANDO EM MODO AUTOMÁTICO RANDÔMICO ===");
-    Serial.println(">>> Digite 'M' ou '2' a qualquer momento para voltar ao menu <<<");
+    LOG_INFO("=== INICIANDO EM MODO AUTOMÁTICO RANDÔMICO ===\n");
+    LOG_INFO(">>> Digite 'M' ou '2' a qualquer momento para voltar ao menu <<<\n");
   }
   else
   {
@@ -656,175 +2116,377 @@ void setup()
     staticMode = false;
     useCustomMac = false;
     useRandomMac = false;
-    Serial.println("=== INICIANDO EM MODO AUTOMÁTICO COM LISTA ===");
-    Serial.println(">>> Digite 'M' ou '2' a qualquer momento para voltar ao menu <<<");
+    LOG_INFO("=== INICIANDO EM MODO AUTOMÁTICO COM LISTA ===\n");
+    LOG_INFO(">>> Digite 'M' ou '2' a qualquer momento para voltar ao menu <<<\n");
   }
 
-  Serial.println("--- Selecionando MAC ---");
-  uint8_t macToUse[6];
-  if (staticMode && useCustomMac)
+  if (autoRestart && config.hotRotation && !useRandomMac && startHotScheduler())
   {
-    memcpy(macToUse, customMac, 6);
-    Serial.println("Usando MAC customizado");
+    LOG_INFO("Escalonador de identidades ativo: %d de %d identidades\n", hotScheduler.count(), schedulerWanted);
   }
-  else if (staticMode)
+
+  LOG_INFO("--- Selecionando MAC ---\n");
+  uint8_t macToUse[6];
+  if (staticMode && useCustomMac)
   {
-    memcpy(macToUse, mac_list[selectedMacIndex], 6);
-    Serial.printf("Usando MAC da lista (índice %d)\n", selectedMacIndex);
+    memcpy(macToUse, config.customMac, 6);
+    LOG_INFO("Usando MAC customizado\n");
   }
-  else if (useRandomMac)
+  else if (staticMode || multiAdvMode)
   {
-    generateRandomMac(macToUse);
-    Serial.println("Usando MAC randômico gerado");
+    activeIdentity = &identityAt(selectedMacIndex);
+    memcpy(macToUse, activeIdentity->mac, 6);
+    LOG_INFO("Usando MAC da lista (índice %d)\n", selectedMacIndex);
   }
   else
   {
-    int macIndex = getNextMacIndex();
-    selectedMacIndex = macIndex;
-    memcpy(macToUse, mac_list[macIndex], 6);
-    Serial.printf("Usando MAC automático da lista (índice %d)\n", macIndex);
+    selectNextAutoMac(macToUse);
+    if (useRandomMac)
+    {
+      LOG_INFO("Usando MAC randômico gerado\n");
+    }
+    else
+    {
+      LOG_INFO("Usando MAC automático da lista (índice %d)\n", selectedMacIndex);
+    }
   }
+  bootProfilerMark(BOOT_PHASE_MAC_SELECT);
 
-  Serial.println("--- Configurando MAC base ---");
+  LOG_INFO("--- Configurando MAC base ---\n");
   esp_base_mac_addr_set(macToUse);
+  bootProfilerMark(BOOT_PHASE_BASE_MAC);
 
-  Serial.println("--- Inicializando BLE ---");
-  BLEDevice::init(DEVICE_NAME);
+  LOG_INFO("--- Inicializando BLE (%s) ---\n", bleStackName());
+  size_t released = bleStackReleaseClassic();
+  if (released > 0)
+  {
+    LOG_INFO("Modo de memória: %lu bytes do BT clássico liberados\n", (unsigned long)released);
+  }
+  updateActiveName();
+  const DeviceProfile &profile = deviceProfile(activeProfile);
+  bleStackInit(profile.baseName);
+  bootProfilerMark(BOOT_PHASE_BLE_INIT);
 
-  const uint8_t *realMac = esp_bt_dev_get_address();
-  Serial.printf("MAC BLE usado: %02X:%02X:%02X:%02X:%02X:%02X\n",
+  const uint8_t *realMac = bleStackAddress();
+  LOG_INFO("MAC BLE usado: %02X:%02X:%02X:%02X:%02X:%02X\n",
                 realMac[0], realMac[1], realMac[2],
                 realMac[3], realMac[4], realMac[5]);
 
-  Serial.println("--- Criando servidor BLE ---");
-  BLEServer *pServer = BLEDevice::createServer();
-  pServer->setCallbacks(new MyServerCallbacks());
-
-  Serial.println("--- Criando serviços BLE ---");
-  BLEService *heartRateService = pServer->createService(BLEUUID((uint16_t)0x180D));
-  BLEService *userDataService = pServer->createService(BLEUUID((uint16_t)0x181C));
-  BLEService *batteryService = pServer->createService(BLEUUID((uint16_t)0x180F));
-  BLEService *deviceInfoService = pServer->createService(BLEUUID((uint16_t)0x180A));
-  BLEService *customService = pServer->createService(BLEUUID((uint16_t)0xFD00));
-
-  heartRateService->start();
-  userDataService->start();
-  batteryService->start();
-  deviceInfoService->start();
-  customService->start();
-
-  Serial.println("--- Configurando advertising ---");
-  BLEAdvertising *pAdvertising = BLEDevice::getAdvertising();
-  BLEAdvertisementData advData;
-
-  advData.setFlags(0x06);
-
-  uint8_t uuidData[] = {
-      0x0B, 0x03,
-      0x0D, 0x18,
-      0x1C, 0x18,
-      0x0F, 0x18,
-      0x0A, 0x18,
-      0x00, 0xFD};
-  advData.addData(std::string((const char *)uuidData, sizeof(uuidData)));
-
-  uint8_t bpm = getNextBPM();
-  uint8_t batteryLevels[] = {0, 25, 50, 75, 100};
-  int index = random(0, 5);
-  uint8_t battery = batteryLevels[index];
-  uint8_t mfrData[] = {0x07, 0xFF, 0x05, 0xFF, 0x01, battery, 0x06, bpm};
-  advData.addData(std::string((const char *)mfrData, sizeof(mfrData)));
-
-  const char *nome = DEVICE_NAME;
-  size_t nomeLength = strlen(nome);
-  uint8_t nomeData[2 + nomeLength];
-  nomeData[0] = 1 + nomeLength;
-  nomeData[1] = 0x09;
-  memcpy(&nomeData[2], nome, nomeLength);
-  advData.addData(std::string((const char *)nomeData, sizeof(nomeData)));
-
-  Serial.println("--- Iniciando advertising ---");
-  pAdvertising->setAdvertisementData(advData);
-  pAdvertising->start();
-
-  bootCompleteTime = millis();
-  unsigned long totalBootTime = (bootCompleteTime - bootStartTime) / 10;
-  bootTimeRecorded = true;
-
-  Serial.println("\n╔════════════════════════════════════════╗");
-  Serial.println("║           INFORMAÇÕES GERAIS           ║");
-  Serial.println("╚════════════════════════════════════════╝");
-  Serial.printf("  Tempo de boot: %6lu ms               \n", totalBootTime);
-  Serial.printf("  BPM atual: %8d                   \n", bpm);
-  Serial.printf("  Bateria: %9d%%                   \n", battery);
-  Serial.println("╚════════════════════════════════════════╝");
+  LOG_INFO("--- Criando servidor BLE ---\n");
+  BleServer *pServer = BleDevice::createServer();
+  bleStackSetConnParams(connParamsFromConfig());
+  bleStackServe(pServer, onConnectionChanged);
+
+  LOG_INFO("--- Criando serviços BLE ---\n");
+  BleService *services[PROFILE_MAX_SERVICES];
+  for (int i = 0; i < profile.serviceCount; i++)
+  {
+    services[i] = pServer->createService(BleUUID(profile.services[i]));
+  }
+  gattBegin(pServer, services[profileServiceIndex(profile, UUID_HEART_RATE)],
+            services[profileServiceIndex(profile, UUID_BATTERY)],
+            services[profileServiceIndex(profile, UUID_DEVICE_INFO)], profile.baseName);
+  transferBegin(services[profileServiceIndex(profile, UUID_TRANSFER)]);
+  for (int i = 0; i < profile.serviceCount; i++)
+  {
+    services[i]->start();
+  }
+  bleStackStartServer(pServer);
+  bootProfilerMark(BOOT_PHASE_SERVICES);
+
+  if (config.fleetRole != FLEET_ROLE_OFF)
+  {
+    if (fleetBegin(config.fleetRole))
+    {
+      LOG_INFO("Frota ESP-NOW: %s no canal %d\n", fleetRoleName(config.fleetRole), FLEET_CHANNEL);
+    }
+    else
+    {
+      LOG_ERROR("Falha ao iniciar o ESP-NOW, frota desativada\n");
+      config.fleetRole = FLEET_ROLE_OFF;
+    }
+  }
+
+  LOG_INFO("--- Configurando advertising ---\n");
+  advertiserBegin();
+  if (adaptiveDwellActive() && !advertiserReportScans(onScanRequest))
+  {
+    LOG_INFO("Dwell adaptativo: %s sem aviso de scan requests, só conexões contam\n", bleStackName());
+  }
+  if (sweepActive())
+  {
+    sweepApplyRadio();
+  }
+  memcpy(activeMac, realMac, 6);
+  if (autoRestart && config.hotRotation)
+  {
+    applyHotIdentity(macToUse);
+    LOG_INFO("Rotação a quente ativa: endereço aleatório estático aplicado\n");
+  }
+
+  uint8_t bpm;
+  uint8_t battery;
+  nextReading(bpm, battery);
+  sensorPayload->build(activeProfile, advertisedName(), bpm, battery);
+  LOG_INFO("Advertising: %d bytes no pacote primário, %d bytes no scan response\n",
+          sensorPayload->adv.length(), sensorPayload->scanRsp.length());
+
+  LOG_INFO("--- Iniciando advertising ---\n");
+  if (multiAdvMode && !fleetAllowsRotation())
+  {
+    LOG_INFO("Frota: sem parte deste nó ainda, fora do ar até o coordenador confirmar\n");
+  }
+  else if (multiAdvMode)
+  {
+    if (!startMultiAdv())
+    {
+      LOG_WARN("Falha no modo multi-sensor, voltando ao advertising simples\n");
+      multiAdvMode = false;
+      staticMode = true;
+    }
+  }
+  if (!multiAdvMode)
+  {
+    advertiserSetPayload(sensorPayload->adv);
+    advertiserSetScanResponse(sensorPayload->scanRsp);
+    if (autoRestart && !fleetAllowsRotation())
+    {
+      fleetWaiting = true;
+      LOG_INFO("Frota: sem parte deste nó ainda, fora do ar até o coordenador confirmar\n");
+    }
+    else
+    {
+      advertiserStart();
+    }
+    dwellStartedAt = millis();
+  }
+
+  bootProfilerMark(BOOT_PHASE_ADV_START);
+  if (sweepActive())
+  {
+    sweepAdvertisingStarted();
+  }
+  if (!consoleBegin(!staticMode))
+  {
+    LOG_ERROR("Falha ao iniciar a tarefa do console\n");
+  }
+  consoleSetPollMs(powerIdleWaitMs(CONSOLE_POLL_MS, POWER_IDLE_WAIT_MS));
+  gattSetReading(bpm, battery);
+  if (!gattStartNotifier(config.notifyRateHz))
+  {
+    LOG_ERROR("Falha ao iniciar a tarefa de notificações GATT\n");
+  }
+  bootProfilerMark(BOOT_PHASE_TASKS);
+  telemetryRecordBoot();
+  lastSignalUpdate = millis();
+  logStartDrain();
+
+  LOG_INFO("\n=== INFORMACOES GERAIS ===\n");
+  LOG_INFO("Tempo de boot: %lu ms | BPM atual: %d | Bateria: %d%%\n",
+           (unsigned long)(bootTimeToAdvertising() / 1000), bpm, battery);
 
   if (staticMode)
   {
-    Serial.println("\n=== MODO ESTÁTICO ATIVO ===");
+    LOG_INFO("\n=== MODO ESTÁTICO ATIVO ===\n");
+    logFlush(LOG_FLUSH_MS);
     showMenu();
   }
+  else if (multiAdvMode)
+  {
+    LOG_INFO("\nAdvertising estendido iniciado - %d sensores simulados\n", multiAdvSensorCount());
+    LOG_INFO(">>> Digite 'M' ou '2' para acessar o menu <<<\n");
+  }
+  else if (config.hotRotation)
+  {
+    LOG_INFO("\nAdvertising iniciado - Modo Automático com rotação a quente\n");
+    LOG_INFO("Próxima troca de identidade em %lu ms\n", (unsigned long)config.restartInterval);
+    LOG_INFO(">>> Digite 'M' ou '2' para acessar o menu <<<\n");
+    if (!rotationTimerBegin(config.restartInterval, config.rotationPhase))
+    {
+      LOG_ERROR("Falha ao criar o temporizador de rotação\n");
+    }
+    if (!pipelineBegin(prepareIdentity))
+    {
+      LOG_WARN("Pipeline de identidades indisponível, preparando cada troca na hora\n");
+    }
+  }
   else
   {
-    Serial.println("\nAdvertising iniciado - Modo Automático");
-    Serial.printf("Próximo restart em %lu ms\n", restartInterval);
-    Serial.println(">>> Digite 'M' ou '2' para acessar o menu <<<");
+    LOG_INFO("\nAdvertising iniciado - Modo Automático\n");
+    LOG_INFO("Próximo restart em %lu ms\n", (unsigned long)config.restartInterval);
+    LOG_INFO(">>> Digite 'M' ou '2' para acessar o menu <<<\n");
   }
 }
 
-bool checkForMenuRequest()
+bool checkForMenuRequest(const char *input)
 {
-  if (Serial.available())
+  if (checkForTelemetryRequest(input))
   {
-    char input = Serial.read();
-    while (Serial.available())
-    {
-      Serial.read();
-    }
-
-    if (input == 'm' || input == 'M' || input == '2')
+    return false;
+  }
+  if (input[0] == 'm' || input[0] == 'M' || input[0] == '2')
+  {
+    Serial.println("\n=== INTERROMPENDO MODO AUTOMÁTICO ===");
+    if (sweepActive())
     {
-      Serial.println("\n=== INTERROMPENDO MODO AUTOMÁTICO ===");
-      autoRestart = false;
-      staticMode = true;
-      EEPROM.write(EEPROM_MODE_ADDR, 1);
-      EEPROM.commit();
-      Serial.println("Modo estático ativado!");
-      showMenu();
-      return true;
+      sweepAbort();
+      configLoad();
+      Serial.println("Varredura cancelada.");
     }
+    autoRestart = false;
+    staticMode = true;
+    multiAdvMode = false;
+    rotationTimerStop();
+    pipelineStop();
+    pipelineLock();
+    hotScheduler.end();
+    pipelineUnlock();
+    basePayload = *sensorPayload;
+    sensorPayload = &basePayload;
+    config.mode = MODE_STATIC;
+    configSave();
+    consoleSetKeyMode(false);
+    Serial.println("Modo estático ativado!");
+    showMenu();
+    return true;
   }
   return false;
 }
 
 void loop()
 {
+#ifdef PHANTOM_ROLE_RECEIVER
+  receiverLoop();
+  return;
+#endif
+
+  ConsoleLine line;
+  processProtocolFrames();
+  followFleet();
+
   if (staticMode)
   {
-    processMenuCommand();
-    delay(100);
+    while (consoleReceive(line))
+    {
+      processMenuCommand(line.text);
+    }
+    if (traceActive())
+    {
+      replayTrace(millis());
+    }
+    else
+    {
+      updateSignal(millis());
+    }
+    uint32_t wait = traceActive() ? 1 : powerIdleWaitMs(10, 1000 / config.signalRateHz);
+    if (consoleReceive(line, pdMS_TO_TICKS(wait)))
+    {
+      processMenuCommand(line.text);
+    }
   }
   else
   {
     unsigned long currentTime = millis();
 
-    if (currentTime - lastMenuCheck >= MENU_CHECK_INTERVAL)
+    while (consoleReceive(line))
     {
-      if (checkForMenuRequest())
+      if (checkForMenuRequest(line.text))
       {
         return;
       }
-      lastMenuCheck = currentTime;
     }
 
-    unsigned long timeUntilRestart = restartInterval - (currentTime % restartInterval);
-    if (timeUntilRestart <= 1000 && timeUntilRestart > 900)
+    if (sweepActive() && sweepStepDue())
+    {
+      LOG_INFO("\n=== VARREDURA: FIM DO PASSO %d ===\n", sweepStepIndex() + 1);
+      sweepAdvance();
+      logFlush(LOG_FLUSH_MS);
+      esp_restart();
+    }
+
+    if (multiAdvMode)
+    {
+      multiAdvLoop(currentTime);
+      delay(10);
+      return;
+    }
+
+    if (config.hotRotation)
+    {
+      if (rotationTimerWait(pdMS_TO_TICKS(powerIdleWaitMs(5, 1000 / config.signalRateHz))) &&
+          fleetAllowsRotation())
+      {
+        rotateIdentity();
+      }
+      updateSignal(millis());
+      return;
+    }
+
+    // With a sleep gap the cycle is dwell + gap; the deadline still lands
+    // on the same grid, and the dwell never runs longer than configured.
+    uint32_t sleepGap = powerSleepGapMs();
+    uint32_t cycle = config.restartInterval + sleepGap;
+    unsigned long timeUntilRestart = rotationRestartDelayMs(cycle);
+    if (timeUntilRestart > config.restartInterval)
+    {
+      timeUntilRestart = config.restartInterval;
+    }
+    if (timeUntilRestart > 900)
     {
-      Serial.printf("Reiniciando em %lu ms...\n", timeUntilRestart);
+      LOG_INFO("Reiniciando em %lu ms...\n", timeUntilRestart);
     }
 
-    vTaskDelay(pdMS_TO_TICKS(restartInterval));
-    Serial.println("\n=== INICIANDO RESTART ===");
+    unsigned long restartAt = currentTime + timeUntilRestart;
+    bool earlyRestart = false;
+    long remaining;
+    while ((remaining = (long)(restartAt - millis())) > 0)
+    {
+      uint32_t wait = powerIdleWaitMs(10, remaining);
+      if (consoleReceive(line, pdMS_TO_TICKS(wait < (uint32_t)remaining ? wait : remaining)) &&
+          checkForMenuRequest(line.text))
+      {
+        return;
+      }
+      processProtocolFrames();
+      followFleet();
+      if (!fleetAllowsRotation())
+      {
+        restartAt = millis() + timeUntilRestart;
+      }
+      else if (fleetWaiting)
+      {
+        restartAt = millis();
+      }
+      if (dwellTargetReached)
+      {
+        dwellTargetReached = false;
+        unsigned long earliest = dwellStartedAt + config.minDwellMs;
+        if ((long)(restartAt - earliest) > 0)
+        {
+          restartAt = earliest;
+          earlyRestart = true;
+        }
+      }
+    }
+    LOG_DEBUG("\n=== INICIANDO RESTART ===\n");
+    logFlush(LOG_FLUSH_MS);
+    if (earlyRestart)
+    {
+      telemetryCount(TELEMETRY_EARLY_ROTATIONS);
+      rotationRestartEarly(cycle);
+    }
+    else
+    {
+      rotationRestartCommit(cycle);
+    }
+    sweepBeforeRestart();
+    syncPulse();
+    telemetryCount(TELEMETRY_ROTATIONS);
+    if (sleepGap > 0)
+    {
+      advertiserStop();
+      powerDeepSleep(sleepGap);
+    }
     esp_restart();
   }
 }
@@ -0,0 +1,234 @@
+#include "multi_adv.h"
+
+#include <Arduino.h>
+#include "adv_payload.h"
+#include "log.h"
+#include "scheduler.h"
+#include "sync_line.h"
+#include "telemetry.h"
+
+#if defined(CONFIG_BT_CTRL_BLE_MAX_ACT) && CONFIG_BT_CTRL_BLE_MAX_ACT > 1
+#define MULTI_ADV_HW_SETS (CONFIG_BT_CTRL_BLE_MAX_ACT - 1)
+#else
+#define MULTI_ADV_HW_SETS 4
+#endif
+
+#define MULTI_ADV_HOST_SETS 10
+
+static SimulatedSensor sensors[MULTI_ADV_MAX_SENSORS];
+static uint8_t sensorCount = 0;
+static uint8_t hwSets = 0;
+static unsigned long sliceDwell = 0;
+
+static uint8_t sensorBpm(const SimulatedSensor &s)
+{
+  return identityBpm(s.identity, s.signal.bpm);
+}
+
+static uint8_t sensorBattery(const SimulatedSensor &s)
+{
+  return identityBattery(s.identity, s.signal.battery);
+}
+
+// BLEMultiAdvertising belongs to the Bluedroid library; NimBLE builds fall
+// back to single-identity advertising.
+#if defined(SOC_BLE_50_SUPPORTED) && !defined(PHANTOM_BLE_NIMBLE)
+
+#include <BLEDevice.h>
+#include <BLEAdvertising.h>
+
+static BLEMultiAdvertising *multiAdv = nullptr;
+static uint8_t slotSensor[MULTI_ADV_HOST_SETS];
+static SensorPayload slotPayload[MULTI_ADV_HOST_SETS];
+static IdentityScheduler slotScheduler;
+static unsigned long lastSlice = 0;
+static unsigned long lastUpdate = 0;
+static unsigned long updateInterval = MULTI_ADV_UPDATE_MS;
+
+static bool configureSlot(uint8_t slot, const SimulatedSensor &s)
+{
+  esp_ble_gap_ext_adv_params_t params;
+  memset(&params, 0, sizeof(params));
+  params.type = ESP_BLE_GAP_SET_EXT_ADV_PROP_LEGACY_IND;
+  params.interval_min = (s.intervalMs * 1000UL) / 625;
+  params.interval_max = params.interval_min + 16;
+  params.channel_map = ADV_CHNL_ALL;
+  params.own_addr_type = BLE_ADDR_TYPE_RANDOM;
+  params.peer_addr_type = BLE_ADDR_TYPE_PUBLIC;
+  params.filter_policy = ADV_FILTER_ALLOW_SCAN_ANY_CON_ANY;
+  params.tx_power = EXT_ADV_TX_PWR_NO_PREFERENCE;
+  params.primary_phy = ESP_BLE_GAP_PRI_PHY_1M;
+  params.max_skip = 0;
+  params.secondary_phy = ESP_BLE_GAP_PHY_1M;
+  params.sid = slot;
+  params.scan_req_notif = false;
+
+  SensorPayload &payload = slotPayload[slot];
+  payload.build(s.profile, s.name, sensorBpm(s), sensorBattery(s));
+  uint8_t addr[6];
+  memcpy(addr, s.addr, 6);
+
+  return multiAdv->setAdvertisingParams(slot, &params) &&
+         multiAdv->setInstanceAddress(slot, addr) &&
+         multiAdv->setAdvertisingData(slot, payload.adv.length(), payload.adv.data()) &&
+         multiAdv->setScanRspData(slot, payload.scanRsp.length(), payload.scanRsp.data());
+}
+
+static void refreshSlotData(uint8_t slot)
+{
+  const SimulatedSensor &s = sensors[slotSensor[slot]];
+  SensorPayload &payload = slotPayload[slot];
+  payload.setBpm(sensorBpm(s));
+  payload.setBattery(sensorBattery(s));
+  multiAdv->setAdvertisingData(slot, payload.adv.length(), payload.adv.data());
+}
+
+static void rotateSlots(unsigned long now)
+{
+  syncPulse();
+  telemetryCount(TELEMETRY_ROTATIONS);
+  for (uint8_t slot = 0; slot < hwSets; slot++)
+  {
+    uint8_t instance = slot;
+    multiAdv->stop(1, &instance);
+    slotSensor[slot] = slotScheduler.next(now, slotSensor, hwSets);
+    configureSlot(slot, sensors[slotSensor[slot]]);
+    multiAdv->start(1, slot);
+    telemetryCount(TELEMETRY_ADV_STARTS);
+  }
+}
+
+bool multiAdvSupported()
+{
+  return true;
+}
+
+uint8_t multiAdvHardwareSets()
+{
+  return MULTI_ADV_HW_SETS < MULTI_ADV_HOST_SETS ? MULTI_ADV_HW_SETS : MULTI_ADV_HOST_SETS;
+}
+
+bool multiAdvBegin(const SimulatedSensor *initial, uint8_t count, unsigned long dwellMs,
+                   unsigned long updateMs)
+{
+  if (count == 0)
+  {
+    return false;
+  }
+  if (count > MULTI_ADV_MAX_SENSORS)
+  {
+    count = MULTI_ADV_MAX_SENSORS;
+  }
+
+  memcpy(sensors, initial, count * sizeof(SimulatedSensor));
+  sensorCount = count;
+  hwSets = count < multiAdvHardwareSets() ? count : multiAdvHardwareSets();
+  sliceDwell = dwellMs;
+  updateInterval = updateMs;
+
+  unsigned long now = millis();
+  slotScheduler.begin(sensorCount, sliceDwell / hwSets, now, esp_random());
+  for (uint8_t i = 0; i < sensorCount; i++)
+  {
+    slotScheduler.setProfile(i, 0, 0, false, sensors[i].weight);
+  }
+
+  multiAdv = new BLEMultiAdvertising(hwSets);
+  for (uint8_t slot = 0; slot < hwSets; slot++)
+  {
+    slotSensor[slot] = slotScheduler.next(now, slotSensor, slot);
+    if (!configureSlot(slot, sensors[slotSensor[slot]]))
+    {
+      LOG_ERROR("Falha ao configurar conjunto de advertising %d\n", slot);
+      return false;
+    }
+  }
+
+  if (!multiAdv->start())
+  {
+    LOG_ERROR("Falha ao iniciar advertising estendido\n");
+    return false;
+  }
+
+  lastSlice = millis();
+  lastUpdate = lastSlice;
+  return true;
+}
+
+void multiAdvLoop(unsigned long now)
+{
+  if (multiAdv == nullptr)
+  {
+    return;
+  }
+
+  if (sensorCount > hwSets && now - lastSlice >= sliceDwell)
+  {
+    lastSlice = now;
+    rotateSlots(now);
+  }
+
+  if (now - lastUpdate >= updateInterval)
+  {
+    unsigned long elapsed = now - lastUpdate;
+    lastUpdate = now;
+    for (uint8_t i = 0; i < sensorCount; i++)
+    {
+      signalAdvance(sensors[i].signal, elapsed);
+    }
+    for (uint8_t slot = 0; slot < hwSets; slot++)
+    {
+      refreshSlotData(slot);
+    }
+  }
+}
+
+#else
+
+bool multiAdvSupported()
+{
+  return false;
+}
+
+uint8_t multiAdvHardwareSets()
+{
+  return 0;
+}
+
+bool multiAdvBegin(const SimulatedSensor *initial, uint8_t count, unsigned long dwellMs,
+                   unsigned long updateMs)
+{
+  (void)initial;
+  (void)count;
+  (void)dwellMs;
+  (void)updateMs;
+  return false;
+}
+
+void multiAdvLoop(unsigned long now)
+{
+  (void)now;
+}
+
+#endif
+
+uint8_t multiAdvSensorCount()
+{
+  return sensorCount;
+}
+
+void multiAdvPrintStatus()
+{
+  Serial.printf("Sensores simulados: %d (conjuntos simultâneos: %d)\n", sensorCount, hwSets);
+  if (sensorCount > hwSets)
+  {
+    Serial.printf("Troca de sensores nos conjuntos a cada %lu ms\n", sliceDwell);
+  }
+  for (uint8_t i = 0; i < sensorCount; i++)
+  {
+    const SimulatedSensor &s = sensors[i];
+    Serial.printf("  %02d: %02X:%02X:%02X:%02X:%02X:%02X | %u ms | BPM %d | Bateria %d%%\n", i,
+                  s.addr[0], s.addr[1], s.addr[2], s.addr[3], s.addr[4], s.addr[5],
+                  s.intervalMs, sensorBpm(s), sensorBattery(s));
+  }
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <stdint.h>
+#include "adv_payload.h"
+#include "identity_table.h"
+#include "signal_model.h"
+
+#ifdef PHANTOM_MEMORY_BUDGET
+#define MULTI_ADV_MAX_SENSORS 128
+#else
+#define MULTI_ADV_MAX_SENSORS 64
+#endif
+#define MULTI_ADV_MIN_INTERVAL 20
+#define MULTI_ADV_MAX_INTERVAL 10240
+#define MULTI_ADV_UPDATE_MS 1000
+
+// signal runs the generator; identity maps it onto the entry's own BPM
+// baseline and battery before it goes on air.
+struct SimulatedSensor
+{
+  IdentityEntry identity;
+  uint8_t addr[6];
+  char name[SENSOR_NAME_MAX + 1];
+  SignalState signal;
+  uint16_t intervalMs;
+  uint8_t weight;
+  uint8_t profile;
+};
+
+bool multiAdvSupported();
+uint8_t multiAdvHardwareSets();
+uint8_t multiAdvSensorCount();
+bool multiAdvBegin(const SimulatedSensor *sensors, uint8_t count, unsigned long dwellMs,
+                   unsigned long updateMs);
+void multiAdvLoop(unsigned long now);
+void multiAdvPrintStatus();
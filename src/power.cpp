@@ -0,0 +1,168 @@
+#include "power.h"
+
+#include <Arduino.h>
+#include "esp_sleep.h"
+#include "driver/uart.h"
+#include "multi_adv.h"
+#ifdef CONFIG_PM_ENABLE
+#include "esp_pm.h"
+#endif
+
+// Typical ESP32 figures at 3.3 V with the BLE controller enabled. They turn
+// the mode's duty cycle into an estimate; they are not a measurement.
+#define CURRENT_ACTIVE_240_UA 48000
+#define CURRENT_ACTIVE_80_UA 25000
+#define CURRENT_LIGHT_SLEEP_UA 1100
+#define CURRENT_DEEP_SLEEP_UA 10
+#define ADV_EVENT_CHARGE_UC 160
+#define ADV_EVENT_WAKE_UC 50
+#define SINGLE_ADV_INTERVAL_MS 35
+
+static uint8_t activeProfile = POWER_PROFILE_PERFORMANCE;
+static bool lightSleep = false;
+
+bool powerBegin(uint8_t profile)
+{
+  activeProfile = profile < POWER_PROFILE_COUNT ? profile : (uint8_t)POWER_PROFILE_PERFORMANCE;
+  if (activeProfile != POWER_PROFILE_LOW)
+  {
+    return false;
+  }
+
+  setCpuFrequencyMhz(POWER_MAX_FREQ_MHZ);
+  uart_set_wakeup_threshold(UART_NUM_0, POWER_UART_WAKE_EDGES);
+  esp_sleep_enable_uart_wakeup(UART_NUM_0);
+
+#ifdef CONFIG_PM_ENABLE
+#if CONFIG_IDF_TARGET_ESP32C3
+  esp_pm_config_esp32c3_t pm;
+#elif CONFIG_IDF_TARGET_ESP32S3
+  esp_pm_config_esp32s3_t pm;
+#else
+  esp_pm_config_esp32_t pm;
+#endif
+  pm.max_freq_mhz = POWER_MAX_FREQ_MHZ;
+  pm.min_freq_mhz = POWER_MIN_FREQ_MHZ;
+#ifdef CONFIG_FREERTOS_USE_TICKLESS_IDLE
+  pm.light_sleep_enable = true;
+#else
+  pm.light_sleep_enable = false;
+#endif
+  lightSleep = esp_pm_configure(&pm) == ESP_OK && pm.light_sleep_enable;
+#endif
+  return lightSleep;
+}
+
+bool powerLowActive()
+{
+  return activeProfile == POWER_PROFILE_LOW;
+}
+
+bool powerLightSleepActive()
+{
+  return lightSleep;
+}
+
+// How long a loop may block: the short busy poll in the performance
+// profile, otherwise up to the next scheduled event.
+uint32_t powerIdleWaitMs(uint32_t busyWaitMs, uint32_t nextEventMs)
+{
+  if (!powerLowActive())
+  {
+    return busyWaitMs;
+  }
+  return nextEventMs < POWER_IDLE_WAIT_MS ? nextEventMs : POWER_IDLE_WAIT_MS;
+}
+
+uint32_t powerSleepGapMs()
+{
+  return powerLowActive() ? config.sleepGapMs : 0;
+}
+
+// A timer wake boots like esp_restart(); cycle state and deadlines live in
+// RTC memory and survive it.
+void powerDeepSleep(uint32_t gapMs)
+{
+  Serial.flush();
+  esp_sleep_enable_timer_wakeup((uint64_t)gapMs * 1000);
+  esp_deep_sleep_start();
+}
+
+// Only the hardware sets are on air at once; the rest wait for a slice.
+static uint32_t advEventsPerSecondX100(uint8_t mode, const DeviceConfig &cfg)
+{
+  uint8_t sets = cfg.multiAdvCount < multiAdvHardwareSets() ? cfg.multiAdvCount : multiAdvHardwareSets();
+  if (mode == MODE_MULTI_ADV && sets > 0)
+  {
+    return 100000UL * sets / cfg.multiAdvInterval;
+  }
+  return 100000UL / SINGLE_ADV_INTERVAL_MS;
+}
+
+// Whether the low profile sleeps between events: what powerBegin() got
+// when it is running, otherwise what this build could get.
+static bool lowProfileSleeps()
+{
+  if (powerLowActive())
+  {
+    return lightSleep;
+  }
+#if defined(CONFIG_PM_ENABLE) && defined(CONFIG_FREERTOS_USE_TICKLESS_IDLE)
+  return true;
+#else
+  return false;
+#endif
+}
+
+// Average over one cycle: always-on modes are a base current (light sleep
+// or an 80 MHz idle CPU in the low profile) plus the charge of each
+// advertising event; the reboot mode adds a full-speed boot
+// per identity and, in the low profile, a deep-sleep gap.
+uint32_t powerEstimateUa(uint8_t mode, const DeviceConfig &cfg, uint32_t bootMs)
+{
+  bool low = cfg.powerProfile == POWER_PROFILE_LOW;
+  bool sleeps = low && lowProfileSleeps();
+  uint32_t baseUa = sleeps ? CURRENT_LIGHT_SLEEP_UA : low ? CURRENT_ACTIVE_80_UA : CURRENT_ACTIVE_240_UA;
+  uint32_t eventUc = sleeps ? ADV_EVENT_CHARGE_UC + ADV_EVENT_WAKE_UC : ADV_EVENT_CHARGE_UC;
+  uint32_t onAirUa = baseUa + advEventsPerSecondX100(mode, cfg) * eventUc / 100;
+
+  bool reboots = (mode == MODE_AUTO_LIST || mode == MODE_AUTO_RANDOM) && !cfg.hotRotation;
+  if (!reboots)
+  {
+    return onAirUa;
+  }
+
+  uint32_t gapMs = low ? cfg.sleepGapMs : 0;
+  uint64_t charge = (uint64_t)bootMs * CURRENT_ACTIVE_240_UA + (uint64_t)cfg.restartInterval * onAirUa +
+                    (uint64_t)gapMs * CURRENT_DEEP_SLEEP_UA;
+  return (uint32_t)(charge / (bootMs + cfg.restartInterval + gapMs));
+}
+
+void powerPrintEstimates(const DeviceConfig &cfg, uint32_t bootMs)
+{
+  static const uint8_t modes[] = {MODE_STATIC, MODE_AUTO_LIST, MODE_AUTO_RANDOM, MODE_MULTI_ADV};
+  static const char *names[] = {"estático", "automático com lista", "automático randômico", "multi-sensor"};
+
+  Serial.printf("Consumo médio estimado (perfil %s, boot %lu ms):\n", powerProfileName(cfg.powerProfile),
+                (unsigned long)bootMs);
+  for (size_t i = 0; i < sizeof(modes); i++)
+  {
+    uint32_t ua = powerEstimateUa(modes[i], cfg, bootMs);
+    Serial.printf("  %-22s %6.1f mA | ~%lu h com %d mAh%s\n", names[i], ua / 1000.0,
+                  (unsigned long)(POWER_BATTERY_MAH * 1000UL / (ua > 0 ? ua : 1)), POWER_BATTERY_MAH,
+                  modes[i] == cfg.mode ? " (atual)" : "");
+  }
+}
+
+const char *powerProfileName(uint8_t profile)
+{
+  switch (profile)
+  {
+  case POWER_PROFILE_PERFORMANCE:
+    return "desempenho";
+  case POWER_PROFILE_LOW:
+    return "baixo consumo";
+  default:
+    return "desconhecido";
+  }
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <stdint.h>
+#include "config.h"
+
+#define POWER_MAX_FREQ_MHZ 80
+#define POWER_MIN_FREQ_MHZ 40
+#define POWER_IDLE_WAIT_MS 250
+#define POWER_MAX_SLEEP_GAP_MS 60000
+#define POWER_UART_WAKE_EDGES 3
+#define POWER_BATTERY_MAH 1000
+
+enum PowerProfile
+{
+  POWER_PROFILE_PERFORMANCE = 0,
+  POWER_PROFILE_LOW = 1,
+  POWER_PROFILE_COUNT
+};
+
+// The low profile caps the CPU at 80 MHz (the BLE floor), lets esp_pm scale
+// down to 40 MHz and light-sleep between advertising events, and wakes on
+// UART activity. Light sleep needs CONFIG_PM_ENABLE and tickless idle in
+// the SDK build; without them only the clock cap applies.
+bool powerBegin(uint8_t profile);
+bool powerLowActive();
+bool powerLightSleepActive();
+uint32_t powerIdleWaitMs(uint32_t busyWaitMs, uint32_t nextEventMs);
+uint32_t powerSleepGapMs();
+void powerDeepSleep(uint32_t gapMs) __attribute__((noreturn));
+
+uint32_t powerEstimateUa(uint8_t mode, const DeviceConfig &cfg, uint32_t bootMs);
+void powerPrintEstimates(const DeviceConfig &cfg, uint32_t bootMs);
+const char *powerProfileName(uint8_t profile);
@@ -0,0 +1,84 @@
+#include "protocol.h"
+
+#include <string.h>
+#include "crc.h"
+
+void ProtocolParser::reset()
+{
+  state = STATE_SOF;
+  received = 0;
+  crc = 0xFFFF;
+  expectedCrc = 0;
+  current.opcode = 0;
+  current.length = 0;
+}
+
+ProtocolParseResult ProtocolParser::feed(uint8_t byte)
+{
+  switch (state)
+  {
+  case STATE_SOF:
+    if (byte == PROTOCOL_SOF)
+    {
+      reset();
+      state = STATE_LENGTH_LOW;
+    }
+    return PROTOCOL_PARSE_PENDING;
+
+  case STATE_LENGTH_LOW:
+    current.length = byte;
+    crc = crc16Ccitt(&byte, 1, crc);
+    state = STATE_LENGTH_HIGH;
+    return PROTOCOL_PARSE_PENDING;
+
+  case STATE_LENGTH_HIGH:
+    current.length |= (uint16_t)byte << 8;
+    crc = crc16Ccitt(&byte, 1, crc);
+    if (current.length > PROTOCOL_MAX_PAYLOAD)
+    {
+      reset();
+      return PROTOCOL_PARSE_TOO_LONG;
+    }
+    state = STATE_OPCODE;
+    return PROTOCOL_PARSE_PENDING;
+
+  case STATE_OPCODE:
+    current.opcode = byte;
+    crc = crc16Ccitt(&byte, 1, crc);
+    state = current.length > 0 ? STATE_PAYLOAD : STATE_CRC_LOW;
+    return PROTOCOL_PARSE_PENDING;
+
+  case STATE_PAYLOAD:
+    current.payload[received++] = byte;
+    crc = crc16Ccitt(&byte, 1, crc);
+    if (received == current.length)
+    {
+      state = STATE_CRC_LOW;
+    }
+    return PROTOCOL_PARSE_PENDING;
+
+  case STATE_CRC_LOW:
+    expectedCrc = byte;
+    state = STATE_CRC_HIGH;
+    return PROTOCOL_PARSE_PENDING;
+
+  default:
+    expectedCrc |= (uint16_t)byte << 8;
+    state = STATE_SOF;
+    return expectedCrc == crc ? PROTOCOL_PARSE_FRAME : PROTOCOL_PARSE_BAD_CRC;
+  }
+}
+
+size_t protocolEncode(uint8_t opcode, const uint8_t *payload, uint16_t length, uint8_t *out)
+{
+  out[0] = PROTOCOL_SOF;
+  protocolPutU16(&out[1], length);
+  out[3] = opcode;
+  if (length > 0)
+  {
+    memcpy(&out[4], payload, length);
+  }
+  uint16_t crc = crc16Ccitt(&out[1], length + 3);
+  protocolPutU16(&out[4 + length], crc);
+  return length + PROTOCOL_OVERHEAD;
+}
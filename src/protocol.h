@@ -0,0 +1,119 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Frame: SOF | length (u16 LE) | opcode | payload[length] | CRC-16/CCITT (u16 LE).
+// The CRC covers the length, opcode and payload bytes. Replies reuse the
+// request opcode with PROTOCOL_REPLY_FLAG set and start with a status byte.
+#define PROTOCOL_SOF 0xA5
+#define PROTOCOL_REPLY_FLAG 0x80
+#define PROTOCOL_MAX_PAYLOAD 600
+#define PROTOCOL_OVERHEAD 6
+#define PROTOCOL_VERSION 1
+
+enum ProtocolOpcode
+{
+  PROTOCOL_OP_PING = 0x01,
+  PROTOCOL_OP_LOAD_IDENTITIES = 0x02,
+  PROTOCOL_OP_SET_INTERVAL = 0x03,
+  PROTOCOL_OP_SET_SIGNAL_MODEL = 0x04,
+  PROTOCOL_OP_GET_COUNTERS = 0x05,
+  PROTOCOL_OP_SET_MODE = 0x06,
+  PROTOCOL_OP_SET_NOTIFY_RATE = 0x07,
+  PROTOCOL_OP_IDENTITY_BEGIN = 0x08,
+  PROTOCOL_OP_IDENTITY_WRITE = 0x09,
+  PROTOCOL_OP_IDENTITY_COMMIT = 0x0A,
+  PROTOCOL_OP_SET_MAC_SEED = 0x0B,
+  PROTOCOL_OP_GET_TELEMETRY = 0x0C,
+  PROTOCOL_OP_SET_CONN_PARAMS = 0x0D,
+  PROTOCOL_OP_TRACE_BEGIN = 0x0E,
+  PROTOCOL_OP_TRACE_WRITE = 0x0F,
+  PROTOCOL_OP_TRACE_COMMIT = 0x10,
+  PROTOCOL_OP_TRACE_PLAY = 0x11,
+  PROTOCOL_OP_CONFIG_READ = 0x12,
+  PROTOCOL_OP_CONFIG_WRITE = 0x13,
+  PROTOCOL_OP_FLEET_CONTROL = 0x14,
+  PROTOCOL_OP_BATCH = 0x7F,
+  PROTOCOL_OP_ERROR = 0xFF
+};
+
+enum ProtocolStatus
+{
+  PROTOCOL_STATUS_OK = 0,
+  PROTOCOL_STATUS_BAD_LENGTH = 1,
+  PROTOCOL_STATUS_BAD_VALUE = 2,
+  PROTOCOL_STATUS_UNKNOWN_OPCODE = 3,
+  PROTOCOL_STATUS_STORAGE_ERROR = 4,
+  PROTOCOL_STATUS_BAD_CRC = 5,
+  PROTOCOL_STATUS_TOO_LONG = 6,
+  PROTOCOL_STATUS_BUSY = 7
+};
+
+struct ProtocolFrame
+{
+  uint8_t opcode;
+  uint16_t length;
+  uint8_t payload[PROTOCOL_MAX_PAYLOAD];
+};
+
+enum ProtocolParseResult
+{
+  PROTOCOL_PARSE_PENDING,
+  PROTOCOL_PARSE_FRAME,
+  PROTOCOL_PARSE_BAD_CRC,
+  PROTOCOL_PARSE_TOO_LONG
+};
+
+class ProtocolParser
+{
+public:
+  ProtocolParser() { reset(); }
+
+  void reset();
+  bool active() const { return state != STATE_SOF; }
+  ProtocolParseResult feed(uint8_t byte);
+  const ProtocolFrame &frame() const { return current; }
+
+private:
+  enum State
+  {
+    STATE_SOF,
+    STATE_LENGTH_LOW,
+    STATE_LENGTH_HIGH,
+    STATE_OPCODE,
+    STATE_PAYLOAD,
+    STATE_CRC_LOW,
+    STATE_CRC_HIGH
+  };
+
+  State state;
+  uint16_t received;
+  uint16_t crc;
+  uint16_t expectedCrc;
+  ProtocolFrame current;
+};
+
+size_t protocolEncode(uint8_t opcode, const uint8_t *payload, uint16_t length, uint8_t *out);
+
+inline void protocolPutU16(uint8_t *out, uint16_t value)
+{
+  out[0] = value & 0xFF;
+  out[1] = value >> 8;
+}
+
+inline void protocolPutU32(uint8_t *out, uint32_t value)
+{
+  protocolPutU16(out, value & 0xFFFF);
+  protocolPutU16(out + 2, value >> 16);
+}
+
+inline uint16_t protocolGetU16(const uint8_t *in)
+{
+  return (uint16_t)(in[0] | (in[1] << 8));
+}
+
+inline uint32_t protocolGetU32(const uint8_t *in)
+{
+  return protocolGetU16(in) | ((uint32_t)protocolGetU16(in + 2) << 16);
+}
@@ -0,0 +1,319 @@
+#include "receiver.h"
+
+#ifndef PHANTOM_BLE_NIMBLE
+
+#include <Arduino.h>
+#include <BLEDevice.h>
+#include <BLEScan.h>
+#include <BLEAdvertisedDevice.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "adv_payload.h"
+#include "sync_line.h"
+#include "sweep.h"
+
+#define SCAN_INTERVAL_MS 100
+#define SCAN_WINDOW_MS 100
+#define ADV_DELAY_MEAN_US 5000
+
+struct ScanEvent
+{
+  uint32_t timeUs;
+  uint8_t addr[6];
+  int8_t rssi;
+  uint8_t bpm;
+  uint8_t battery;
+};
+
+struct IdentityRow
+{
+  uint8_t addr[6];
+  bool used;
+  uint32_t syncUs;
+  uint32_t syncIndex;
+  uint32_t firstUs;
+  uint32_t lastUs;
+  uint32_t packets;
+  int32_t rssiSum;
+  int8_t rssiMin;
+  int8_t rssiMax;
+  uint8_t bpmMin;
+  uint8_t bpmMax;
+  uint8_t bpm;
+  uint8_t battery;
+};
+
+static QueueHandle_t scanQueue = nullptr;
+static IdentityRow rows[RECEIVER_MAX_ROWS];
+struct StepTotals
+{
+  uint32_t startUs;
+  uint32_t identities;
+  uint32_t packets;
+  uint32_t expected;
+  uint64_t visibleUs;
+  uint32_t dropped;
+};
+
+static StepTotals stepTotals;
+static uint32_t seenBoundaries = 0;
+static int sweepStep = -1;
+static volatile uint32_t droppedEvents = 0;
+static volatile uint32_t ignoredPackets = 0;
+static uint32_t rowsEmitted = 0;
+
+class ScanCallbacks : public BLEAdvertisedDeviceCallbacks
+{
+  void onResult(BLEAdvertisedDevice device)
+  {
+    ScanEvent event;
+    event.timeUs = micros();
+    size_t length = device.getPayloadLength();
+    if (!sensorPayloadDecode(device.getPayload(), length > 255 ? 255 : length, event.bpm, event.battery))
+    {
+      ignoredPackets++;
+      return;
+    }
+    memcpy(event.addr, *device.getAddress().getNative(), 6);
+    event.rssi = device.getRSSI();
+    if (xQueueSend(scanQueue, &event, 0) != pdTRUE)
+    {
+      droppedEvents++;
+    }
+  }
+};
+
+static ScanCallbacks scanCallbacks;
+
+static void printHeader()
+{
+  Serial.println("mac,sync_index,sync_us,first_us,last_us,latency_ms,packets,pps,"
+                 "rssi_min,rssi_max,rssi_avg,bpm_min,bpm_max,bpm,battery");
+}
+
+static void emitRow(IdentityRow &row)
+{
+  uint32_t spanUs = row.lastUs - row.firstUs;
+  float pps = spanUs > 0 ? (row.packets - 1) * 1e6f / spanUs : 0.0f;
+
+  Serial.printf("%02X:%02X:%02X:%02X:%02X:%02X,", row.addr[0], row.addr[1], row.addr[2],
+                row.addr[3], row.addr[4], row.addr[5]);
+  if (row.syncIndex > 0)
+  {
+    Serial.printf("%lu,%lu,%lu,%lu,%.3f,", (unsigned long)row.syncIndex, (unsigned long)row.syncUs,
+                  (unsigned long)row.firstUs, (unsigned long)row.lastUs, (row.firstUs - row.syncUs) / 1000.0f);
+  }
+  else
+  {
+    Serial.printf(",,%lu,%lu,,", (unsigned long)row.firstUs, (unsigned long)row.lastUs);
+  }
+  Serial.printf("%lu,%.1f,%d,%d,%.1f,%d,%d,%d,%d\n", (unsigned long)row.packets, pps, row.rssiMin, row.rssiMax,
+                (float)row.rssiSum / row.packets, row.bpmMin, row.bpmMax, row.bpm, row.battery);
+  if (sweepStep >= 0)
+  {
+    uint32_t periodUs = sweepPlan[sweepStep].advIntervalMs * 1000UL + ADV_DELAY_MEAN_US;
+    stepTotals.identities++;
+    stepTotals.packets += row.packets;
+    stepTotals.expected += spanUs / periodUs + 1;
+    stepTotals.visibleUs += spanUs + periodUs;
+  }
+  row.used = false;
+  rowsEmitted++;
+}
+
+static IdentityRow *findRow(const uint8_t *addr)
+{
+  IdentityRow *freeRow = nullptr;
+  IdentityRow *oldest = nullptr;
+  for (int i = 0; i < RECEIVER_MAX_ROWS; i++)
+  {
+    IdentityRow &row = rows[i];
+    if (!row.used)
+    {
+      if (freeRow == nullptr)
+      {
+        freeRow = &row;
+      }
+      continue;
+    }
+    if (memcmp(row.addr, addr, 6) == 0)
+    {
+      return &row;
+    }
+    if (oldest == nullptr || (int32_t)(row.lastUs - oldest->lastUs) < 0)
+    {
+      oldest = &row;
+    }
+  }
+  if (freeRow == nullptr)
+  {
+    emitRow(*oldest);
+    freeRow = oldest;
+  }
+  return freeRow;
+}
+
+static void recordEvent(const ScanEvent &event)
+{
+  IdentityRow *row = findRow(event.addr);
+  if (!row->used)
+  {
+    memset(row, 0, sizeof(*row));
+    memcpy(row->addr, event.addr, 6);
+    row->used = true;
+    row->firstUs = event.timeUs;
+    row->rssiMin = event.rssi;
+    row->rssiMax = event.rssi;
+    row->bpmMin = event.bpm;
+    row->bpmMax = event.bpm;
+
+    uint32_t count;
+    uint32_t edgeUs;
+    do
+    {
+      count = syncEdgeCount();
+      edgeUs = syncLastEdgeUs();
+    } while (count != syncEdgeCount());
+    if (count > 0 && (int32_t)(event.timeUs - edgeUs) >= 0)
+    {
+      row->syncIndex = count;
+      row->syncUs = edgeUs;
+    }
+  }
+
+  row->lastUs = event.timeUs;
+  row->packets++;
+  row->rssiSum += event.rssi;
+  if (event.rssi < row->rssiMin)
+    row->rssiMin = event.rssi;
+  if (event.rssi > row->rssiMax)
+    row->rssiMax = event.rssi;
+  if (event.bpm < row->bpmMin)
+    row->bpmMin = event.bpm;
+  if (event.bpm > row->bpmMax)
+    row->bpmMax = event.bpm;
+  row->bpm = event.bpm;
+  row->battery = event.battery;
+}
+
+static void flushIdle(uint32_t nowUs)
+{
+  for (int i = 0; i < RECEIVER_MAX_ROWS; i++)
+  {
+    if (rows[i].used && nowUs - rows[i].lastUs >= RECEIVER_IDLE_MS * 1000UL)
+    {
+      emitRow(rows[i]);
+    }
+  }
+}
+
+static void printSweepHeader()
+{
+  Serial.println("sweep,step,adv_ms,dwell_ms,tx_dbm,layout,hot,duration_s,identities,ids_per_min,"
+                 "packets,expected,loss_pct,visible_pct,dropped");
+}
+
+static void closeSweepStep(uint32_t nowUs)
+{
+  for (int i = 0; i < RECEIVER_MAX_ROWS; i++)
+  {
+    if (rows[i].used)
+    {
+      emitRow(rows[i]);
+    }
+  }
+  if (sweepStep < 0)
+  {
+    return;
+  }
+
+  const SweepStep &step = sweepPlan[sweepStep];
+  float seconds = (nowUs - stepTotals.startUs) / 1e6f;
+  float loss = 0.0f;
+  if (stepTotals.expected > stepTotals.packets)
+  {
+    loss = (stepTotals.expected - stepTotals.packets) * 100.0f / stepTotals.expected;
+  }
+  float visible = seconds > 0 ? stepTotals.visibleUs / 1e4f / seconds : 0.0f;
+  Serial.printf("sweep,%d,%d,%d,%d,%d,%d,%.1f,%lu,%.1f,%lu,%lu,%.1f,%.1f,%lu\n", sweepStep, step.advIntervalMs,
+                step.dwellMs, step.txPowerDbm, step.layout, step.hotRotation, seconds,
+                (unsigned long)stepTotals.identities, seconds > 0 ? stepTotals.identities * 60.0f / seconds : 0.0f,
+                (unsigned long)stepTotals.packets, (unsigned long)stepTotals.expected, loss,
+                visible > 100.0f ? 100.0f : visible, (unsigned long)(droppedEvents - stepTotals.dropped));
+}
+
+// Each long pulse ends the running step and starts the next one, so the
+// receiver has to be listening before the transmitter starts the sweep.
+static void pollSweep()
+{
+  uint32_t boundaries = syncBoundaryCount();
+  if (boundaries == seenBoundaries)
+  {
+    return;
+  }
+  seenBoundaries = boundaries;
+  uint32_t edgeUs = syncLastBoundaryUs();
+
+  closeSweepStep(edgeUs);
+  if (sweepStep < 0)
+  {
+    printSweepHeader();
+  }
+  sweepStep++;
+  if (sweepStep >= (int)SWEEP_STEP_COUNT)
+  {
+    Serial.println("# varredura concluída");
+    sweepStep = -1;
+    return;
+  }
+  memset(&stepTotals, 0, sizeof(stepTotals));
+  stepTotals.startUs = edgeUs;
+  stepTotals.dropped = droppedEvents;
+}
+
+void receiverBegin()
+{
+  Serial.begin(115200);
+  memset(rows, 0, sizeof(rows));
+  scanQueue = xQueueCreate(RECEIVER_QUEUE_DEPTH, sizeof(ScanEvent));
+  syncInputBegin(SWEEP_BOUNDARY_MIN_US);
+
+  BLEDevice::init("");
+  BLEScan *scan = BLEDevice::getScan();
+  scan->setAdvertisedDeviceCallbacks(&scanCallbacks, true);
+  scan->setActiveScan(false);
+  scan->setInterval(SCAN_INTERVAL_MS);
+  scan->setWindow(SCAN_WINDOW_MS);
+  scan->start(0, nullptr, false);
+
+  Serial.printf("# PhantomFreq receptor | sync GPIO %d | inatividade %d ms\n", PHANTOM_SYNC_PIN, RECEIVER_IDLE_MS);
+  printHeader();
+}
+
+void receiverLoop()
+{
+  ScanEvent event;
+  while (xQueueReceive(scanQueue, &event, pdMS_TO_TICKS(10)) == pdTRUE)
+  {
+    recordEvent(event);
+  }
+  pollSweep();
+  flushIdle(micros());
+
+  static uint32_t lastReport = 0;
+  static uint32_t lastDropped = 0;
+  uint32_t now = millis();
+  if (now - lastReport >= 10000UL)
+  {
+    lastReport = now;
+    if (droppedEvents != lastDropped)
+    {
+      lastDropped = droppedEvents;
+      Serial.printf("# %lu linhas, %lu pacotes descartados (fila cheia), %lu pacotes de terceiros\n",
+                    (unsigned long)rowsEmitted, (unsigned long)droppedEvents, (unsigned long)ignoredPackets);
+    }
+  }
+}
+
+#endif
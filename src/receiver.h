@@ -0,0 +1,21 @@
+#pragma once
+
+#include <stdint.h>
+
+#if defined(PHANTOM_ROLE_RECEIVER) && defined(PHANTOM_BLE_NIMBLE)
+#error "the receiver role scans through the Bluedroid library; build it without PHANTOM_BLE_NIMBLE"
+#endif
+
+#ifndef RECEIVER_IDLE_MS
+#define RECEIVER_IDLE_MS 1500
+#endif
+
+#define RECEIVER_MAX_ROWS 64
+#define RECEIVER_QUEUE_DEPTH 64
+
+// Benchmark role built with -DPHANTOM_ROLE_RECEIVER: scans passively and
+// streams one CSV row per identity once it has been silent for
+// RECEIVER_IDLE_MS. Latency is measured from the last sync edge before the
+// identity's first packet.
+void receiverBegin();
+void receiverLoop();
@@ -0,0 +1,302 @@
+#include "rotation_timer.h"
+
+#include <Arduino.h>
+#include <sys/time.h>
+#include "esp_attr.h"
+#include "esp_timer.h"
+#include "freertos/task.h"
+#include "sync_line.h"
+#include "telemetry.h"
+
+#define RESTART_DEADLINE_MAGIC 0x50465244UL
+
+struct RestartDeadline
+{
+  uint32_t magic;
+  uint32_t periodMs;
+  int64_t wallUs;
+  uint32_t checkInverse;
+};
+
+RTC_NOINIT_ATTR static RestartDeadline restartDeadline;
+
+static esp_timer_handle_t timer = nullptr;
+static TaskHandle_t waiter = nullptr;
+static portMUX_TYPE timerMux = portMUX_INITIALIZER_UNLOCKED;
+static int64_t periodUs = 0;
+static int64_t nextDeadlineUs = 0;
+static int64_t firedDeadlineUs = 0;
+static uint32_t missed = 0;
+static uint32_t anchoredEdges = 0;
+static int32_t phaseErrorUs = 0;
+static uint8_t phaseMode = ROTATION_PHASE_FREE;
+static bool gridPending = false;
+static int64_t gridAnchorUs = 0;
+
+// Moves the deadline grid onto an anchor point at or before the deadline
+// that just fired.
+static void anchorGrid(int64_t edge)
+{
+  int64_t offset = (firedDeadlineUs - edge) % periodUs;
+  if (offset > periodUs / 2)
+    offset -= periodUs;
+  if (offset < -periodUs / 2)
+    offset += periodUs;
+  phaseErrorUs = (int32_t)offset;
+
+  // First grid point at least half a period past the deadline that just
+  // fired, so a late edge never produces a second rotation right away.
+  int64_t target = firedDeadlineUs + periodUs / 2 - edge;
+  nextDeadlineUs = edge + (target / periodUs + 1) * periodUs;
+}
+
+// The leader's latest edge is a 32-bit micros() stamp from the same timer,
+// widened against "now".
+static void followSyncEdge(int64_t now)
+{
+  uint32_t count = syncEdgeCount();
+  if (count == anchoredEdges)
+  {
+    return;
+  }
+  anchoredEdges = count;
+  anchorGrid(now - (int64_t)(uint32_t)((uint32_t)now - syncLastEdgeUs()));
+}
+
+// A fleet grid point may lie ahead of the deadline; it is stepped back by
+// whole periods first.
+static void followFleetGrid()
+{
+  gridPending = false;
+  int64_t anchor = gridAnchorUs;
+  if (anchor > firedDeadlineUs)
+  {
+    anchor -= ((anchor - firedDeadlineUs) / periodUs + 1) * periodUs;
+  }
+  anchorGrid(anchor);
+}
+
+static void armNext(int64_t now)
+{
+  if (nextDeadlineUs <= now)
+  {
+    int64_t behind = (now - nextDeadlineUs) / periodUs + 1;
+    missed += (uint32_t)behind;
+    nextDeadlineUs += behind * periodUs;
+  }
+  esp_timer_start_once(timer, (uint64_t)(nextDeadlineUs - now));
+}
+
+static void onDeadline(void *arg)
+{
+  (void)arg;
+  int64_t now = esp_timer_get_time();
+  portENTER_CRITICAL(&timerMux);
+  firedDeadlineUs = nextDeadlineUs;
+  nextDeadlineUs += periodUs;
+  if (phaseMode == ROTATION_PHASE_FOLLOWER)
+  {
+    followSyncEdge(now);
+  }
+  else if (gridPending)
+  {
+    followFleetGrid();
+  }
+  portEXIT_CRITICAL(&timerMux);
+  armNext(now);
+  xTaskNotifyGive(waiter);
+}
+
+bool rotationTimerBegin(uint32_t periodMs, uint8_t phase)
+{
+  if (timer == nullptr)
+  {
+    esp_timer_create_args_t args = {};
+    args.callback = onDeadline;
+    args.dispatch_method = ESP_TIMER_TASK;
+    args.name = "rotation";
+    if (esp_timer_create(&args, &timer) != ESP_OK)
+    {
+      return false;
+    }
+  }
+  esp_timer_stop(timer);
+  ulTaskNotifyTake(pdTRUE, 0);
+
+  waiter = xTaskGetCurrentTaskHandle();
+  phaseMode = phase;
+  periodUs = (int64_t)periodMs * 1000;
+  missed = 0;
+  phaseErrorUs = 0;
+  anchoredEdges = syncEdgeCount();
+  int64_t now = esp_timer_get_time();
+  firedDeadlineUs = now;
+  nextDeadlineUs = now + periodUs;
+  return esp_timer_start_once(timer, (uint64_t)periodUs) == ESP_OK;
+}
+
+void rotationTimerStop()
+{
+  if (timer != nullptr)
+  {
+    esp_timer_stop(timer);
+  }
+}
+
+// Takes effect from the next deadline on; the one already armed still fires.
+void rotationTimerSetPeriod(uint32_t periodMs)
+{
+  portENTER_CRITICAL(&timerMux);
+  if (periodUs > 0)
+  {
+    nextDeadlineUs += (int64_t)periodMs * 1000 - periodUs;
+  }
+  periodUs = (int64_t)periodMs * 1000;
+  portEXIT_CRITICAL(&timerMux);
+}
+
+void rotationTimerAnchor(int64_t gridUs)
+{
+  portENTER_CRITICAL(&timerMux);
+  gridAnchorUs = gridUs;
+  gridPending = true;
+  portEXIT_CRITICAL(&timerMux);
+}
+
+// The deadline is pulled in under the lock and the timer re-armed from
+// whatever is pending afterwards, so a deadline firing in between is
+// neither lost nor doubled. The grid then restarts from the early edge.
+bool rotationTimerCutShort(uint32_t minDwellMs)
+{
+  if (timer == nullptr || periodUs == 0)
+  {
+    return false;
+  }
+  int64_t now = esp_timer_get_time();
+  bool moved = false;
+  portENTER_CRITICAL(&timerMux);
+  int64_t target = firedDeadlineUs + (int64_t)minDwellMs * 1000;
+  if (target < now)
+  {
+    target = now;
+  }
+  if (target < nextDeadlineUs)
+  {
+    nextDeadlineUs = target;
+    moved = true;
+  }
+  portEXIT_CRITICAL(&timerMux);
+  if (!moved)
+  {
+    return false;
+  }
+  esp_timer_stop(timer);
+  portENTER_CRITICAL(&timerMux);
+  int64_t deadline = nextDeadlineUs;
+  portEXIT_CRITICAL(&timerMux);
+  esp_timer_start_once(timer, deadline > now ? (uint64_t)(deadline - now) : 0);
+  return true;
+}
+
+bool rotationTimerWait(TickType_t maxWait)
+{
+  if (ulTaskNotifyTake(pdTRUE, maxWait) == 0)
+  {
+    return false;
+  }
+  int64_t now = esp_timer_get_time();
+  portENTER_CRITICAL(&timerMux);
+  int64_t deadline = firedDeadlineUs;
+  portEXIT_CRITICAL(&timerMux);
+  telemetryRecordJitter((int32_t)(now - deadline));
+  return true;
+}
+
+uint32_t rotationTimerMissed()
+{
+  return missed;
+}
+
+int32_t rotationTimerPhaseError()
+{
+  return phaseErrorUs;
+}
+
+static int64_t wallUs()
+{
+  struct timeval tv;
+  gettimeofday(&tv, nullptr);
+  return (int64_t)tv.tv_sec * 1000000LL + tv.tv_usec;
+}
+
+static bool restartDeadlineValid(uint32_t periodMs)
+{
+  return restartDeadline.magic == RESTART_DEADLINE_MAGIC &&
+         restartDeadline.checkInverse == ~(uint32_t)(restartDeadline.wallUs ^ restartDeadline.periodMs) &&
+         restartDeadline.periodMs == periodMs;
+}
+
+uint32_t rotationRestartDelayMs(uint32_t periodMs)
+{
+  if (!restartDeadlineValid(periodMs))
+  {
+    return periodMs;
+  }
+  int64_t left = restartDeadline.wallUs - wallUs();
+  if (left <= 0)
+  {
+    return 0;
+  }
+  if (left > (int64_t)periodMs * 1000)
+  {
+    return periodMs;
+  }
+  return (uint32_t)(left / 1000);
+}
+
+static void armRestartDeadline(uint32_t periodMs, int64_t deadline)
+{
+  restartDeadline.magic = RESTART_DEADLINE_MAGIC;
+  restartDeadline.periodMs = periodMs;
+  restartDeadline.wallUs = deadline;
+  restartDeadline.checkInverse = ~(uint32_t)(deadline ^ periodMs);
+}
+
+// Records how late this restart is and arms the following deadline. Boots
+// that overran a whole period skip ahead instead of trying to catch up.
+void rotationRestartCommit(uint32_t periodMs)
+{
+  int64_t now = wallUs();
+  int64_t period = (int64_t)periodMs * 1000;
+  int64_t deadline = restartDeadlineValid(periodMs) ? restartDeadline.wallUs : now;
+  telemetryRecordJitter((int32_t)(now - deadline));
+
+  deadline += period;
+  if (deadline <= now)
+  {
+    deadline += ((now - deadline) / period + 1) * period;
+  }
+  armRestartDeadline(periodMs, deadline);
+}
+
+// A restart ahead of its deadline starts a new grid from now and is not a
+// jitter sample.
+void rotationRestartEarly(uint32_t periodMs)
+{
+  armRestartDeadline(periodMs, wallUs() + (int64_t)periodMs * 1000);
+}
+
+const char *rotationPhaseName(uint8_t phase)
+{
+  switch (phase)
+  {
+  case ROTATION_PHASE_FREE:
+    return "livre (sem linha de sync)";
+  case ROTATION_PHASE_LEADER:
+    return "líder (gera pulsos de sync)";
+  case ROTATION_PHASE_FOLLOWER:
+    return "seguidor (alinha aos pulsos de sync)";
+  default:
+    return "desconhecido";
+  }
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <stdint.h>
+#include "freertos/FreeRTOS.h"
+
+enum RotationPhase
+{
+  ROTATION_PHASE_FREE = 0,
+  ROTATION_PHASE_LEADER = 1,
+  ROTATION_PHASE_FOLLOWER = 2,
+  ROTATION_PHASE_COUNT
+};
+
+// Hot rotation: an esp_timer fires at absolute deadlines (previous deadline
+// + period, never "now + period") and wakes the task that called begin.
+// A follower re-anchors its deadlines on every edge of the sync line, so
+// boards wired to one leader rotate in lockstep. Outside follower mode a
+// grid point handed to rotationTimerAnchor (esp_timer time, e.g. from the
+// fleet coordinator) re-anchors the grid the same way at the next deadline.
+// rotationTimerCutShort ends the current dwell early, but no sooner than
+// minDwellMs after it began (adaptive dwell).
+bool rotationTimerBegin(uint32_t periodMs, uint8_t phase);
+void rotationTimerStop();
+void rotationTimerSetPeriod(uint32_t periodMs);
+void rotationTimerAnchor(int64_t gridUs);
+bool rotationTimerCutShort(uint32_t minDwellMs);
+bool rotationTimerWait(TickType_t maxWait);
+uint32_t rotationTimerMissed();
+int32_t rotationTimerPhaseError();
+
+// Reboot rotation: the next restart deadline is kept in RTC memory against
+// system time, which keeps running across esp_restart(), so the time spent
+// in setup() is part of the period instead of being added to it.
+uint32_t rotationRestartDelayMs(uint32_t periodMs);
+void rotationRestartCommit(uint32_t periodMs);
+void rotationRestartEarly(uint32_t periodMs);
+
+const char *rotationPhaseName(uint8_t phase);
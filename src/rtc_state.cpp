@@ -0,0 +1,39 @@
+#include "rtc_state.h"
+
+#include <stddef.h>
+#include "esp_attr.h"
+
+#define CYCLE_STATE_MAGIC 0x50465243
+
+RTC_NOINIT_ATTR CycleState cycleState;
+
+static uint32_t cycleChecksum(const CycleState &state)
+{
+  const uint8_t *bytes = (const uint8_t *)&state;
+  uint32_t hash = 2166136261UL;
+  for (size_t i = 0; i < offsetof(CycleState, checksum); i++)
+  {
+    hash ^= bytes[i];
+    hash *= 16777619UL;
+  }
+  return hash;
+}
+
+bool cycleStateLoad()
+{
+  return cycleState.magic == CYCLE_STATE_MAGIC && cycleState.checksum == cycleChecksum(cycleState);
+}
+
+void cycleStateReset(uint16_t macIndex)
+{
+  cycleState.magic = CYCLE_STATE_MAGIC;
+  cycleState.macIndex = macIndex;
+  cycleState.dwellLeft = 0;
+  signalInit(cycleState.signal, SIGNAL_MODEL_STEPPED, 60, 100, 0);
+  cycleStateCommit();
+}
+
+void cycleStateCommit()
+{
+  cycleState.checksum = cycleChecksum(cycleState);
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <stdint.h>
+#include "signal_model.h"
+
+struct CycleState
+{
+  uint32_t magic;
+  uint16_t macIndex;
+  uint8_t dwellLeft;
+  SignalState signal;
+  uint32_t checksum;
+};
+
+extern CycleState cycleState;
+
+bool cycleStateLoad();
+void cycleStateReset(uint16_t macIndex);
+void cycleStateCommit();
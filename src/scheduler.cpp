@@ -0,0 +1,189 @@
+#include "scheduler.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define TREND_MAX_Q8 128
+#define TREND_CHANGE_MS 20000UL
+#define DRAIN_MIN_Q16 900
+#define DRAIN_SPAN_Q16 1800
+#define BATTERY_FULL_Q16 (100UL << 16)
+
+IdentityScheduler::IdentityScheduler()
+    : n(0), dwell(0), totalWeight(0), lastStep(0), rng(1), block(nullptr),
+      bpmQ8(nullptr), trendQ8(nullptr), batteryQ16(nullptr), drainQ16(nullptr),
+      lastShown(nullptr), dueAt(nullptr), weight(nullptr)
+{
+}
+
+IdentityScheduler::~IdentityScheduler()
+{
+  end();
+}
+
+uint32_t IdentityScheduler::nextRandom()
+{
+  uint32_t x = rng;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  rng = x;
+  return x;
+}
+
+bool IdentityScheduler::begin(uint16_t count, uint32_t dwellMs, uint32_t nowMs, uint32_t seed)
+{
+  end();
+  if (count == 0)
+  {
+    return false;
+  }
+  if (count > SCHEDULER_MAX_IDENTITIES)
+  {
+    count = SCHEDULER_MAX_IDENTITIES;
+  }
+
+  // Widest arrays first so every one stays naturally aligned.
+  size_t size = count * (3 * sizeof(uint32_t) + 3 * sizeof(uint16_t) + sizeof(uint8_t));
+  uint8_t *memory = (uint8_t *)malloc(size);
+  if (memory == nullptr)
+  {
+    return false;
+  }
+  block = memory;
+  batteryQ16 = (uint32_t *)memory;
+  lastShown = batteryQ16 + count;
+  dueAt = lastShown + count;
+  bpmQ8 = (uint16_t *)(dueAt + count);
+  trendQ8 = (int16_t *)(bpmQ8 + count);
+  drainQ16 = (uint16_t *)(trendQ8 + count);
+  weight = (uint8_t *)(drainQ16 + count);
+
+  n = count;
+  dwell = dwellMs;
+  lastStep = nowMs;
+  rng = seed != 0 ? seed : 0x9E3779B9UL;
+  totalWeight = count;
+
+  for (uint16_t i = 0; i < n; i++)
+  {
+    bpmQ8[i] = (uint16_t)((60 + nextRandom() % 60) << 8);
+    trendQ8[i] = (int16_t)(nextRandom() % (2 * TREND_MAX_Q8 + 1)) - TREND_MAX_Q8;
+    batteryQ16[i] = (50UL + nextRandom() % 51) << 16;
+    drainQ16[i] = DRAIN_MIN_Q16 + nextRandom() % DRAIN_SPAN_Q16;
+    lastShown[i] = 0;
+    dueAt[i] = nowMs + i;
+    weight[i] = 1;
+  }
+  return true;
+}
+
+void IdentityScheduler::end()
+{
+  free(block);
+  block = nullptr;
+  n = 0;
+}
+
+void IdentityScheduler::setProfile(uint16_t index, uint8_t bpm, uint8_t battery, bool batteryFixed, uint8_t newWeight)
+{
+  if (index >= n)
+  {
+    return;
+  }
+  if (newWeight == 0)
+  {
+    newWeight = 1;
+  }
+  totalWeight = totalWeight - weight[index] + newWeight;
+  weight[index] = newWeight;
+  if (bpm != 0)
+  {
+    bpmQ8[index] = (uint16_t)bpm << 8;
+  }
+  if (batteryFixed)
+  {
+    batteryQ16[index] = (uint32_t)battery << 16;
+    drainQ16[index] = 0;
+  }
+}
+
+void IdentityScheduler::step(uint32_t nowMs)
+{
+  uint32_t dt = nowMs - lastStep;
+  if (n == 0 || dt == 0)
+  {
+    return;
+  }
+  lastStep = nowMs;
+  if (dt > 10000)
+  {
+    dt = 10000;
+  }
+
+  for (uint16_t i = 0; i < n; i++)
+  {
+    int32_t level = bpmQ8[i] + (int32_t)trendQ8[i] * (int32_t)dt / 1000;
+    if (level < (SCHEDULER_MIN_BPM << 8) || level > (SCHEDULER_MAX_BPM << 8))
+    {
+      trendQ8[i] = -trendQ8[i];
+      level = level < (SCHEDULER_MIN_BPM << 8) ? (SCHEDULER_MIN_BPM << 8) : (SCHEDULER_MAX_BPM << 8);
+    }
+    bpmQ8[i] = (uint16_t)level;
+  }
+
+  for (uint16_t i = 0; i < n; i++)
+  {
+    if (nextRandom() % TREND_CHANGE_MS < dt)
+    {
+      trendQ8[i] = (int16_t)(nextRandom() % (2 * TREND_MAX_Q8 + 1)) - TREND_MAX_Q8;
+    }
+  }
+
+  for (uint16_t i = 0; i < n; i++)
+  {
+    uint32_t drained = (uint32_t)drainQ16[i] * dt / 1000;
+    batteryQ16[i] = batteryQ16[i] > drained ? batteryQ16[i] - drained : BATTERY_FULL_Q16;
+  }
+}
+
+void IdentityScheduler::revisit(uint16_t index, uint32_t nowMs)
+{
+  lastShown[index] = nowMs;
+  dueAt[index] = nowMs + (uint32_t)(((uint64_t)dwell * totalWeight) / weight[index]);
+}
+
+uint16_t IdentityScheduler::next(uint32_t nowMs, const uint8_t *exclude, uint8_t excludeCount)
+{
+  uint16_t best = 0;
+  int32_t bestLateness = INT32_MIN;
+
+  for (uint16_t i = 0; i < n; i++)
+  {
+    int32_t lateness = (int32_t)(nowMs - dueAt[i]);
+    if (lateness <= bestLateness)
+    {
+      continue;
+    }
+    bool excluded = false;
+    for (uint8_t e = 0; e < excludeCount; e++)
+    {
+      if (exclude[e] == i)
+      {
+        excluded = true;
+        break;
+      }
+    }
+    if (!excluded)
+    {
+      best = i;
+      bestLateness = lateness;
+    }
+  }
+
+  if (n > 0)
+  {
+    revisit(best, nowMs);
+  }
+  return best;
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <stdint.h>
+
+#ifdef PHANTOM_MEMORY_BUDGET
+#define SCHEDULER_MAX_IDENTITIES 4096
+#else
+#define SCHEDULER_MAX_IDENTITIES 1024
+#endif
+#define SCHEDULER_MIN_BPM 50
+#define SCHEDULER_MAX_BPM 190
+
+// Per-identity simulation state kept as parallel arrays so a tick walks
+// each field linearly. Selection is deadline-based: an identity with
+// weight w comes due every dwell * totalWeight / w ms, so equal weights
+// reduce to the original round robin.
+class IdentityScheduler
+{
+public:
+  IdentityScheduler();
+  ~IdentityScheduler();
+
+  bool begin(uint16_t count, uint32_t dwellMs, uint32_t nowMs, uint32_t seed);
+  void end();
+  bool active() const { return n > 0; }
+  uint16_t count() const { return n; }
+
+  void setProfile(uint16_t index, uint8_t bpm, uint8_t battery, bool batteryFixed, uint8_t weight);
+  void setDwell(uint32_t dwellMs) { dwell = dwellMs; }
+  void step(uint32_t nowMs);
+  uint16_t next(uint32_t nowMs, const uint8_t *exclude = nullptr, uint8_t excludeCount = 0);
+
+  uint8_t bpm(uint16_t index) const { return (bpmQ8[index] + 128) >> 8; }
+  uint8_t battery(uint16_t index) const { return (batteryQ16[index] + 32768) >> 16; }
+  uint32_t lastAdvertised(uint16_t index) const { return lastShown[index]; }
+
+private:
+  uint32_t nextRandom();
+  void revisit(uint16_t index, uint32_t nowMs);
+
+  uint16_t n;
+  uint32_t dwell;
+  uint32_t totalWeight;
+  uint32_t lastStep;
+  uint32_t rng;
+  void *block;
+
+  uint16_t *bpmQ8;
+  int16_t *trendQ8;
+  uint32_t *batteryQ16;
+  uint16_t *drainQ16;
+  uint32_t *lastShown;
+  uint32_t *dueAt;
+  uint8_t *weight;
+};
@@ -0,0 +1,219 @@
+#include "signal_model.h"
+
+#define Q8(value) ((int32_t)(value) << 8)
+
+#define RAMP_MIN_BPM 60
+#define RAMP_MAX_BPM 180
+#define RAMP_PERIOD_MS 240000UL
+
+#define SINE_CENTER_BPM 110
+#define SINE_AMPLITUDE_BPM 40
+#define SINE_PERIOD_MS 60000UL
+
+#define REST_BASE_BPM 66
+#define REST_RSA_BPM 3
+#define REST_RSA_PERIOD_MS 4000UL
+
+#define EXERCISE_PERIOD_MS 600000UL
+#define EXERCISE_TAU_MS 30000L
+
+#define STEP_DWELL_MS 30000UL
+
+#define BATTERY_DRAIN_MS_PER_PERCENT 36000UL
+
+static const int16_t quarterSine[65] = {
+    0, 804, 1608, 2410, 3212, 4011, 4808, 5602, 6393, 7179, 7962, 8739, 9512,
+    10278, 11039, 11793, 12539, 13279, 14010, 14732, 15446, 16151, 16846, 17530,
+    18204, 18868, 19519, 20159, 20787, 21403, 22005, 22594, 23170, 23731, 24279,
+    24811, 25329, 25832, 26319, 26790, 27245, 27683, 28105, 28510, 28898, 29268,
+    29621, 29956, 30273, 30571, 30852, 31113, 31356, 31580, 31785, 31971, 32137,
+    32285, 32412, 32521, 32609, 32678, 32728, 32757, 32767};
+
+static const uint8_t stepLevels[] = {70, 120, 160, 120};
+
+// phase is a full turn in 0..255, result is Q15.
+static int32_t sineQ15(uint8_t phase)
+{
+  uint8_t index = phase & 0x3F;
+  switch (phase >> 6)
+  {
+  case 0:
+    return quarterSine[index];
+  case 1:
+    return quarterSine[64 - index];
+  case 2:
+    return -quarterSine[index];
+  default:
+    return -quarterSine[64 - index];
+  }
+}
+
+static uint8_t phaseOf(uint32_t elapsedMs, uint32_t periodMs)
+{
+  return (uint8_t)(((uint64_t)(elapsedMs % periodMs) * 256) / periodMs);
+}
+
+static uint32_t nextRandom(SignalState &s)
+{
+  uint32_t x = s.rng;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  s.rng = x;
+  return x;
+}
+
+static int32_t randomQ8(SignalState &s, int32_t amplitudeQ8)
+{
+  return (int32_t)(nextRandom(s) % (uint32_t)(2 * amplitudeQ8 + 1)) - amplitudeQ8;
+}
+
+// Mean-reverting random walk so noise wanders instead of flickering.
+static int32_t wander(SignalState &s, int32_t amplitudeQ8)
+{
+  s.noiseQ8 += randomQ8(s, amplitudeQ8 / 2) - s.noiseQ8 / 8;
+  return s.noiseQ8;
+}
+
+static void approach(SignalState &s, int32_t targetQ8, uint32_t dtMs)
+{
+  if (dtMs >= (uint32_t)EXERCISE_TAU_MS)
+  {
+    s.levelQ8 = targetQ8;
+    return;
+  }
+  s.levelQ8 += (int32_t)(((int64_t)(targetQ8 - s.levelQ8) * dtMs) / EXERCISE_TAU_MS);
+}
+
+static int32_t exerciseTargetQ8(uint32_t elapsedMs)
+{
+  uint32_t t = elapsedMs % EXERCISE_PERIOD_MS;
+  if (t < 60000UL)
+  {
+    return Q8(75);
+  }
+  if (t < 480000UL)
+  {
+    return Q8(155);
+  }
+  return Q8(95);
+}
+
+static void stepPingPong(SignalState &s)
+{
+  if (s.bpm < 60 || s.bpm > 180)
+    s.bpm = 60;
+  if (s.bpmDir > 1)
+    s.bpmDir = 0;
+
+  if (s.bpmDir == 0)
+  {
+    if (++s.bpm >= 180)
+    {
+      s.bpm = 180;
+      s.bpmDir = 1;
+    }
+  }
+  else
+  {
+    if (--s.bpm <= 60)
+    {
+      s.bpm = 60;
+      s.bpmDir = 0;
+    }
+  }
+}
+
+static uint8_t toBpm(int32_t valueQ8)
+{
+  int32_t bpm = (valueQ8 + 128) >> 8;
+  if (bpm < SIGNAL_MIN_BPM)
+    bpm = SIGNAL_MIN_BPM;
+  if (bpm > SIGNAL_MAX_BPM)
+    bpm = SIGNAL_MAX_BPM;
+  return (uint8_t)bpm;
+}
+
+void signalInit(SignalState &s, uint8_t model, uint8_t bpm, uint8_t battery, uint32_t seed)
+{
+  s.elapsedMs = 0;
+  s.rng = seed != 0 ? seed : 0x9E3779B9UL;
+  s.levelQ8 = Q8(bpm);
+  s.noiseQ8 = 0;
+  s.drainMs = 0;
+  s.model = model < SIGNAL_MODEL_COUNT ? model : (uint8_t)SIGNAL_MODEL_STEPPED;
+  s.bpm = bpm;
+  s.bpmDir = 0;
+  s.battery = battery <= 100 ? battery : 100;
+  s.batteryStart = s.battery;
+}
+
+void signalAdvance(SignalState &s, uint32_t dtMs)
+{
+  if (s.model == SIGNAL_MODEL_STEPPED)
+  {
+    stepPingPong(s);
+    return;
+  }
+
+  s.elapsedMs += dtMs;
+  s.drainMs += dtMs;
+  uint32_t t = s.elapsedMs;
+  int32_t valueQ8;
+
+  switch (s.model)
+  {
+  case SIGNAL_MODEL_RAMP:
+  {
+    uint32_t pos = t % RAMP_PERIOD_MS;
+    uint32_t half = RAMP_PERIOD_MS / 2;
+    uint32_t rise = pos < half ? pos : RAMP_PERIOD_MS - pos;
+    valueQ8 = Q8(RAMP_MIN_BPM) + (int32_t)(((uint64_t)rise * Q8(RAMP_MAX_BPM - RAMP_MIN_BPM)) / half);
+    break;
+  }
+
+  case SIGNAL_MODEL_SINE:
+    valueQ8 = Q8(SINE_CENTER_BPM) + ((Q8(SINE_AMPLITUDE_BPM) * sineQ15(phaseOf(t, SINE_PERIOD_MS))) >> 15);
+    break;
+
+  case SIGNAL_MODEL_REST:
+    valueQ8 = Q8(REST_BASE_BPM) + ((Q8(REST_RSA_BPM) * sineQ15(phaseOf(t, REST_RSA_PERIOD_MS))) >> 15) +
+              wander(s, Q8(2));
+    break;
+
+  case SIGNAL_MODEL_EXERCISE:
+    approach(s, exerciseTargetQ8(t), dtMs);
+    valueQ8 = s.levelQ8 + wander(s, Q8(3));
+    break;
+
+  default:
+    valueQ8 = Q8(stepLevels[(t / STEP_DWELL_MS) % sizeof(stepLevels)]);
+    break;
+  }
+
+  s.bpm = toBpm(valueQ8);
+  // Empty wraps back to full, as a recharge would.
+  uint8_t drained = (uint8_t)((s.drainMs / BATTERY_DRAIN_MS_PER_PERCENT) % 101);
+  s.battery = (uint8_t)((s.batteryStart + 101 - drained) % 101);
+}
+
+const char *signalModelName(uint8_t model)
+{
+  switch (model)
+  {
+  case SIGNAL_MODEL_STEPPED:
+    return "degrau por ciclo";
+  case SIGNAL_MODEL_RAMP:
+    return "rampa";
+  case SIGNAL_MODEL_SINE:
+    return "senoide";
+  case SIGNAL_MODEL_REST:
+    return "repouso com ruído";
+  case SIGNAL_MODEL_EXERCISE:
+    return "exercício";
+  case SIGNAL_MODEL_STEP:
+    return "perfil em degraus";
+  default:
+    return "desconhecido";
+  }
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <stdint.h>
+
+#define SIGNAL_MIN_BPM 40
+#define SIGNAL_MAX_BPM 200
+#define SIGNAL_MIN_RATE_HZ 1
+#define SIGNAL_MAX_RATE_HZ 10
+
+enum SignalModel
+{
+  SIGNAL_MODEL_STEPPED = 0,
+  SIGNAL_MODEL_RAMP = 1,
+  SIGNAL_MODEL_SINE = 2,
+  SIGNAL_MODEL_REST = 3,
+  SIGNAL_MODEL_EXERCISE = 4,
+  SIGNAL_MODEL_STEP = 5,
+  SIGNAL_MODEL_COUNT
+};
+
+// Levels are Q8 fixed point (bpm * 256). STEPPED keeps the original
+// +/-1 bpm ping-pong per advance; every other model is driven by elapsedMs
+// and drains the battery from batteryStart over drainMs.
+struct SignalState
+{
+  uint32_t elapsedMs;
+  uint32_t drainMs;
+  uint32_t rng;
+  int32_t levelQ8;
+  int32_t noiseQ8;
+  uint8_t model;
+  uint8_t bpm;
+  uint8_t bpmDir;
+  uint8_t battery;
+  uint8_t batteryStart;
+};
+
+void signalInit(SignalState &s, uint8_t model, uint8_t bpm, uint8_t battery, uint32_t seed);
+void signalAdvance(SignalState &s, uint32_t dtMs);
+const char *signalModelName(uint8_t model);
@@ -0,0 +1,181 @@
+#include "sweep.h"
+
+#include <Arduino.h>
+#include <stddef.h>
+#include <string.h>
+#include <sys/time.h>
+#include "esp_attr.h"
+#include "esp_bt.h"
+#include "advertiser.h"
+#include "config.h"
+#include "sync_line.h"
+
+#define SWEEP_STATE_MAGIC 0x50465357
+
+struct SweepResult
+{
+  uint32_t totalMs;
+  uint32_t advertisingMs;
+  uint32_t cycles;
+};
+
+struct SweepState
+{
+  uint32_t magic;
+  uint8_t active;
+  uint8_t step;
+  uint8_t advertising;
+  uint64_t stepStartMs;
+  uint64_t advStartMs;
+  SweepResult results[16];
+  uint32_t checksum;
+};
+
+RTC_NOINIT_ATTR static SweepState sweep;
+
+static uint32_t sweepChecksum()
+{
+  const uint8_t *bytes = (const uint8_t *)&sweep;
+  uint32_t hash = 2166136261UL;
+  for (size_t i = 0; i < offsetof(SweepState, checksum); i++)
+  {
+    hash ^= bytes[i];
+    hash *= 16777619UL;
+  }
+  return hash;
+}
+
+static void commit()
+{
+  sweep.checksum = sweepChecksum();
+}
+
+// System time keeps running across esp_restart(), unlike millis(), so the
+// reboot gaps are part of each step's wall time.
+static uint64_t wallMs()
+{
+  struct timeval tv;
+  gettimeofday(&tv, nullptr);
+  return (uint64_t)tv.tv_sec * 1000ULL + tv.tv_usec / 1000;
+}
+
+static esp_power_level_t powerLevel(int8_t dbm)
+{
+  return (esp_power_level_t)(ESP_PWR_LVL_N12 + (dbm + 12) / 3);
+}
+
+static void closeAdvertising(uint64_t now)
+{
+  if (sweep.advertising)
+  {
+    sweep.results[sweep.step].advertisingMs += (uint32_t)(now - sweep.advStartMs);
+    sweep.advertising = 0;
+  }
+}
+
+static void printTable()
+{
+  Serial.println("\nsweep_tx,step,adv_ms,dwell_ms,tx_dbm,layout,hot,duration_s,cycles,adv_pct,reboot_pct,avg_gap_ms");
+  for (uint8_t i = 0; i < SWEEP_STEP_COUNT; i++)
+  {
+    const SweepStep &step = sweepPlan[i];
+    const SweepResult &result = sweep.results[i];
+    uint32_t gapMs = result.totalMs - result.advertisingMs;
+    float advPct = result.totalMs > 0 ? result.advertisingMs * 100.0f / result.totalMs : 0.0f;
+    Serial.printf("sweep_tx,%d,%d,%d,%d,%d,%d,%.1f,%lu,%.1f,%.1f,%.1f\n", i, step.advIntervalMs, step.dwellMs,
+                  step.txPowerDbm, step.layout, step.hotRotation, result.totalMs / 1000.0f,
+                  (unsigned long)result.cycles, advPct, 100.0f - advPct,
+                  result.cycles > 0 ? (float)gapMs / result.cycles : 0.0f);
+  }
+}
+
+void sweepStart()
+{
+  memset(&sweep, 0, sizeof(sweep));
+  sweep.magic = SWEEP_STATE_MAGIC;
+  sweep.active = 1;
+  sweep.stepStartMs = wallMs();
+  commit();
+  syncPulse(SWEEP_BOUNDARY_PULSE_US);
+}
+
+void sweepAbort()
+{
+  sweep.active = 0;
+  commit();
+}
+
+bool sweepActive()
+{
+  return sweep.magic == SWEEP_STATE_MAGIC && sweep.checksum == sweepChecksum() && sweep.active &&
+         sweep.step < SWEEP_STEP_COUNT;
+}
+
+uint8_t sweepStepIndex()
+{
+  return sweep.step;
+}
+
+const SweepStep &sweepCurrent()
+{
+  return sweepPlan[sweep.step < SWEEP_STEP_COUNT ? sweep.step : 0];
+}
+
+void sweepApply(DeviceConfig &cfg)
+{
+  const SweepStep &step = sweepCurrent();
+  cfg.mode = MODE_AUTO_LIST;
+  cfg.useCustomMac = 0;
+  cfg.restartInterval = step.dwellMs;
+  cfg.hotRotation = step.hotRotation;
+  cfg.fastBoot = 1;
+}
+
+void sweepApplyRadio()
+{
+  const SweepStep &step = sweepCurrent();
+  advertiserSetInterval(step.advIntervalMs);
+  esp_ble_tx_power_set(ESP_BLE_PWR_TYPE_ADV, powerLevel(step.txPowerDbm));
+}
+
+void sweepAdvertisingStarted()
+{
+  sweep.advStartMs = wallMs();
+  sweep.advertising = 1;
+  sweep.results[sweep.step].cycles++;
+  commit();
+}
+
+void sweepBeforeRestart()
+{
+  if (!sweepActive())
+  {
+    return;
+  }
+  closeAdvertising(wallMs());
+  commit();
+}
+
+bool sweepStepDue()
+{
+  return wallMs() - sweep.stepStartMs >= SWEEP_STEP_MS;
+}
+
+bool sweepAdvance()
+{
+  uint64_t now = wallMs();
+  closeAdvertising(now);
+  sweep.results[sweep.step].totalMs = (uint32_t)(now - sweep.stepStartMs);
+  sweep.step++;
+  sweep.stepStartMs = now;
+  syncPulse(SWEEP_BOUNDARY_PULSE_US);
+
+  bool more = sweep.step < SWEEP_STEP_COUNT;
+  if (!more)
+  {
+    printTable();
+    sweep.active = 0;
+  }
+  commit();
+  return more;
+}
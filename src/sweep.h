@@ -0,0 +1,72 @@
+#pragma once
+
+#include <stdint.h>
+
+#define SWEEP_STEP_MS 60000UL
+#define SWEEP_BOUNDARY_PULSE_US 2000
+#define SWEEP_BOUNDARY_MIN_US 500
+
+enum SweepLayout
+{
+  SWEEP_LAYOUT_FULL = 0,
+  SWEEP_LAYOUT_NO_NAME = 1
+};
+
+struct SweepStep
+{
+  uint16_t advIntervalMs;
+  uint16_t dwellMs;
+  int8_t txPowerDbm;
+  uint8_t layout;
+  uint8_t hotRotation;
+};
+
+// Shared by both roles: the receiver labels its summary rows with the same
+// plan the transmitter runs, so the table diffs cleanly between builds.
+static constexpr SweepStep sweepPlan[] = {
+    {20, 250, 9, SWEEP_LAYOUT_FULL, 0},
+    {20, 250, 9, SWEEP_LAYOUT_FULL, 1},
+    {100, 250, 9, SWEEP_LAYOUT_FULL, 1},
+    {20, 1000, 9, SWEEP_LAYOUT_FULL, 0},
+    {20, 1000, 9, SWEEP_LAYOUT_FULL, 1},
+    {20, 250, 0, SWEEP_LAYOUT_FULL, 1},
+    {20, 250, -12, SWEEP_LAYOUT_FULL, 1},
+    {20, 250, 9, SWEEP_LAYOUT_NO_NAME, 1},
+};
+
+#define SWEEP_STEP_COUNT (sizeof(sweepPlan) / sizeof(sweepPlan[0]))
+
+constexpr bool sweepPowerSupported(int8_t dbm)
+{
+  return dbm == -12 || dbm == -9 || dbm == -6 || dbm == -3 || dbm == 0 || dbm == 3 || dbm == 6 || dbm == 9;
+}
+
+constexpr bool sweepStepValid(const SweepStep &step)
+{
+  return step.advIntervalMs >= 20 && step.dwellMs >= 20 && step.dwellMs <= 30000 &&
+         sweepPowerSupported(step.txPowerDbm) && step.layout <= SWEEP_LAYOUT_NO_NAME && step.hotRotation <= 1;
+}
+
+constexpr bool sweepPlanValid(unsigned index = 0)
+{
+  return index >= SWEEP_STEP_COUNT || (sweepStepValid(sweepPlan[index]) && sweepPlanValid(index + 1));
+}
+
+static_assert(SWEEP_STEP_COUNT <= 16, "sweep results are kept in RTC memory for at most 16 steps");
+static_assert(sweepPlanValid(), "every sweep step needs a legal interval, dwell, TX power and layout");
+
+struct DeviceConfig;
+
+// Transmitter side. The plan survives reboot-mode restarts in RTC memory and
+// overrides the loaded config without touching NVS.
+void sweepStart();
+void sweepAbort();
+bool sweepActive();
+uint8_t sweepStepIndex();
+const SweepStep &sweepCurrent();
+void sweepApply(DeviceConfig &cfg);
+void sweepApplyRadio();
+void sweepAdvertisingStarted();
+void sweepBeforeRestart();
+bool sweepStepDue();
+bool sweepAdvance();
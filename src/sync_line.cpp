@@ -0,0 +1,70 @@
+#include "sync_line.h"
+
+#include <Arduino.h>
+
+static bool outputReady = false;
+static volatile uint32_t lastEdgeUs = 0;
+static volatile uint32_t edgeCount = 0;
+static volatile uint32_t lastBoundaryUs = 0;
+static volatile uint32_t boundaryCount = 0;
+static uint32_t boundaryWidthUs = 0;
+
+static void IRAM_ATTR onSyncEdge()
+{
+  uint32_t now = micros();
+  if (digitalRead(PHANTOM_SYNC_PIN) == HIGH)
+  {
+    lastEdgeUs = now;
+    edgeCount++;
+  }
+  else if (now - lastEdgeUs >= boundaryWidthUs)
+  {
+    lastBoundaryUs = lastEdgeUs;
+    boundaryCount++;
+  }
+}
+
+void syncOutputBegin()
+{
+  pinMode(PHANTOM_SYNC_PIN, OUTPUT);
+  digitalWrite(PHANTOM_SYNC_PIN, LOW);
+  outputReady = true;
+}
+
+void syncPulse(uint32_t widthUs)
+{
+  if (!outputReady)
+  {
+    return;
+  }
+  digitalWrite(PHANTOM_SYNC_PIN, HIGH);
+  delayMicroseconds(widthUs);
+  digitalWrite(PHANTOM_SYNC_PIN, LOW);
+}
+
+void syncInputBegin(uint32_t boundaryMinUs)
+{
+  boundaryWidthUs = boundaryMinUs;
+  pinMode(PHANTOM_SYNC_PIN, INPUT_PULLDOWN);
+  attachInterrupt(digitalPinToInterrupt(PHANTOM_SYNC_PIN), onSyncEdge, CHANGE);
+}
+
+uint32_t syncLastEdgeUs()
+{
+  return lastEdgeUs;
+}
+
+uint32_t syncEdgeCount()
+{
+  return edgeCount;
+}
+
+uint32_t syncLastBoundaryUs()
+{
+  return lastBoundaryUs;
+}
+
+uint32_t syncBoundaryCount()
+{
+  return boundaryCount;
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <stdint.h>
+
+#ifndef PHANTOM_SYNC_PIN
+#define PHANTOM_SYNC_PIN 4
+#endif
+
+#define SYNC_PULSE_US 20
+
+// Transmitter side: drives the shared line and raises one short pulse per
+// identity switch, or a long one at a sweep step boundary. Receiver side:
+// timestamps each rising edge in an ISR and classifies pulses by width.
+void syncOutputBegin();
+void syncPulse(uint32_t widthUs = SYNC_PULSE_US);
+
+void syncInputBegin(uint32_t boundaryMinUs);
+uint32_t syncLastEdgeUs();
+uint32_t syncEdgeCount();
+uint32_t syncLastBoundaryUs();
+uint32_t syncBoundaryCount();
@@ -0,0 +1,156 @@
+#include "telemetry.h"
+
+#include <Arduino.h>
+#include <string.h>
+#include "esp_attr.h"
+#include "esp_system.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "console.h"
+#include "gatt_server.h"
+#include "protocol.h"
+
+#define TELEMETRY_MAGIC 0x50465454UL
+
+RTC_NOINIT_ATTR TelemetryState telemetry;
+
+static const char *counterNames[TELEMETRY_COUNT] = {
+    "Boots",
+    "Resets por falha",
+    "Rotações",
+    "Advertisings iniciados",
+    "Conexões",
+    "Desconexões",
+    "Gravações na NVS",
+    "Scan requests",
+    "Rotações antecipadas"};
+
+static bool crashReset(esp_reset_reason_t reason)
+{
+  return reason == ESP_RST_PANIC || reason == ESP_RST_INT_WDT || reason == ESP_RST_TASK_WDT ||
+         reason == ESP_RST_WDT || reason == ESP_RST_BROWNOUT;
+}
+
+void telemetryReset()
+{
+  memset(&telemetry, 0, sizeof(telemetry));
+  telemetry.magic = TELEMETRY_MAGIC;
+  telemetry.magicInverse = (uint32_t)~TELEMETRY_MAGIC;
+  telemetry.minFreeHeap = UINT32_MAX;
+  telemetry.jitterMinUs = INT32_MAX;
+  telemetry.jitterMaxUs = INT32_MIN;
+}
+
+void telemetryBegin()
+{
+  esp_reset_reason_t reason = esp_reset_reason();
+  if (telemetry.magic != TELEMETRY_MAGIC || telemetry.magicInverse != (uint32_t)~TELEMETRY_MAGIC || reason == ESP_RST_POWERON)
+  {
+    telemetryReset();
+  }
+  telemetryCount(TELEMETRY_BOOTS);
+  if (crashReset(reason))
+  {
+    telemetryCount(TELEMETRY_CRASH_RESETS);
+  }
+}
+
+void telemetryRecordBoot()
+{
+  for (int i = 0; i < BOOT_PHASE_COUNT; i++)
+  {
+    telemetry.bootPhaseUs[i] = bootPhaseDuration((BootPhase)i);
+  }
+  telemetry.lastBootUs = bootTimeToAdvertising();
+  if (telemetry.lastBootUs > telemetry.worstBootUs)
+  {
+    telemetry.worstBootUs = telemetry.lastBootUs;
+  }
+  telemetrySampleHeap();
+}
+
+void telemetryRecordJitter(int32_t lateUs)
+{
+  telemetry.jitterSamples++;
+  if (lateUs < telemetry.jitterMinUs)
+    telemetry.jitterMinUs = lateUs;
+  if (lateUs > telemetry.jitterMaxUs)
+    telemetry.jitterMaxUs = lateUs;
+  telemetry.jitterAbsSumUs += lateUs < 0 ? -lateUs : lateUs;
+}
+
+void telemetrySampleHeap()
+{
+  uint32_t low = esp_get_minimum_free_heap_size();
+  if (low < telemetry.minFreeHeap)
+  {
+    telemetry.minFreeHeap = low;
+  }
+}
+
+static uint32_t jitterMeanUs()
+{
+  return telemetry.jitterSamples > 0 ? (uint32_t)(telemetry.jitterAbsSumUs / telemetry.jitterSamples) : 0;
+}
+
+// Stack watermarks are read from the calling task, so this has to run on loop().
+uint16_t telemetryEncode(uint8_t *out, uint16_t capacity)
+{
+  if (capacity < TELEMETRY_ENCODED_SIZE)
+  {
+    return 0;
+  }
+  telemetrySampleHeap();
+
+  uint16_t pos = 0;
+  out[pos++] = TELEMETRY_LAYOUT_VERSION;
+  for (int i = 0; i < TELEMETRY_COUNT; i++, pos += 4)
+  {
+    protocolPutU32(&out[pos], telemetry.counters[i]);
+  }
+  for (int i = 0; i < BOOT_PHASE_COUNT; i++, pos += 4)
+  {
+    protocolPutU32(&out[pos], telemetry.bootPhaseUs[i]);
+  }
+  uint32_t tail[12] = {telemetry.lastBootUs,
+                       telemetry.worstBootUs,
+                       esp_get_free_heap_size(),
+                       telemetry.minFreeHeap,
+                       (uint32_t)uxTaskGetStackHighWaterMark(nullptr),
+                       consoleStackFree(),
+                       gattStackFree(),
+                       telemetry.jitterSamples,
+                       (uint32_t)(telemetry.jitterSamples > 0 ? telemetry.jitterMinUs : 0),
+                       (uint32_t)(telemetry.jitterSamples > 0 ? telemetry.jitterMaxUs : 0),
+                       jitterMeanUs(),
+                       (uint32_t)millis()};
+  for (int i = 0; i < 12; i++, pos += 4)
+  {
+    protocolPutU32(&out[pos], tail[i]);
+  }
+  return pos;
+}
+
+void telemetryPrint()
+{
+  telemetrySampleHeap();
+  Serial.println("\n=== TELEMETRIA ===");
+  for (int i = 0; i < TELEMETRY_COUNT; i++)
+  {
+    Serial.printf("  %-24s %10lu\n", counterNames[i], (unsigned long)telemetry.counters[i]);
+  }
+  Serial.printf("  Boot: último %lu us, pior %lu us\n", (unsigned long)telemetry.lastBootUs,
+                (unsigned long)telemetry.worstBootUs);
+  Serial.printf("  Heap livre: %lu bytes (mínimo %lu)\n", (unsigned long)esp_get_free_heap_size(),
+                (unsigned long)telemetry.minFreeHeap);
+  Serial.printf("  Pilha livre: loop %lu, console %lu, notificações %lu bytes\n",
+                (unsigned long)uxTaskGetStackHighWaterMark(nullptr), (unsigned long)consoleStackFree(),
+                (unsigned long)gattStackFree());
+  if (telemetry.jitterSamples > 0)
+  {
+    Serial.printf("  Jitter de rotação: %lu amostras, min %ld us, max %ld us, médio %lu us\n",
+                  (unsigned long)telemetry.jitterSamples, (long)telemetry.jitterMinUs,
+                  (long)telemetry.jitterMaxUs, (unsigned long)jitterMeanUs());
+  }
+  Serial.println("==================");
+}
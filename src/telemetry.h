@@ -0,0 +1,54 @@
+#pragma once
+
+#include <stdint.h>
+#include "boot_profiler.h"
+
+#define TELEMETRY_LAYOUT_VERSION 3
+#define TELEMETRY_CLEAR_AFTER_READ 0x01
+
+enum TelemetryCounter
+{
+  TELEMETRY_BOOTS,
+  TELEMETRY_CRASH_RESETS,
+  TELEMETRY_ROTATIONS,
+  TELEMETRY_ADV_STARTS,
+  TELEMETRY_CONNECTS,
+  TELEMETRY_DISCONNECTS,
+  TELEMETRY_NVS_COMMITS,
+  TELEMETRY_SCAN_REQUESTS,
+  TELEMETRY_EARLY_ROTATIONS,
+  TELEMETRY_COUNT
+};
+
+// Kept in RTC memory so a soak run accumulates across rotation reboots.
+// Counting is a plain increment; everything else is sampled on demand.
+struct TelemetryState
+{
+  uint32_t magic;
+  uint32_t magicInverse;
+  uint32_t counters[TELEMETRY_COUNT];
+  uint32_t bootPhaseUs[BOOT_PHASE_COUNT];
+  uint32_t lastBootUs;
+  uint32_t worstBootUs;
+  uint32_t minFreeHeap;
+  uint32_t jitterSamples;
+  int32_t jitterMinUs;
+  int32_t jitterMaxUs;
+  uint64_t jitterAbsSumUs;
+};
+
+#define TELEMETRY_ENCODED_SIZE (1 + 4 * (TELEMETRY_COUNT + BOOT_PHASE_COUNT) + 4 * 12)
+
+extern TelemetryState telemetry;
+
+void telemetryBegin();
+void telemetryReset();
+inline void telemetryCount(TelemetryCounter counter)
+{
+  telemetry.counters[counter]++;
+}
+void telemetryRecordBoot();
+void telemetryRecordJitter(int32_t lateUs);
+void telemetrySampleHeap();
+uint16_t telemetryEncode(uint8_t *out, uint16_t capacity);
+void telemetryPrint();
@@ -0,0 +1,367 @@
+#include "trace_replay.h"
+
+#include <stddef.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "esp_partition.h"
+#include "crc.h"
+
+#define TRACE_MAGIC 0x52544650
+#define TRACE_VERSION 1
+
+struct TraceHeader
+{
+  uint32_t magic;
+  uint16_t version;
+  uint16_t recordSize;
+  uint32_t count;
+  uint32_t durationMs;
+  uint32_t recordsCrc;
+  uint32_t headerCrc;
+};
+
+static_assert(sizeof(TraceHeader) <= TRACE_HEADER_SIZE, "trace header must fit its reserved space");
+
+// Two halves: the player drains one while the loader task reads the next
+// chunk from flash into the other, so a stall only happens when a whole
+// buffer is played before its successor is read.
+struct TraceBuffer
+{
+  TraceRecord records[TRACE_BUFFER_RECORDS];
+  uint32_t first;
+  uint16_t length;
+  volatile bool ready;
+};
+
+static const esp_partition_t *partition = nullptr;
+static TraceHeader header;
+static bool valid = false;
+static bool recordsChecked = false;
+static bool uploading = false;
+static uint32_t uploadCount = 0;
+
+static TraceBuffer buffers[2];
+static TaskHandle_t loaderTask = nullptr;
+static SemaphoreHandle_t loadLock = nullptr;
+static volatile uint32_t loadNext = 0;
+static volatile uint8_t loadTarget = 0;
+
+static bool playing = false;
+static bool repeating = false;
+static uint8_t speed = 1;
+static uint8_t current = 0;
+static uint16_t cursor = 0;
+static uint32_t position = 0;
+static uint32_t traceTimeMs = 0;
+static uint32_t startMs = 0;
+static uint32_t underruns = 0;
+static bool stalled = false;
+
+static uint32_t headerCrc(const TraceHeader &h)
+{
+  return crc32((const uint8_t *)&h, offsetof(TraceHeader, headerCrc));
+}
+
+static bool readHeader()
+{
+  valid = partition != nullptr &&
+          esp_partition_read(partition, 0, &header, sizeof(header)) == ESP_OK &&
+          header.magic == TRACE_MAGIC && header.version == TRACE_VERSION &&
+          header.recordSize == sizeof(TraceRecord) && header.headerCrc == headerCrc(header) &&
+          header.count > 0 && header.count <= TRACE_MAX_RECORDS;
+  recordsChecked = false;
+  return valid;
+}
+
+// Wraps to record 0 when repeating; a chunk past the end stays empty.
+static void fill(TraceBuffer &buffer, uint32_t first)
+{
+  if (first >= header.count && repeating)
+  {
+    first = 0;
+  }
+  uint32_t left = first < header.count ? header.count - first : 0;
+  uint16_t length = left < TRACE_BUFFER_RECORDS ? left : TRACE_BUFFER_RECORDS;
+  if (length > 0 &&
+      esp_partition_read(partition, TRACE_HEADER_SIZE + first * sizeof(TraceRecord), buffer.records,
+                         length * sizeof(TraceRecord)) != ESP_OK)
+  {
+    length = 0;
+  }
+  buffer.first = first;
+  buffer.length = length;
+  buffer.ready = true;
+}
+
+// A fill runs under loadLock and only into a buffer nobody has marked
+// ready, so a request left over from an earlier playback can neither race
+// a restart nor refill a buffer that is already being played.
+static void loaderLoop(void *arg)
+{
+  (void)arg;
+  for (;;)
+  {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    xSemaphoreTake(loadLock, portMAX_DELAY);
+    if (!buffers[loadTarget].ready)
+    {
+      fill(buffers[loadTarget], loadNext);
+    }
+    xSemaphoreGive(loadLock);
+  }
+}
+
+void traceBegin()
+{
+  if (partition == nullptr)
+  {
+    partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA,
+                                         (esp_partition_subtype_t)TRACE_PARTITION_SUBTYPE,
+                                         TRACE_PARTITION_LABEL);
+  }
+  readHeader();
+}
+
+uint32_t traceRecordCount()
+{
+  return valid ? header.count : 0;
+}
+
+uint32_t traceDurationMs()
+{
+  return valid ? header.durationMs : 0;
+}
+
+bool traceUploadBegin(uint32_t count)
+{
+  if (partition == nullptr || count == 0 || count > TRACE_MAX_RECORDS)
+  {
+    return false;
+  }
+
+  traceStop();
+  valid = false;
+  size_t eraseSize = TRACE_HEADER_SIZE + count * sizeof(TraceRecord);
+  eraseSize = (eraseSize + 0xFFF) & ~(size_t)0xFFF;
+  uploading = esp_partition_erase_range(partition, 0, eraseSize) == ESP_OK;
+  uploadCount = uploading ? count : 0;
+  return uploading;
+}
+
+bool traceUploadWrite(uint32_t start, const uint8_t *records, uint16_t count)
+{
+  if (!uploading || count == 0 || start + count > uploadCount)
+  {
+    return false;
+  }
+  return esp_partition_write(partition, TRACE_HEADER_SIZE + start * sizeof(TraceRecord),
+                             records, count * sizeof(TraceRecord)) == ESP_OK;
+}
+
+static bool scanRecords(uint32_t count, uint32_t &crc, uint32_t &duration)
+{
+  TraceRecord chunk[42];
+  crc = 0;
+  duration = 0;
+  for (uint32_t first = 0; first < count; first += 42)
+  {
+    uint32_t length = count - first < 42 ? count - first : 42;
+    if (esp_partition_read(partition, TRACE_HEADER_SIZE + first * sizeof(TraceRecord), chunk,
+                           length * sizeof(TraceRecord)) != ESP_OK)
+    {
+      return false;
+    }
+    crc = crc32((const uint8_t *)chunk, length * sizeof(TraceRecord), crc);
+    for (uint32_t i = 0; i < length; i++)
+    {
+      duration += chunk[i].deltaMs;
+    }
+  }
+  return true;
+}
+
+bool traceUploadCrc(uint32_t &crc)
+{
+  uint32_t duration;
+  return uploading && scanRecords(uploadCount, crc, duration);
+}
+
+bool traceUploadCommit()
+{
+  if (!uploading)
+  {
+    return false;
+  }
+  uploading = false;
+
+  uint32_t crc;
+  uint32_t duration;
+  if (!scanRecords(uploadCount, crc, duration))
+  {
+    return false;
+  }
+
+  TraceHeader fresh;
+  memset(&fresh, 0, sizeof(fresh));
+  fresh.magic = TRACE_MAGIC;
+  fresh.version = TRACE_VERSION;
+  fresh.recordSize = sizeof(TraceRecord);
+  fresh.count = uploadCount;
+  fresh.durationMs = duration;
+  fresh.recordsCrc = crc;
+  fresh.headerCrc = headerCrc(fresh);
+  if (esp_partition_write(partition, 0, &fresh, sizeof(fresh)) != ESP_OK)
+  {
+    return false;
+  }
+  if (!readHeader())
+  {
+    return false;
+  }
+  recordsChecked = true;
+  return true;
+}
+
+// A full pass over the records, so it runs once per stored trace, on the
+// first playback rather than on every boot. A mismatch invalidates it.
+static bool recordsIntact()
+{
+  if (recordsChecked)
+  {
+    return true;
+  }
+  uint32_t crc;
+  uint32_t duration;
+  if (!scanRecords(header.count, crc, duration) || crc != header.recordsCrc)
+  {
+    valid = false;
+    return false;
+  }
+  recordsChecked = true;
+  return true;
+}
+
+bool traceStart(uint8_t playSpeed, bool repeat, uint32_t nowMs)
+{
+  if (!valid || playSpeed < 1 || playSpeed > TRACE_MAX_SPEED || !recordsIntact())
+  {
+    return false;
+  }
+  if (loadLock == nullptr && (loadLock = xSemaphoreCreateMutex()) == nullptr)
+  {
+    return false;
+  }
+  if (loaderTask == nullptr &&
+      xTaskCreate(loaderLoop, "trace_loader", TRACE_LOADER_STACK, nullptr, TRACE_LOADER_PRIORITY, &loaderTask) != pdPASS)
+  {
+    return false;
+  }
+
+  // Waits out a fill still running for the previous playback and drops the
+  // request it may have left pending.
+  playing = false;
+  xSemaphoreTake(loadLock, portMAX_DELAY);
+  xTaskNotifyStateClear(loaderTask);
+  repeating = repeat;
+  speed = playSpeed;
+  buffers[0].ready = false;
+  buffers[1].ready = false;
+  fill(buffers[0], 0);
+  if (buffers[0].length == 0)
+  {
+    xSemaphoreGive(loadLock);
+    return false;
+  }
+  current = 0;
+  cursor = 0;
+  position = 0;
+  traceTimeMs = 0;
+  startMs = nowMs;
+  underruns = 0;
+  stalled = false;
+
+  loadTarget = 1;
+  loadNext = buffers[0].first + buffers[0].length;
+  xSemaphoreGive(loadLock);
+  xTaskNotifyGive(loaderTask);
+  playing = true;
+  return true;
+}
+
+void traceStop()
+{
+  playing = false;
+}
+
+bool traceActive()
+{
+  return playing;
+}
+
+// Hands out the next record once its scaled timestamp has passed. The
+// player only ever touches the buffer it is draining; the other one is the
+// loader's until it sets ready.
+bool traceNext(uint32_t nowMs, TraceRecord &record)
+{
+  if (!playing)
+  {
+    return false;
+  }
+
+  TraceBuffer *buffer = &buffers[current];
+  if (cursor >= buffer->length)
+  {
+    TraceBuffer &next = buffers[current ^ 1];
+    if (!next.ready)
+    {
+      if (!stalled)
+      {
+        underruns++;
+        stalled = true;
+      }
+      return false;
+    }
+    stalled = false;
+    if (next.length == 0)
+    {
+      playing = false;
+      return false;
+    }
+    buffer->ready = false;
+    loadTarget = current;
+    loadNext = next.first + next.length;
+    current ^= 1;
+    cursor = 0;
+    buffer = &next;
+    xTaskNotifyGive(loaderTask);
+  }
+
+  const TraceRecord &candidate = buffer->records[cursor];
+  uint32_t dueMs = startMs + (traceTimeMs + candidate.deltaMs) / speed;
+  if ((int32_t)(nowMs - dueMs) < 0)
+  {
+    return false;
+  }
+  record = candidate;
+  traceTimeMs += candidate.deltaMs;
+  position = buffer->first + cursor;
+  cursor++;
+  return true;
+}
+
+uint32_t tracePosition()
+{
+  return position;
+}
+
+uint8_t traceSpeed()
+{
+  return speed;
+}
+
+uint32_t traceUnderruns()
+{
+  return underruns;
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <stdint.h>
+
+#define TRACE_PARTITION_LABEL "traces"
+#define TRACE_PARTITION_SUBTYPE 0x41
+#define TRACE_PARTITION_SIZE 0xA0000
+#define TRACE_HEADER_SIZE 32
+#define TRACE_MAX_RECORDS ((TRACE_PARTITION_SIZE - TRACE_HEADER_SIZE) / 6)
+#define TRACE_BUFFER_RECORDS 256
+#define TRACE_MAX_SPEED 64
+#define TRACE_IDENTITY_KEEP 0xFFFF
+#define TRACE_PLAY_REPEAT 0x01
+
+#define TRACE_LOADER_STACK 2048
+#define TRACE_LOADER_PRIORITY 2
+
+// One captured reading, applied deltaMs after the previous one. Gaps longer
+// than a u16 are written as repeated readings; an identity of
+// TRACE_IDENTITY_KEEP leaves the advertised identity as it is.
+struct __attribute__((packed)) TraceRecord
+{
+  uint16_t deltaMs;
+  uint16_t identity;
+  uint8_t bpm;
+  uint8_t battery;
+};
+
+static_assert(sizeof(TraceRecord) == 6, "trace records are 6 bytes on flash");
+
+void traceBegin();
+uint32_t traceRecordCount();
+uint32_t traceDurationMs();
+
+bool traceUploadBegin(uint32_t count);
+bool traceUploadWrite(uint32_t start, const uint8_t *records, uint16_t count);
+bool traceUploadCrc(uint32_t &crc);
+bool traceUploadCommit();
+
+bool traceStart(uint8_t speed, bool repeat, uint32_t nowMs);
+void traceStop();
+bool traceActive();
+bool traceNext(uint32_t nowMs, TraceRecord &record);
+uint32_t tracePosition();
+uint8_t traceSpeed();
+uint32_t traceUnderruns();
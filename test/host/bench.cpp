@@ -0,0 +1,81 @@
+#include <chrono>
+#include <stdio.h>
+#include <string.h>
+#include "adv_payload.h"
+#include "hal_host.h"
+#include "mac_generator.h"
+#include "protocol.h"
+#include "signal_model.h"
+
+// Operations per second for the hot paths of the rotation loop. --quick
+// runs a short pass so the binary also works as a smoke test under ctest.
+
+static volatile uint32_t sink = 0;
+
+template <typename Operation>
+static void bench(const char *name, unsigned long iterations, Operation operation)
+{
+  auto start = std::chrono::steady_clock::now();
+  for (unsigned long i = 0; i < iterations; i++)
+  {
+    operation(i);
+  }
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  printf("%-24s %10lu ops %12.0f ops/s %8.1f ns/op\n", name, iterations,
+         seconds > 0 ? iterations / seconds : 0.0, seconds * 1e9 / iterations);
+}
+
+int main(int argc, char **argv)
+{
+  unsigned long scale = argc > 1 && strcmp(argv[1], "--quick") == 0 ? 1 : 50;
+
+  bench("macParse", 20000 * scale, [](unsigned long i) {
+    uint8_t mac[6];
+    sink += macParse(i & 1 ? "C2:52:F5:C7:D6:FE" : "d2:4f:3a:77:22:10", mac) + mac[5];
+  });
+
+  macGeneratorReset(1);
+  bench("macGeneratorNext", 20000 * scale, [](unsigned long i) {
+    (void)i;
+    uint8_t mac[6];
+    macGeneratorNext(mac);
+    sink += mac[1];
+  });
+
+  SensorPayload payload;
+  bench("SensorPayload::build", 20000 * scale, [&payload](unsigned long i) {
+    payload.build(i & 1, "HW706-0047980", 60 + (i & 63), 100);
+    sink += payload.adv.length();
+  });
+
+  payload.build(0, "HW706-0047980", 60, 100);
+  bench("setBpm + decode", 20000 * scale, [&payload](unsigned long i) {
+    uint8_t bpm;
+    uint8_t battery;
+    payload.setBpm(60 + (i & 63));
+    payload.setBattery(i % 101);
+    sink += sensorPayloadDecode(payload.adv.data(), payload.adv.length(), bpm, battery) + bpm;
+  });
+
+  SignalState signal;
+  signalInit(signal, SIGNAL_MODEL_EXERCISE, 70, 100, 1);
+  bench("signalAdvance", 100000 * scale, [&signal](unsigned long i) {
+    (void)i;
+    signalAdvance(signal, 250);
+    sink += signal.bpm;
+  });
+
+  bench("protocol encode+parse", 10000 * scale, [](unsigned long i) {
+    uint8_t data[32];
+    uint8_t frame[PROTOCOL_OVERHEAD + sizeof(data)];
+    memset(data, (int)i, sizeof(data));
+    size_t length = protocolEncode(PROTOCOL_OP_IDENTITY_WRITE, data, sizeof(data), frame);
+    ProtocolParser parser;
+    for (size_t j = 0; j < length; j++)
+    {
+      sink += parser.feed(frame[j]);
+    }
+  });
+
+  return 0;
+}
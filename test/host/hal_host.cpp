@@ -0,0 +1,34 @@
+#include "hal_host.h"
+
+static uint32_t clockMs = 0;
+static uint32_t rngState = 0x9E3779B9UL;
+
+uint32_t halMillis()
+{
+  return clockMs;
+}
+
+uint32_t halRandom()
+{
+  uint32_t x = rngState;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  rngState = x;
+  return x;
+}
+
+void halHostSetMillis(uint32_t ms)
+{
+  clockMs = ms;
+}
+
+void halHostAdvanceMillis(uint32_t ms)
+{
+  clockMs += ms;
+}
+
+void halHostSeedRandom(uint32_t seed)
+{
+  rngState = seed != 0 ? seed : 0x9E3779B9UL;
+}
@@ -0,0 +1,10 @@
+#pragma once
+
+#include <stdint.h>
+#include "hal.h"
+
+// Test controls for the host HAL: a manual clock and a reseedable xorshift
+// standing in for the hardware RNG.
+void halHostSetMillis(uint32_t ms);
+void halHostAdvanceMillis(uint32_t ms);
+void halHostSeedRandom(uint32_t seed);
@@ -0,0 +1,105 @@
+#include <string.h>
+#include "hal_host.h"
+#include "mac_generator.h"
+#include "test_support.h"
+
+TEST(macParseAcceptsUpperAndLowerCase)
+{
+  static const uint8_t expected[6] = {0xC2, 0x52, 0xF5, 0xC7, 0xD6, 0xFE};
+  uint8_t mac[6];
+  CHECK(macParse("C2:52:F5:C7:D6:FE", mac));
+  CHECK(memcmp(mac, expected, 6) == 0);
+  CHECK(macParse("c2:52:f5:c7:d6:fe", mac));
+  CHECK(memcmp(mac, expected, 6) == 0);
+}
+
+TEST(macParseIgnoresWhitespace)
+{
+  static const uint8_t expected[6] = {0x01, 0x23, 0x45, 0x67, 0x89, 0xAB};
+  uint8_t mac[6];
+  CHECK(macParse("  01:23: 45:67 :89:ab\r\n", mac));
+  CHECK(memcmp(mac, expected, 6) == 0);
+}
+
+TEST(macParseRejectsMalformedText)
+{
+  static const char *invalid[] = {
+      "",
+      "C2:52:F5:C7:D6",
+      "C2:52:F5:C7:D6:FE:00",
+      "C2-52-F5-C7-D6-FE",
+      "C2:52:F5:C7:D6:FG",
+      "C252F5C7D6FE",
+      "C2::52:F5:C7:D6F",
+  };
+  for (size_t i = 0; i < sizeof(invalid) / sizeof(invalid[0]); i++)
+  {
+    uint8_t mac[6] = {0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA};
+    CHECK(!macParse(invalid[i], mac));
+    CHECK_EQ(mac[0], 0xAA);
+  }
+}
+
+TEST(macGeneratorSeededSequenceRepeats)
+{
+  uint8_t first[8][6];
+  macGeneratorReset(1234);
+  for (int i = 0; i < 8; i++)
+  {
+    macGeneratorNext(first[i]);
+  }
+  macGeneratorReset(1234);
+  for (int i = 0; i < 8; i++)
+  {
+    uint8_t mac[6];
+    macGeneratorNext(mac);
+    CHECK(memcmp(mac, first[i], 6) == 0);
+  }
+  CHECK(macGeneratorSeeded());
+  CHECK_EQ(macGeneratorIssued(), 8);
+}
+
+TEST(macGeneratorAddressesAreRandomStatic)
+{
+  macGeneratorReset(42);
+  for (int i = 0; i < 2 * MAC_BLOOM_CAPACITY + 10; i++)
+  {
+    uint8_t mac[6];
+    macGeneratorNext(mac);
+    CHECK_EQ(mac[0] & 0xC3, 0xC2);
+    CHECK(mac[5] < 0xFE);
+  }
+}
+
+TEST(macGeneratorNeverRepeatsWithinCapacity)
+{
+  static uint8_t issued[MAC_BLOOM_CAPACITY][6];
+  macGeneratorReset(7);
+  for (int i = 0; i < MAC_BLOOM_CAPACITY; i++)
+  {
+    macGeneratorNext(issued[i]);
+  }
+  int duplicates = 0;
+  for (int i = 0; i < MAC_BLOOM_CAPACITY; i++)
+  {
+    for (int j = i + 1; j < MAC_BLOOM_CAPACITY; j++)
+    {
+      duplicates += memcmp(issued[i], issued[j], 6) == 0;
+    }
+  }
+  CHECK_EQ(duplicates, 0);
+}
+
+TEST(macGeneratorUnseededDrawsFromHal)
+{
+  uint8_t a[6];
+  uint8_t b[6];
+  halHostSeedRandom(99);
+  macGeneratorReset(0);
+  macGeneratorNext(a);
+  halHostSeedRandom(99);
+  macGeneratorReset(0);
+  macGeneratorNext(b);
+  CHECK(!macGeneratorSeeded());
+  CHECK(memcmp(a, b, 6) == 0);
+}
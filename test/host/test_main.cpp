@@ -0,0 +1,49 @@
+#include <string.h>
+#include "test_support.h"
+
+static TestCase *firstTest = nullptr;
+static TestCase **lastTest = &firstTest;
+static int failures = 0;
+
+void testRegister(TestCase &test)
+{
+  *lastTest = &test;
+  lastTest = &test.next;
+}
+
+void testFail(const char *file, int line, const char *expression)
+{
+  printf("  %s:%d: CHECK(%s) falhou\n", file, line, expression);
+  failures++;
+}
+
+void testFailValues(const char *file, int line, const char *expression, long long actual, long long expected)
+{
+  printf("  %s:%d: CHECK_EQ(%s) falhou: %lld != %lld\n", file, line, expression, actual, expected);
+  failures++;
+}
+
+// An optional argument runs only the tests whose name contains it.
+int main(int argc, char **argv)
+{
+  const char *filter = argc > 1 ? argv[1] : nullptr;
+  int run = 0;
+  int failed = 0;
+  for (TestCase *test = firstTest; test != nullptr; test = test->next)
+  {
+    if (filter != nullptr && strstr(test->name, filter) == nullptr)
+    {
+      continue;
+    }
+    int before = failures;
+    test->run();
+    run++;
+    if (failures != before)
+    {
+      failed++;
+      printf("FALHOU %s\n", test->name);
+    }
+  }
+  printf("%d testes, %d falharam\n", run, failed);
+  return failed == 0 ? 0 : 1;
+}
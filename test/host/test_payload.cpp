@@ -0,0 +1,85 @@
+#include <string.h>
+#include "adv_payload.h"
+#include "device_profile.h"
+#include "test_support.h"
+
+TEST(hw706PrimaryPacketLayout)
+{
+  static const uint8_t expected[] = {0x02, 0x01, 0x06,
+                                     0x07, 0xFF, 0x05, 0xFF, 0x01, 55, 0x06, 77,
+                                     0x0B, 0x03, 0x0D, 0x18, 0x1C, 0x18, 0x0F, 0x18, 0x0A, 0x18, 0x00, 0xFD};
+  SensorPayload payload;
+  CHECK(payload.build(0, "HW706-0047980", 77, 55));
+  CHECK_EQ(payload.adv.length(), sizeof(expected));
+  CHECK(memcmp(payload.adv.data(), expected, sizeof(expected)) == 0);
+  CHECK_EQ(payload.scanRsp.length(), AD_FIELD_SIZE(13));
+  CHECK_EQ(payload.scanRsp.data()[1], AD_TYPE_NAME_COMPLETE);
+}
+
+TEST(readingsArePatchedInPlace)
+{
+  SensorPayload payload;
+  payload.build(0, "HW706-0047980", 60, 100);
+  payload.setBpm(123);
+  payload.setBattery(42);
+  uint8_t bpm = 0;
+  uint8_t battery = 0;
+  CHECK(sensorPayloadDecode(payload.adv.data(), payload.adv.length(), bpm, battery));
+  CHECK_EQ(bpm, 123);
+  CHECK_EQ(battery, 42);
+}
+
+TEST(profileWithoutManufacturerBlockIsNotDecoded)
+{
+  SensorPayload payload;
+  payload.build(1, "HRM-0047980", 80, 90);
+  payload.setBpm(81);
+  uint8_t bpm = 0;
+  uint8_t battery = 0;
+  CHECK(!sensorPayloadDecode(payload.adv.data(), payload.adv.length(), bpm, battery));
+  CHECK_EQ(payload.adv.data()[3], AD_FIELD_SIZE(8) - 1);
+  CHECK_EQ(payload.adv.data()[4], AD_TYPE_UUID16_COMPLETE);
+}
+
+TEST(everyProfileFitsItsBudget)
+{
+  for (size_t i = 0; i < DEVICE_PROFILE_COUNT; i++)
+  {
+    const DeviceProfile &profile = deviceProfiles[i];
+    SensorPayload payload;
+    CHECK(payload.build(i, profile.baseName, 70, 80));
+    CHECK(payload.adv.length() <= ADV_PAYLOAD_MAX);
+    CHECK(payload.scanRsp.length() <= ADV_PAYLOAD_MAX);
+  }
+}
+
+TEST(longNameIsShortenedIntoTheScanResponse)
+{
+  char name[SENSOR_NAME_MAX + 5];
+  memset(name, 'N', sizeof(name) - 1);
+  name[sizeof(name) - 1] = '\0';
+  SensorPayload payload;
+  CHECK(!payload.build(0, name, 70, 80));
+  CHECK_EQ(payload.scanRsp.length(), ADV_PAYLOAD_MAX);
+  CHECK_EQ(payload.scanRsp.data()[1], AD_TYPE_NAME_SHORT);
+}
+
+TEST(unknownProfileUsesTheDefault)
+{
+  SensorPayload fallback;
+  SensorPayload reference;
+  fallback.build(0xFF, nullptr, 70, 80);
+  reference.build(DEVICE_PROFILE_DEFAULT, nullptr, 70, 80);
+  CHECK_EQ(fallback.adv.length(), reference.adv.length());
+  CHECK(memcmp(fallback.adv.data(), reference.adv.data(), reference.adv.length()) == 0);
+  CHECK_EQ(fallback.scanRsp.length(), 0);
+}
+
+TEST(decodeRejectsTruncatedStructures)
+{
+  SensorPayload payload;
+  payload.build(0, nullptr, 70, 80);
+  uint8_t bpm = 0;
+  uint8_t battery = 0;
+  CHECK(!sensorPayloadDecode(payload.adv.data(), 8, bpm, battery));
+}
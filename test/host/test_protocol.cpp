@@ -0,0 +1,54 @@
+#include <string.h>
+#include "protocol.h"
+#include "test_support.h"
+
+static ProtocolParseResult feedAll(ProtocolParser &parser, const uint8_t *data, size_t length)
+{
+  ProtocolParseResult result = PROTOCOL_PARSE_PENDING;
+  for (size_t i = 0; i < length; i++)
+  {
+    result = parser.feed(data[i]);
+  }
+  return result;
+}
+
+TEST(encodedFrameParsesBack)
+{
+  uint8_t payload[5] = {1, 2, 3, 4, 5};
+  uint8_t encoded[PROTOCOL_OVERHEAD + sizeof(payload)];
+  CHECK_EQ(protocolEncode(PROTOCOL_OP_SET_INTERVAL, payload, sizeof(payload), encoded), sizeof(encoded));
+
+  ProtocolParser parser;
+  CHECK_EQ(feedAll(parser, encoded, sizeof(encoded)), PROTOCOL_PARSE_FRAME);
+  CHECK_EQ(parser.frame().opcode, PROTOCOL_OP_SET_INTERVAL);
+  CHECK_EQ(parser.frame().length, sizeof(payload));
+  CHECK(memcmp(parser.frame().payload, payload, sizeof(payload)) == 0);
+}
+
+TEST(corruptedFrameFailsTheCrc)
+{
+  uint8_t payload[2] = {0x10, 0x20};
+  uint8_t encoded[PROTOCOL_OVERHEAD + sizeof(payload)];
+  protocolEncode(PROTOCOL_OP_PING, payload, sizeof(payload), encoded);
+  encoded[4] ^= 0x01;
+
+  ProtocolParser parser;
+  CHECK_EQ(feedAll(parser, encoded, sizeof(encoded)), PROTOCOL_PARSE_BAD_CRC);
+}
+
+TEST(oversizedLengthIsRejected)
+{
+  uint8_t header[3] = {PROTOCOL_SOF, (PROTOCOL_MAX_PAYLOAD + 1) & 0xFF, (PROTOCOL_MAX_PAYLOAD + 1) >> 8};
+  ProtocolParser parser;
+  CHECK_EQ(feedAll(parser, header, sizeof(header)), PROTOCOL_PARSE_TOO_LONG);
+}
+
+TEST(littleEndianHelpersRoundTrip)
+{
+  uint8_t buffer[4];
+  protocolPutU32(buffer, 0x12345678UL);
+  CHECK_EQ(buffer[0], 0x78);
+  CHECK_EQ(protocolGetU32(buffer), 0x12345678UL);
+  protocolPutU16(buffer, 0xBEEF);
+  CHECK_EQ(protocolGetU16(buffer), 0xBEEF);
+}
@@ -0,0 +1,78 @@
+#include "scheduler.h"
+#include "test_support.h"
+
+TEST(schedulerEqualWeightsRoundRobin)
+{
+  IdentityScheduler scheduler;
+  CHECK(scheduler.begin(4, 100, 0, 1));
+  for (uint32_t pick = 0; pick < 12; pick++)
+  {
+    CHECK_EQ(scheduler.next(pick * 100), pick % 4);
+  }
+}
+
+TEST(schedulerDwellFollowsWeightRatio)
+{
+  IdentityScheduler scheduler;
+  CHECK(scheduler.begin(3, 100, 0, 1));
+  scheduler.setProfile(0, 0, 0, false, 3);
+
+  int picks[3] = {0, 0, 0};
+  for (uint32_t pick = 0; pick < 500; pick++)
+  {
+    picks[scheduler.next(pick * 100)]++;
+  }
+  CHECK(picks[0] >= 295 && picks[0] <= 305);
+  CHECK(picks[1] >= 95 && picks[1] <= 105);
+  CHECK(picks[2] >= 95 && picks[2] <= 105);
+}
+
+TEST(schedulerZeroWeightCountsAsOne)
+{
+  IdentityScheduler scheduler;
+  CHECK(scheduler.begin(2, 100, 0, 1));
+  scheduler.setProfile(1, 0, 0, false, 0);
+  for (uint32_t pick = 0; pick < 8; pick++)
+  {
+    CHECK_EQ(scheduler.next(pick * 100), pick % 2);
+  }
+}
+
+TEST(schedulerPicksTheMostOverdue)
+{
+  IdentityScheduler scheduler;
+  CHECK(scheduler.begin(3, 1000, 0, 1));
+  CHECK_EQ(scheduler.next(0), 0);
+  CHECK_EQ(scheduler.next(0), 1);
+  // 0 and 1 come due again at 3000; 2 has been due since 2.
+  CHECK_EQ(scheduler.next(5000), 2);
+  CHECK_EQ(scheduler.lastAdvertised(2), 5000);
+  CHECK_EQ(scheduler.next(5000), 0);
+  CHECK_EQ(scheduler.next(5000), 1);
+}
+
+TEST(schedulerSkipsExcludedIdentities)
+{
+  IdentityScheduler scheduler;
+  CHECK(scheduler.begin(4, 100, 0, 1));
+  const uint8_t exclude[] = {0, 1};
+  CHECK_EQ(scheduler.next(10, exclude, 2), 2);
+  CHECK_EQ(scheduler.next(10, exclude, 2), 3);
+  CHECK_EQ(scheduler.next(10), 0);
+}
+
+TEST(schedulerClampsToCapacity)
+{
+  IdentityScheduler scheduler;
+  CHECK(!scheduler.begin(0, 100, 0, 1));
+  CHECK(!scheduler.active());
+
+  CHECK(scheduler.begin(SCHEDULER_MAX_IDENTITIES + 10, 100, 0, 1));
+  CHECK_EQ(scheduler.count(), SCHEDULER_MAX_IDENTITIES);
+  for (uint32_t pick = 0; pick < SCHEDULER_MAX_IDENTITIES + 10; pick++)
+  {
+    CHECK(scheduler.next(pick) < SCHEDULER_MAX_IDENTITIES);
+  }
+  scheduler.end();
+  CHECK(!scheduler.active());
+}
@@ -0,0 +1,77 @@
+#include "signal_model.h"
+#include "test_support.h"
+
+TEST(steppedModelPingPongsBetween60And180)
+{
+  SignalState s;
+  signalInit(s, SIGNAL_MODEL_STEPPED, 60, 100, 1);
+  for (int i = 1; i <= 120; i++)
+  {
+    signalAdvance(s, 250);
+    CHECK_EQ(s.bpm, 60 + i);
+  }
+  CHECK_EQ(s.bpmDir, 1);
+  for (int i = 1; i <= 120; i++)
+  {
+    signalAdvance(s, 250);
+    CHECK_EQ(s.bpm, 180 - i);
+  }
+  CHECK_EQ(s.bpmDir, 0);
+}
+
+TEST(steppedModelRecoversFromOutOfRangeState)
+{
+  SignalState s;
+  signalInit(s, SIGNAL_MODEL_STEPPED, 200, 100, 1);
+  s.bpmDir = 7;
+  signalAdvance(s, 250);
+  CHECK_EQ(s.bpm, 61);
+  CHECK_EQ(s.bpmDir, 0);
+}
+
+TEST(everyModelStaysInsideTheBpmLimits)
+{
+  for (uint8_t model = SIGNAL_MODEL_RAMP; model < SIGNAL_MODEL_COUNT; model++)
+  {
+    SignalState s;
+    signalInit(s, model, 70, 100, 12345);
+    for (int i = 0; i < 4000; i++)
+    {
+      signalAdvance(s, 500);
+      CHECK(s.bpm >= SIGNAL_MIN_BPM && s.bpm <= SIGNAL_MAX_BPM);
+      CHECK(s.battery <= 100);
+    }
+  }
+}
+
+TEST(batteryDrainsOnePercentPer36Seconds)
+{
+  SignalState s;
+  signalInit(s, SIGNAL_MODEL_SINE, 70, 100, 1);
+  signalAdvance(s, 35999);
+  CHECK_EQ(s.battery, 100);
+  signalAdvance(s, 1);
+  CHECK_EQ(s.battery, 99);
+}
+
+TEST(batteryDrainsFromItsInitialLevel)
+{
+  SignalState s;
+  signalInit(s, SIGNAL_MODEL_RAMP, 70, 42, 1);
+  s.elapsedMs = 500000;
+  signalAdvance(s, 1000);
+  CHECK_EQ(s.battery, 42);
+  signalAdvance(s, 35000);
+  CHECK_EQ(s.battery, 41);
+  signalAdvance(s, 41 * 36000UL);
+  CHECK_EQ(s.battery, 0);
+  signalAdvance(s, 36000);
+  CHECK_EQ(s.battery, 100);
+}
+
+TEST(unknownModelFallsBackToStepped)
+{
+  SignalState s;
+  signalInit(s, SIGNAL_MODEL_COUNT, 60, 100, 1);
+  CHECK_EQ(s.model, SIGNAL_MODEL_STEPPED);
+}
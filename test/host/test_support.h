@@ -0,0 +1,45 @@
+#pragma once
+
+#include <stdio.h>
+
+typedef void (*TestFunction)();
+
+struct TestCase
+{
+  const char *name;
+  TestFunction run;
+  TestCase *next;
+};
+
+void testRegister(TestCase &test);
+void testFail(const char *file, int line, const char *expression);
+void testFailValues(const char *file, int line, const char *expression, long long actual, long long expected);
+
+#define TEST(name)                                                    \
+  static void name();                                                 \
+  static TestCase name##Case = {#name, name, nullptr};                \
+  static struct name##Registrar                                       \
+  {                                                                   \
+    name##Registrar() { testRegister(name##Case); }                   \
+  } name##RegistrarInstance;                                          \
+  static void name()
+
+#define CHECK(condition)                        \
+  do                                            \
+  {                                             \
+    if (!(condition))                           \
+    {                                           \
+      testFail(__FILE__, __LINE__, #condition); \
+    }                                           \
+  } while (0)
+
+#define CHECK_EQ(actual, expected)                                                       \
+  do                                                                                     \
+  {                                                                                      \
+    long long actualValue = (long long)(actual);                                         \
+    long long expectedValue = (long long)(expected);                                     \
+    if (actualValue != expectedValue)                                                    \
+    {                                                                                    \
+      testFailValues(__FILE__, __LINE__, #actual " == " #expected, actualValue, expectedValue); \
+    }                                                                                    \
+  } while (0)